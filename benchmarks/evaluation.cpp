@@ -6,5 +6,235 @@
  */
 
 #include <benchmark/benchmark.h>
+#include <fsd/chebyshev.h>
+#include <fsd/compile.h>
+#include <fsd/constant.h>
+#include <fsd/flat.h>
+#include <fsd/interval.h>
+#include <fsd/lazy.h>
+#include <fsd/literal.h>
+#include <fsd/operations.h>
+#include <fsd/variable.h>
 
-BENCHMARK_MAIN();
\ No newline at end of file
+namespace {
+
+// sum_{i=1}^{n} i * x^2 * y
+fsd::Expression polynomial(int n) {
+  fsd::Expression expr = fsd::constant(0);
+  for (int i = 1; i <= n; ++i) {
+    expr = expr + fsd::constant(i) * fsd::pow(fsd::variable("x"), fsd::constant(2)) * fsd::variable("y");
+  }
+  return expr;
+}
+
+// sum_{i=1}^{n} 1 / (i + x^2): many divisions, cheap to approximate
+fsd::Expression rational(int n) {
+  std::vector<fsd::Expression> terms;
+  for (int i = 1; i <= n; ++i) {
+    terms.push_back(fsd::constant(1) /
+                    (fsd::constant(i) + fsd::pow(fsd::variable("x"), fsd::constant(2))));
+  }
+  return fsd::sum(std::move(terms));
+}
+
+}  // namespace
+
+static void BM_TreeEvaluate(benchmark::State& state) {
+  const auto expr = polynomial(static_cast<int>(state.range(0)));
+  const std::map<std::string, double> values {{"x", 1.5}, {"y", 0.5}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(expr->evaluate(values));
+  }
+}
+BENCHMARK(BM_TreeEvaluate)->Range(8, 8 << 10);
+
+// derivative evaluated once: built as a term or computed on the source
+static void BM_DerivativeEager(benchmark::State& state) {
+  const auto expr = polynomial(static_cast<int>(state.range(0)));
+  const std::map<std::string, double> values {{"x", 1.5}, {"y", 0.5}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(expr->derivative("x")->evaluate(values));
+  }
+}
+BENCHMARK(BM_DerivativeEager)->Range(8, 8 << 10);
+
+static void BM_DerivativeLazy(benchmark::State& state) {
+  const auto expr = polynomial(static_cast<int>(state.range(0)));
+  const std::map<std::string, double> values {{"x", 1.5}, {"y", 0.5}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fsd::lazy_derivative(expr, "x").evaluate(values));
+  }
+}
+BENCHMARK(BM_DerivativeLazy)->Range(8, 8 << 10);
+
+static void BM_FlatEvaluate(benchmark::State& state) {
+  const auto flat = fsd::flatten(*polynomial(static_cast<int>(state.range(0))));
+  std::vector<double> values(flat.symbols().size());
+  values[flat.symbol_id("x").value()] = 1.5;
+  values[flat.symbol_id("y").value()] = 0.5;
+  std::vector<double> scratch(flat.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(flat.evaluate(values, scratch));
+  }
+}
+BENCHMARK(BM_FlatEvaluate)->Range(8, 8 << 10);
+
+static void BM_ProgramEvaluate(benchmark::State& state) {
+  const auto program = fsd::compile(*polynomial(static_cast<int>(state.range(0))));
+  std::vector<double> values(program.symbols().size());
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = program.symbols()[i] == "x" ? 1.5 : 0.5;
+  }
+  std::vector<double> registers(program.registers());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.evaluate(values, registers));
+  }
+}
+BENCHMARK(BM_ProgramEvaluate)->Range(8, 8 << 10);
+
+// f, df/dx and df/dy as three programs vs. one kernel
+static void BM_GradientSeparate(benchmark::State& state) {
+  const auto f = polynomial(static_cast<int>(state.range(0)));
+  const std::vector<fsd::Program> programs {fsd::compile(*f), fsd::compile(*f->derivative("x")),
+                                            fsd::compile(*f->derivative("y"))};
+  const std::map<std::string, double> var {{"x", 1.5}, {"y", 0.5}};
+  std::vector<std::vector<double>> values;
+  for (const auto& program : programs) {
+    values.emplace_back();
+    for (const auto& symbol : program.symbols()) {
+      values.back().push_back(var.at(symbol));
+    }
+  }
+  std::vector<double> registers(std::ranges::max(programs, {}, &fsd::Program::registers).registers());
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < programs.size(); ++i) {
+      benchmark::DoNotOptimize(programs[i].evaluate(values[i], registers));
+    }
+  }
+}
+BENCHMARK(BM_GradientSeparate)->Range(8, 512);
+
+static void BM_GradientKernel(benchmark::State& state) {
+  const auto f = polynomial(static_cast<int>(state.range(0)));
+  const std::vector<fsd::Expression> outputs {f, f->derivative("x"), f->derivative("y")};
+  const auto kernel = fsd::compile_kernel(outputs);
+  std::vector<double> values;
+  for (const auto& symbol : kernel.symbols()) {
+    values.push_back(symbol == "x" ? 1.5 : 0.5);
+  }
+  std::vector<double> registers(kernel.registers());
+  std::vector<double> results(outputs.size());
+  for (auto _ : state) {
+    kernel.evaluate(values, registers, results);
+    benchmark::DoNotOptimize(results.data());
+  }
+  state.counters["saved_operations"] = static_cast<double>(kernel.saved_operations());
+}
+BENCHMARK(BM_GradientKernel)->Range(8, 512);
+
+// 4096 points of an expression vs. its Chebyshev surrogate on [0, 1]
+static void BM_RationalBatch(benchmark::State& state) {
+  const auto flat = fsd::flatten(*rational(static_cast<int>(state.range(0))));
+  std::vector<double> x(4096);
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    x[i] = static_cast<double>(i) / static_cast<double>(x.size());
+  }
+  const std::vector<const double*> columns {x.data()};
+  std::vector<double> result(x.size());
+  for (auto _ : state) {
+    flat.evaluate(columns, result);
+    benchmark::DoNotOptimize(result.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * x.size()));
+}
+BENCHMARK(BM_RationalBatch)->Range(8, 512);
+
+static void BM_SurrogateBatch(benchmark::State& state) {
+  const auto series = fsd::approximate(*rational(static_cast<int>(state.range(0))), {"x", 0, 1});
+  std::vector<double> x(4096);
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    x[i] = static_cast<double>(i) / static_cast<double>(x.size());
+  }
+  std::vector<double> result(x.size());
+  for (auto _ : state) {
+    series.evaluate(x, result);
+    benchmark::DoNotOptimize(result.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * x.size()));
+  state.counters["degree"] = static_cast<double>(series.degree());
+}
+BENCHMARK(BM_SurrogateBatch)->Range(8, 512);
+
+// parsed at compile time vs. parsed and flattened at runtime
+static void BM_LiteralEvaluate(benchmark::State& state) {
+  using namespace fsd::literals;
+  constexpr auto expr = "1*x**2*y + 2*x**2*y + 3*x**2*y + 4*x**2*y + 5*x**2*y + 6*x**2*y + 7*x**2*y + 8*x**2*y"_fsd;
+  const double values[] = {1.5, 0.5};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(expr.evaluate(values));
+  }
+}
+BENCHMARK(BM_LiteralEvaluate);
+
+// cost of one node of the given type (a chain of 256 of them), the default CostModel of fsd/egraph.h is derived from it.
+// The constant operand is the integer -1, which keeps the values bounded for every type, powers included.
+static void BM_NodeCost(benchmark::State& state) {
+  const auto type = static_cast<fsd::Node_TP>(state.range(0));
+  fsd::FlatExpression flat;
+  std::uint32_t value = flat.emplace_variable(flat.intern("x"));
+  const std::uint32_t c = flat.emplace_constant(-1, true);
+  for (int i = 0; i < 256; ++i) {
+    value = flat.emplace(type, value, c);
+  }
+  const std::vector<double> values {1.5};
+  std::vector<double> scratch(flat.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(flat.evaluate(values, scratch));
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * 256));
+}
+BENCHMARK(BM_NodeCost)->DenseRange(static_cast<int>(fsd::Node_TP::ADD), static_cast<int>(fsd::Node_TP::POW));
+
+// cost of one leaf of the given type plus one addition (a sum of 256 new leaves), subtract BM_NodeCost of ADD
+static void BM_LeafCost(benchmark::State& state) {
+  const auto type = static_cast<fsd::Node_TP>(state.range(0));
+  fsd::FlatExpression flat;
+  const std::uint32_t symbol = flat.intern("x");
+  std::uint32_t value = flat.emplace_variable(symbol);
+  for (int i = 0; i < 256; ++i) {
+    const std::uint32_t leaf =
+      type == fsd::Node_TP::CONSTANT ? flat.emplace_constant(-1, true) : flat.emplace_variable(symbol);
+    value = flat.emplace(fsd::Node_TP::ADD, value, leaf);
+  }
+  const std::vector<double> values {1.5};
+  std::vector<double> scratch(flat.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(flat.evaluate(values, scratch));
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * 256));
+}
+BENCHMARK(BM_LeafCost)->DenseRange(static_cast<int>(fsd::Node_TP::CONSTANT), static_cast<int>(fsd::Node_TP::VARIABLE));
+
+// batch evaluation of 4096 points, compares the scalar types
+template <typename T>
+static void BM_FlatBatchEvaluate(benchmark::State& state) {
+  const auto flat = fsd::flatten(*polynomial(static_cast<int>(state.range(0))));
+  constexpr std::size_t points = 4096;
+  std::vector<T> x(points, T(1.5));
+  std::vector<T> y(points, T(0.5));
+  std::vector<const T*> columns(flat.symbols().size());
+  columns[flat.symbol_id("x").value()] = x.data();
+  columns[flat.symbol_id("y").value()] = y.data();
+  std::vector<T> result(points);
+  for (auto _ : state) {
+    flat.evaluate<T>(columns, result);
+    benchmark::DoNotOptimize(result.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * points));
+}
+BENCHMARK(BM_FlatBatchEvaluate<float>)->Range(8, 512);
+BENCHMARK(BM_FlatBatchEvaluate<double>)->Range(8, 512);
+BENCHMARK(BM_FlatBatchEvaluate<long double>)->Range(8, 512);
+BENCHMARK(BM_FlatBatchEvaluate<fsd::Interval>)->Range(8, 512);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,396 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+// Python bindings written against the CPython C API. Arrays are accepted through the buffer protocol, so NumPy arrays
+// (and any other contiguous float64 buffer) are evaluated in place without copying and with the GIL released.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <fsd/flat.h>
+#include <fsd/parser.h>
+
+#include <exception>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct PyExpression {
+  PyObject_HEAD
+  fsd::FlatExpression flat;
+};
+
+// heap type created from PyExpression_spec by PyInit_fsd()
+PyTypeObject* PyExpression_Type = nullptr;
+
+PyObject* wrap(fsd::FlatExpression flat) {
+  auto* self = PyObject_New(PyExpression, PyExpression_Type);
+  if (self == nullptr) {
+    return nullptr;
+  }
+  new (&self->flat) fsd::FlatExpression(std::move(flat));
+  return reinterpret_cast<PyObject*>(self);
+}
+
+void PyExpression_dealloc(PyObject* self) {
+  // instances of heap types hold a reference to their type
+  PyTypeObject* type = Py_TYPE(self);
+  reinterpret_cast<PyExpression*>(self)->flat.~FlatExpression();
+  PyObject_Free(self);
+  Py_DECREF(type);
+}
+
+/**
+ * Calls f, an entry point returning a new reference or nullptr with a Python error set, and translates C++ exceptions
+ * into Python errors. No exception may cross the C API boundary.
+ */
+template <typename F>
+PyObject* guarded(F&& f) noexcept {
+  try {
+    return f();
+  } catch (const std::bad_alloc&) {
+    return PyErr_NoMemory();
+  } catch (const std::invalid_argument& e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+  } catch (const std::exception& e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+  } catch (...) {
+    PyErr_SetString(PyExc_RuntimeError, "unknown C++ exception");
+  }
+  return nullptr;
+}
+
+/// Owns a reference to a Python object, so it is released if an exception is thrown before it is returned.
+class Reference {
+ public:
+  explicit Reference(PyObject* object = nullptr) : _object(object) {}
+  Reference(const Reference&) = delete;
+  Reference& operator=(const Reference&) = delete;
+  ~Reference() { Py_XDECREF(_object); }
+
+  [[nodiscard]] PyObject* get() const { return _object; }
+  PyObject* release() { return std::exchange(_object, nullptr); }
+  void reset(PyObject* object) {
+    Py_XDECREF(_object);
+    _object = object;
+  }
+
+ private:
+  PyObject* _object;
+};
+
+/// Owns a buffer acquired from a Python object and releases it on destruction.
+class Buffer {
+ public:
+  Buffer() = default;
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+  ~Buffer() {
+    if (_acquired) {
+      PyBuffer_Release(&_view);
+    }
+  }
+
+  /// Acquires a C contiguous float64 buffer. Sets a Python exception and returns false on failure.
+  bool acquire(PyObject* object, const char* name, bool writable) {
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    if (writable) {
+      flags |= PyBUF_WRITABLE;
+    }
+    if (PyObject_GetBuffer(object, &_view, flags) != 0) {
+      return false;
+    }
+    _acquired = true;
+    const std::string format = _view.format != nullptr ? _view.format : "B";
+    if (_view.itemsize != sizeof(double) || (format != "d" && format != "<d" && format != "=d" && format != "@d")) {
+      PyErr_Format(PyExc_TypeError, "'%s' must be a contiguous float64 array", name);
+      return false;
+    }
+    return true;
+  }
+
+  [[nodiscard]] double* data() const { return static_cast<double*>(_view.buf); }
+  [[nodiscard]] std::size_t size() const { return static_cast<std::size_t>(_view.len) / sizeof(double); }
+  [[nodiscard]] const Py_buffer& view() const { return _view; }
+
+ private:
+  Py_buffer _view {};
+  bool _acquired {false};
+};
+
+/// Returns a tuple describing the shape of view, a 1-d shape for scalars.
+PyObject* shape_of(const Py_buffer& view) {
+  if (view.ndim == 0 || view.shape == nullptr) {
+    return Py_BuildValue("(n)", view.len / view.itemsize);
+  }
+  PyObject* shape = PyTuple_New(view.ndim);
+  for (int i = 0; shape != nullptr && i < view.ndim; ++i) {
+    PyTuple_SET_ITEM(shape, i, PyLong_FromSsize_t(view.shape[i]));
+  }
+  return shape;
+}
+
+PyObject* evaluate(const fsd::FlatExpression& flat, PyObject* args, PyObject* kwargs) {
+  if (PyTuple_GET_SIZE(args) != 0) {
+    PyErr_SetString(PyExc_TypeError, "evaluate() takes variables as keyword arguments only");
+    return nullptr;
+  }
+  const auto& symbols = flat.symbols();
+  std::vector<bool> used(symbols.size());
+  for (const auto& node : flat.nodes()) {
+    if (node.type == fsd::Node_TP::VARIABLE) {
+      used[node.lhs] = true;
+    }
+  }
+
+  // scalar arguments for all variables are evaluated directly and return a float
+  std::vector<double> scalars(symbols.size());
+  std::vector<PyObject*> objects(symbols.size());
+  std::vector<bool> given(symbols.size());
+  PyObject* out = nullptr;
+  bool all_scalar = true;
+  if (kwargs != nullptr) {
+    PyObject* key;
+    PyObject* value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(kwargs, &pos, &key, &value)) {
+      const char* name = PyUnicode_AsUTF8(key);
+      if (name == nullptr) {
+        return nullptr;
+      }
+      if (std::string_view(name) == "out") {
+        out = value;
+        all_scalar = false;
+        continue;
+      }
+      const auto symbol = flat.symbol_id(name);
+      if (!symbol.has_value()) {
+        PyErr_Format(PyExc_TypeError, "unknown variable '%s'", name);
+        return nullptr;
+      }
+      given[symbol.value()] = true;
+      if (PyFloat_Check(value) || PyLong_Check(value)) {
+        scalars[symbol.value()] = PyFloat_AsDouble(value);
+        if (PyErr_Occurred() != nullptr) {
+          return nullptr;
+        }
+      } else {
+        objects[symbol.value()] = value;
+        all_scalar = false;
+      }
+    }
+  }
+  for (std::size_t i = 0; i < symbols.size(); ++i) {
+    if (used[i] && !given[i]) {
+      PyErr_Format(PyExc_TypeError, "no value for variable '%s'", symbols[i].c_str());
+      return nullptr;
+    }
+  }
+  if (all_scalar) {
+    const double result = flat.evaluate(scalars);
+    return PyFloat_FromDouble(result);
+  }
+
+  std::vector<Buffer> buffers(symbols.size());
+  std::optional<std::size_t> size;
+  Reference shape;
+  for (std::size_t i = 0; i < symbols.size(); ++i) {
+    if (objects[i] == nullptr) {
+      continue;
+    }
+    if (!buffers[i].acquire(objects[i], symbols[i].c_str(), false)) {
+      return nullptr;
+    }
+    if (size.has_value() && size.value() != buffers[i].size()) {
+      PyErr_SetString(PyExc_ValueError, "all arrays must have the same number of elements");
+      return nullptr;
+    }
+    if (!size.has_value()) {
+      size = buffers[i].size();
+      shape.reset(shape_of(buffers[i].view()));
+      if (shape.get() == nullptr) {
+        return nullptr;
+      }
+    }
+  }
+
+  // the result is either written to 'out' or to a new buffer returned as memoryview (numpy.asarray() does not copy)
+  Reference result;
+  Buffer result_buffer;
+  if (out != nullptr) {
+    if (!result_buffer.acquire(out, "out", true)) {
+      return nullptr;
+    }
+    if (size.has_value() && size.value() != result_buffer.size()) {
+      PyErr_SetString(PyExc_ValueError, "'out' must have the same number of elements as the input arrays");
+      return nullptr;
+    }
+    size = result_buffer.size();
+    Py_INCREF(out);
+    result.reset(out);
+  } else {
+    const Reference bytes(
+        PyByteArray_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(size.value() * sizeof(double))));
+    if (bytes.get() == nullptr) {
+      return nullptr;
+    }
+    const Reference view(PyMemoryView_FromObject(bytes.get()));
+    if (view.get() == nullptr) {
+      return nullptr;
+    }
+    result.reset(PyObject_CallMethod(view.get(), "cast", "sO", "d", shape.get()));
+    if (result.get() == nullptr || !result_buffer.acquire(result.get(), "out", true)) {
+      return nullptr;
+    }
+  }
+
+  // scalar arguments are broadcast
+  std::vector<std::vector<double>> broadcast(symbols.size());
+  std::vector<const double*> columns(symbols.size());
+  for (std::size_t i = 0; i < symbols.size(); ++i) {
+    if (objects[i] != nullptr) {
+      columns[i] = buffers[i].data();
+    } else if (used[i]) {
+      broadcast[i].assign(size.value(), scalars[i]);
+      columns[i] = broadcast[i].data();
+    }
+  }
+
+  // an exception must not unwind past Py_END_ALLOW_THREADS, it is rethrown once the GIL is held again
+  std::span<double> target(result_buffer.data(), size.value());
+  std::exception_ptr error;
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    flat.evaluate(columns, target);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  Py_END_ALLOW_THREADS
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+  return result.release();
+}
+
+PyObject* PyExpression_evaluate(PyObject* py_self, PyObject* args, PyObject* kwargs) {
+  return guarded([&] { return evaluate(reinterpret_cast<PyExpression*>(py_self)->flat, args, kwargs); });
+}
+
+PyObject* PyExpression_derivative(PyObject* py_self, PyObject* arg) {
+  const auto& flat = reinterpret_cast<PyExpression*>(py_self)->flat;
+  const char* var = PyUnicode_AsUTF8(arg);
+  if (var == nullptr) {
+    return nullptr;
+  }
+  // unsupported derivatives are a ValueError, like parse errors
+  return guarded([&]() -> PyObject* {
+    try {
+      return wrap(flat.derivative(var));
+    } catch (const std::runtime_error& e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return nullptr;
+    }
+  });
+}
+
+PyObject* PyExpression_to_str(PyObject* py_self, PyObject*) {
+  return guarded([&] {
+    const std::string str = reinterpret_cast<PyExpression*>(py_self)->flat.to_str();
+    return PyUnicode_FromStringAndSize(str.data(), static_cast<Py_ssize_t>(str.size()));
+  });
+}
+
+PyObject* PyExpression_str(PyObject* py_self) { return PyExpression_to_str(py_self, nullptr); }
+
+PyObject* PyExpression_variables(PyObject* py_self, void*) {
+  const auto& symbols = reinterpret_cast<PyExpression*>(py_self)->flat.symbols();
+  PyObject* result = PyTuple_New(static_cast<Py_ssize_t>(symbols.size()));
+  for (std::size_t i = 0; result != nullptr && i < symbols.size(); ++i) {
+    PyTuple_SET_ITEM(result, i, PyUnicode_FromString(symbols[i].c_str()));
+  }
+  return result;
+}
+
+PyMethodDef PyExpression_methods[] = {
+    {"evaluate", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(PyExpression_evaluate)),
+     METH_VARARGS | METH_KEYWORDS,
+     "evaluate(out=None, **variables)\n\nEvaluates the expression. Variables are given as floats or float64 arrays of "
+     "equal size, floats are broadcast. Arrays are evaluated in native code without copying, the result is written "
+     "to 'out' or returned as memoryview."},
+    {"derivative", PyExpression_derivative, METH_O, "derivative(var)\n\nReturns the partial derivative by var."},
+    {"to_str", PyExpression_to_str, METH_NOARGS,
+     "Returns the string representation."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyGetSetDef PyExpression_getset[] = {
+    {"variables", PyExpression_variables, nullptr, "names of the variables, ordered by symbol id", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+PyType_Slot PyExpression_slots[] = {
+    {Py_tp_dealloc, reinterpret_cast<void*>(PyExpression_dealloc)},
+    {Py_tp_str, reinterpret_cast<void*>(PyExpression_str)},
+    {Py_tp_doc, const_cast<char*>("Parsed expression, create with fsd.parse().")},
+    {Py_tp_methods, PyExpression_methods},
+    {Py_tp_getset, PyExpression_getset},
+    {0, nullptr},
+};
+
+// expressions are only created by fsd.parse() and the methods, never by calling the type
+PyType_Spec PyExpression_spec = {
+    "fsd.Expression", sizeof(PyExpression), 0, Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    PyExpression_slots,
+};
+
+PyObject* fsd_parse(PyObject*, PyObject* arg) {
+  Py_ssize_t length;
+  const char* input = PyUnicode_AsUTF8AndSize(arg, &length);
+  if (input == nullptr) {
+    return nullptr;
+  }
+  return guarded([&]() -> PyObject* {
+    auto result = fsd::parse({input, static_cast<std::size_t>(length)});
+    if (!result.has_value()) {
+      PyErr_Format(PyExc_ValueError, "error parsing expression at position %zu", result.error().position);
+      return nullptr;
+    }
+    return wrap(fsd::flatten(*result.value()));
+  });
+}
+
+PyMethodDef fsd_methods[] = {
+    {"parse", fsd_parse, METH_O, "parse(expression)\n\nParses an expression string into an Expression."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef fsd_module = {
+    PyModuleDef_HEAD_INIT, "fsd", "Symbolic derivation with native batch evaluation.", -1, fsd_methods, nullptr,
+    nullptr, nullptr, nullptr,
+};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit_fsd() {
+  PyExpression_Type = reinterpret_cast<PyTypeObject*>(PyType_FromSpec(&PyExpression_spec));
+  if (PyExpression_Type == nullptr) {
+    return nullptr;
+  }
+  PyObject* module = PyModule_Create(&fsd_module);
+  if (module == nullptr) {
+    return nullptr;
+  }
+  Py_INCREF(PyExpression_Type);
+  if (PyModule_AddObject(module, "Expression", reinterpret_cast<PyObject*>(PyExpression_Type)) < 0) {
+    Py_DECREF(PyExpression_Type);
+    Py_DECREF(module);
+    return nullptr;
+  }
+  return module;
+}
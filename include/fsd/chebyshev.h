@@ -0,0 +1,124 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/flat.h>
+#include <fsd/term.h>
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsd {
+
+/// Variable of a surrogate and the interval it is approximated on.
+struct Domain {
+  std::string var;
+  double lower;
+  double upper;
+};
+
+struct ApproximationOptions {
+  /// maximal absolute error of the surrogate on its domain
+  double tolerance = 1e-10;
+  /// the degree is doubled starting from 15 (or this degree if it is lower) until the tolerance is met or doubling would
+  /// exceed this degree (per variable)
+  std::size_t max_degree = 512;
+};
+
+/**
+ * Chebyshev series sum_k c_k T_k(t) of a function of one variable x on [lower, upper], with t the affine map of x onto
+ * [-1, 1]. Evaluation is a Clenshaw recurrence over the coefficients, which is numerically stable and costs two
+ * multiply-adds per coefficient no matter how expensive the approximated expression is.
+ */
+class ChebyshevSeries {
+ public:
+  ChebyshevSeries(Domain domain, std::vector<double> coefficients, double max_error);
+
+  [[nodiscard]] double evaluate(double x) const;
+  /// evaluates result.size() points, the recurrence runs over blocks of points so the inner loops vectorize
+  void evaluate(std::span<const double> x, std::span<double> result) const;
+
+  /// Exact derivative of the series, computed from the coefficients. Its max_error() is unknown (NaN): derivatives of
+  /// the approximation error may be larger than the error itself.
+  [[nodiscard]] ChebyshevSeries derivative() const;
+
+  [[nodiscard]] const Domain& domain() const { return _domain; }
+  [[nodiscard]] const std::vector<double>& coefficients() const { return _coefficients; }
+  [[nodiscard]] std::size_t degree() const { return _coefficients.size() - 1; }
+  /// largest absolute error found on a dense check grid when the series was fitted
+  [[nodiscard]] double max_error() const { return _max_error; }
+
+  /// number of points evaluated together by the batch evaluate()
+  static constexpr std::size_t BATCH_BLOCK_SIZE = 128;
+
+ private:
+  friend ChebyshevSeries approximate(const FlatExpression& flat, const Domain& domain,
+                                     const ApproximationOptions& options);
+
+  Domain _domain;
+  std::vector<double> _coefficients;
+  double _max_error;
+};
+
+/**
+ * Tensor product Chebyshev series sum_ij c_ij T_i(s) T_j(t) of a function of two variables x and y on a rectangle.
+ * Evaluation runs a Clenshaw recurrence in y for every row of coefficients inside a Clenshaw recurrence in x.
+ */
+class ChebyshevSeries2D {
+ public:
+  /// coefficients are row major: coefficients[i * (degree_y + 1) + j] is c_ij
+  ChebyshevSeries2D(Domain x, Domain y, std::size_t degree_x, std::size_t degree_y, std::vector<double> coefficients,
+                    double max_error);
+
+  [[nodiscard]] double evaluate(double x, double y) const;
+  void evaluate(std::span<const double> x, std::span<const double> y, std::span<double> result) const;
+
+  /// exact partial derivative by the variable of axis 0 (x) or 1 (y), see ChebyshevSeries::derivative()
+  [[nodiscard]] ChebyshevSeries2D derivative(std::size_t axis) const;
+  [[nodiscard]] ChebyshevSeries2D derivative(std::string_view var) const;
+
+  [[nodiscard]] const Domain& domain_x() const { return _x; }
+  [[nodiscard]] const Domain& domain_y() const { return _y; }
+  [[nodiscard]] std::size_t degree_x() const { return _degree_x; }
+  [[nodiscard]] std::size_t degree_y() const { return _degree_y; }
+  [[nodiscard]] const std::vector<double>& coefficients() const { return _coefficients; }
+  [[nodiscard]] double max_error() const { return _max_error; }
+
+  static constexpr std::size_t BATCH_BLOCK_SIZE = ChebyshevSeries::BATCH_BLOCK_SIZE;
+
+ private:
+  friend ChebyshevSeries2D approximate(const FlatExpression& flat, const Domain& x, const Domain& y,
+                                       const ApproximationOptions& options);
+
+  Domain _x;
+  Domain _y;
+  std::size_t _degree_x;
+  std::size_t _degree_y;
+  std::vector<double> _coefficients;
+  double _max_error;
+};
+
+/**
+ * Fits a Chebyshev surrogate of flat, a function of domain.var only, by interpolation at Chebyshev points. The degree
+ * is doubled until the error measured on a grid finer than the interpolation points is below the tolerance or the
+ * maximal degree is reached; check max_error() in the latter case. Trailing coefficients below the tolerance are
+ * dropped.
+ *
+ * Throws std::invalid_argument if flat depends on other variables and std::runtime_error if it is not finite on the
+ * domain.
+ */
+ChebyshevSeries approximate(const FlatExpression& flat, const Domain& domain, const ApproximationOptions& options = {});
+ChebyshevSeries approximate(const Term_I& term, const Domain& domain, const ApproximationOptions& options = {});
+
+/// Two variable version, the degrees of both variables are adapted separately.
+ChebyshevSeries2D approximate(const FlatExpression& flat, const Domain& x, const Domain& y,
+                              const ApproximationOptions& options = {});
+ChebyshevSeries2D approximate(const Term_I& term, const Domain& x, const Domain& y,
+                              const ApproximationOptions& options = {});
+
+}  // namespace fsd
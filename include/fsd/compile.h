@@ -0,0 +1,163 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/flat.h>
+#include <fsd/interval.h>
+#include <fsd/term.h>
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace fsd {
+
+enum class OpCode_TP : std::uint8_t {
+  CONST,  // dst = constants[a]
+  LOAD,   // dst = values[a]
+  ADD,    // dst = a + b
+  SUB,    // dst = a - b
+  MUL,    // dst = a * b
+  DIV,    // dst = a / b
+  POW,    // dst = a ^ b
+  FMA,    // dst = a * b + c, rounded once
+  FMS,    // dst = a * b - c, rounded once
+  FNMA,   // dst = c - a * b, rounded once
+};
+
+/// Register machine instruction. Except for CONST and LOAD, a, b and c are registers.
+struct Instruction {
+  OpCode_TP op;
+  std::uint32_t dst;
+  std::uint32_t a;
+  std::uint32_t b;
+  std::uint32_t c;
+
+  auto operator<=>(const Instruction&) const = default;
+};
+
+struct CompileOptions {
+  /// integer powers become multiplication chains, division by a constant becomes multiplication by its reciprocal
+  bool strength_reduction = true;
+  /// a * b + c, a * b - c and c - a * b become fused multiply-add instructions, a product used by several of them is
+  /// fused into each
+  bool fma_fusion = true;
+  /// removes instructions whose result is not used
+  bool dead_code_elimination = true;
+  /// values share registers once they are dead, otherwise every value gets its own register
+  bool register_reuse = true;
+  /// evaluates the program after every pass at sample points and throws std::logic_error if it differs from the
+  /// unoptimized program by more than rounding
+  bool verify = false;
+  /// values computed more than once, also across the outputs of a kernel, are computed once
+  bool common_subexpression_elimination = true;
+};
+
+/**
+ * Expression compiled into a straight line register program. Evaluation runs over the instructions once and only needs
+ * registers() scratch values, which is much less than the number of nodes for large expressions.
+ */
+class Program {
+ public:
+  [[nodiscard]] double evaluate(const std::map<std::string, double>& var) const;
+  /// values are indexed by symbol id
+  [[nodiscard]] double evaluate(std::span<const double> values) const;
+  /// allocation free variant: registers must provide at least registers() elements
+  [[nodiscard]] double evaluate(std::span<const double> values, std::span<double> registers) const;
+  /// evaluates result.size() points, columns[i] points to the values of symbol i
+  void evaluate(std::span<const double* const> columns, std::span<double> result) const;
+  /**
+   * Encloses the program over the box values, indexed by symbol id. Fused instructions are evaluated as a product and a
+   * sum, and a division strength reduced to a multiplication by a rounded reciprocal multiplies by an enclosure of the
+   * exact reciprocal, so the result encloses the expression for any options. It can be wider than the enclosure of the
+   * expression itself: expanded integer powers treat their factors as independent (x * x of [-1, 1] is [-1, 1]).
+   */
+  [[nodiscard]] Interval evaluate(std::span<const Interval> values) const;
+
+  /// one instruction per line
+  [[nodiscard]] std::string to_str() const;
+
+  [[nodiscard]] const std::vector<Instruction>& instructions() const { return _instructions; }
+  [[nodiscard]] const std::vector<double>& constants() const { return _constants; }
+  [[nodiscard]] const std::vector<std::string>& symbols() const { return _symbols; }
+  [[nodiscard]] std::uint32_t registers() const { return _registers; }
+  [[nodiscard]] std::uint32_t result() const { return _result; }
+  /// number of arithmetic instructions
+  [[nodiscard]] std::size_t operations() const;
+
+  /// number of points evaluated together by the batch evaluate()
+  static constexpr std::size_t BATCH_BLOCK_SIZE = 128;
+
+ private:
+  friend Program compile(const FlatExpression& flat, const CompileOptions& options);
+
+  std::vector<Instruction> _instructions;
+  std::vector<double> _constants;
+  /// enclosures of the exact values of _constants, used by the interval evaluate()
+  std::vector<Interval> _bounds;
+  std::vector<std::string> _symbols;
+  std::uint32_t _registers {0};
+  std::uint32_t _result {0};
+};
+
+/**
+ * Program with several outputs, e.g. a function and its partial derivatives. The outputs are compiled together, so
+ * subexpressions they share are computed once per evaluation.
+ */
+class Kernel {
+ public:
+  /// one value per output
+  [[nodiscard]] std::vector<double> evaluate(const std::map<std::string, double>& var) const;
+  /// values are indexed by symbol id, outputs must provide at least outputs().size() elements
+  void evaluate(std::span<const double> values, std::span<double> outputs) const;
+  /// allocation free variant: registers must provide at least registers() elements
+  void evaluate(std::span<const double> values, std::span<double> registers, std::span<double> outputs) const;
+  /// evaluates count points, columns[i] points to the values of symbol i and outputs[j] receives the values of output j
+  void evaluate(std::span<const double* const> columns, std::span<double* const> outputs, std::size_t count) const;
+  /// encloses every output over the box values like Program::evaluate(std::span<const Interval>)
+  void evaluate(std::span<const Interval> values, std::span<Interval> outputs) const;
+
+  [[nodiscard]] std::string to_str() const;
+
+  [[nodiscard]] const std::vector<Instruction>& instructions() const { return _instructions; }
+  [[nodiscard]] const std::vector<double>& constants() const { return _constants; }
+  /// union of the symbols of all outputs
+  [[nodiscard]] const std::vector<std::string>& symbols() const { return _symbols; }
+  [[nodiscard]] std::uint32_t registers() const { return _registers; }
+  /// register holding each output after evaluation
+  [[nodiscard]] const std::vector<std::uint32_t>& outputs() const { return _outputs; }
+
+  /// number of arithmetic instructions
+  [[nodiscard]] std::size_t operations() const;
+  /// number of arithmetic instructions of the outputs compiled separately with the same options
+  [[nodiscard]] std::size_t separate_operations() const { return _separate_operations; }
+  /// separate_operations() - operations(), negative if compiling the outputs together costs instructions
+  [[nodiscard]] std::ptrdiff_t saved_operations() const {
+    return static_cast<std::ptrdiff_t>(_separate_operations) - static_cast<std::ptrdiff_t>(operations());
+  }
+
+ private:
+  friend Kernel compile_kernel(std::span<const FlatExpression> outputs, const CompileOptions& options);
+
+  std::vector<Instruction> _instructions;
+  std::vector<double> _constants;
+  std::vector<Interval> _bounds;
+  std::vector<std::string> _symbols;
+  std::uint32_t _registers {0};
+  std::vector<std::uint32_t> _outputs;
+  std::size_t _separate_operations {0};
+};
+
+/// Compiles flat through the optimization passes enabled in options. The symbol ids of flat are kept.
+Program compile(const FlatExpression& flat, const CompileOptions& options = {});
+Program compile(const Term_I& term, const CompileOptions& options = {});
+
+/// Compiles outputs into a single kernel. Symbols are merged by name in order of first occurrence.
+Kernel compile_kernel(std::span<const FlatExpression> outputs, const CompileOptions& options = {});
+Kernel compile_kernel(std::span<const Expression> outputs, const CompileOptions& options = {});
+
+}  // namespace fsd
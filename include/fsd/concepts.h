@@ -11,4 +11,16 @@ namespace fsd {
 template <typename T>
 concept Numeric = std::integral<T> || std::floating_point<T>;
 
+/**
+ * Type expressions can be evaluated with: closed under the four basic arithmetic operations and constructible from
+ * double. pow(T, T) must be found either in std or by argument dependent lookup.
+ */
+template <typename T>
+concept Scalar = std::copyable<T> && std::constructible_from<T, double> && requires(T a, T b) {
+  { a + b } -> std::convertible_to<T>;
+  { a - b } -> std::convertible_to<T>;
+  { a * b } -> std::convertible_to<T>;
+  { a / b } -> std::convertible_to<T>;
+};
+
 }  // namespace fsd
\ No newline at end of file
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <fsd/concepts.h>
+#include <fsd/flat.h>
 #include <fsd/term.h>
 
 #include <memory>
@@ -17,11 +18,11 @@ class Constant final : public Term_I {
 public:
   explicit Constant(T value) : _value(value) {}
 
-  [[nodiscard]] std::unique_ptr<Term_I> derivative(const std::string& var) const override {
-    return std::make_unique<Constant<int>>(0);
+  [[nodiscard]] Expression derivative(const std::string& /*var*/) const override {
+    return std::make_shared<Constant<int>>(0);
   }
 
-  [[nodiscard]] double evaluate(const std::map<std::string, double> &var) const override {
+  [[nodiscard]] double evaluate(const std::map<std::string, double> & /*var*/) const override {
     return _value;
   }
 
@@ -29,10 +30,16 @@ public:
     return std::to_string(_value);
   }
 
-  [[nodiscard]] std::unique_ptr<Term_I> clone() const override {
+  [[nodiscard]] std::unique_ptr<Term_I> clone_unique() const override {
     return std::make_unique<Constant<T>>(_value);
   }
 
+  [[nodiscard]] Node_TP node_type() const override { return Node_TP::CONSTANT; }
+
+  std::uint32_t flatten_into(FlatExpression& flat, std::span<const std::uint32_t>) const override {
+    return flat.emplace_constant(static_cast<double>(_value), std::integral<T>);
+  }
+
 private:
   T _value;
 };
@@ -0,0 +1,70 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/flat.h>
+#include <fsd/term.h>
+
+#include <chrono>
+#include <cstddef>
+
+namespace fsd {
+
+/**
+ * Relative evaluation cost per node type. The defaults are the times per node measured by BM_NodeCost and BM_LeafCost
+ * (benchmarks/evaluation.cpp) for FlatExpression::evaluate(), normalized to an addition. Powers are measured with an
+ * integral exponent, std::pow takes as long for any other.
+ */
+struct CostModel {
+  double constant = 0.3;
+  double variable = 0.3;
+  double add = 1.0;
+  double sub = 1.0;
+  double mul = 1.1;
+  double div = 2.3;
+  double pow = 12.0;
+
+  [[nodiscard]] double operator()(Node_TP type) const;
+};
+
+/// Evaluation cost of flat. Shared nodes are counted once, sums and products of n operands as n - 1 binary nodes.
+[[nodiscard]] double cost(const FlatExpression& flat, const CostModel& costs = {});
+
+struct OptimizerOptions {
+  /// rewriting stops once the e-graph holds this many nodes
+  std::size_t max_nodes = 10000;
+  /// rewriting stops after this time, extraction is not included
+  std::chrono::milliseconds max_time {50};
+  std::size_t max_iterations = 32;
+  CostModel costs {};
+};
+
+struct Optimization {
+  FlatExpression expr;
+  double cost_before;
+  double cost_after;
+  std::size_t iterations;
+  std::size_t egraph_nodes;
+  /// true if the rules were applied until nothing changed, false if a budget ran out first
+  bool saturated;
+};
+
+/**
+ * Searches the cheapest equivalent of an expression by equality saturation: the expression is added to an e-graph,
+ * which stores classes of equivalent terms, and algebraic rewrite rules (commutativity, associativity, factoring
+ * a*x + a*y = a*(x + y), integer powers as multiplications, identities and constant folding) add equivalent terms to
+ * it until no rule adds anything new or a budget is exhausted. The term with the lowest cost according to the cost
+ * model is extracted from the class of the root.
+ *
+ * The rules hold for real arithmetic on finite values, e.g. x * 0 is rewritten to 0. Products of powers x^j * x^k are
+ * merged only for integral j and k of the same sign, since x^0.5 * x^0.5 is NaN for x < 0 and x^-1 * x is NaN for
+ * x = 0, where x and 1 are not. The result is never more expensive than the input and keeps its symbol table.
+ *
+ * Throws std::invalid_argument if an entry of options.costs is not positive.
+ */
+Optimization optimize(const FlatExpression& flat, const OptimizerOptions& options = {});
+Optimization optimize(const Term_I& term, const OptimizerOptions& options = {});
+
+}  // namespace fsd
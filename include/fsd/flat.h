@@ -0,0 +1,340 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/concepts.h>
+#include <fsd/term.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace fsd {
+
+/**
+ * Compact tagged node of a FlatExpression. Operands are referenced by their index within the same FlatExpression and
+ * always precede the node itself.
+ *  - CONSTANT:     lhs is the index into the constant pool, rhs is 1 if the constant is integral, 0 otherwise
+ *  - VARIABLE:     lhs is the interned symbol id, rhs is unused
+ *  - SUM, PRODUCT: lhs is the offset of the operand indices in the operand pool, rhs is their number (at least 1)
+ *  - others:       lhs and rhs are the operand node indices
+ */
+struct Node {
+  Node_TP type;
+  std::uint32_t lhs;
+  std::uint32_t rhs;
+
+  auto operator<=>(const Node&) const = default;
+};
+
+/**
+ * Expression stored as a contiguous vector of nodes in topological order (operands before their users). All traversals
+ * are plain loops over this vector: there are no virtual calls, no recursion and shared subterms are stored only once.
+ * Variables are interned into symbol ids local to the expression, so evaluation indexes into a span of values instead
+ * of looking up names.
+ */
+class FlatExpression {
+ public:
+  FlatExpression() = default;
+
+  [[nodiscard]] FlatExpression derivative(std::string_view var) const;
+  [[nodiscard]] FlatExpression derivative(std::uint32_t symbol) const;
+
+  /**
+   * Evaluation is generic over the scalar type T: float, double, long double or any user supplied type modelling
+   * Scalar. Constants are converted from double. An empty (default constructed) expression evaluates to 0, like its
+   * compiled Program.
+   */
+  template <Scalar T = double>
+  [[nodiscard]] T evaluate(const std::map<std::string, std::type_identity_t<T>>& var) const;
+  /// values are indexed by symbol id
+  template <Scalar T = double>
+  [[nodiscard]] T evaluate(std::span<const std::type_identity_t<T>> values) const;
+  /// allocation free variant: scratch must provide at least size() elements
+  template <Scalar T = double>
+  [[nodiscard]] T evaluate(std::span<const std::type_identity_t<T>> values,
+                           std::span<std::type_identity_t<T>> scratch) const;
+  /**
+   * Evaluates the expression for result.size() points at once. columns[i] points to the values of symbol i. Points are
+   * processed in blocks, so the inner loops run over contiguous lanes and can be vectorized.
+   */
+  template <Scalar T = double>
+  void evaluate(std::span<const std::type_identity_t<T>* const> columns,
+                std::span<std::type_identity_t<T>> result) const;
+
+  [[nodiscard]] std::string to_str() const;
+
+  [[nodiscard]] Expression to_expression() const;
+
+  /// number of points evaluated together by the batch evaluate()
+  static constexpr std::size_t BATCH_BLOCK_SIZE = 128;
+
+  // --- builder interface ---------------------------------------------------------------------------------------------
+  std::uint32_t intern(std::string_view name);
+  std::uint32_t emplace_constant(double value, bool integral = false);
+  std::uint32_t emplace_variable(std::uint32_t symbol);
+  std::uint32_t emplace(Node_TP type, std::uint32_t lhs, std::uint32_t rhs);
+  /// appends a SUM or PRODUCT node
+  std::uint32_t emplace_nary(Node_TP type, std::span<const std::uint32_t> operands);
+  void set_root(std::uint32_t root);
+
+  // --- access --------------------------------------------------------------------------------------------------------
+  [[nodiscard]] std::optional<std::uint32_t> symbol_id(std::string_view name) const;
+  [[nodiscard]] const std::vector<std::string>& symbols() const { return _symbols; }
+  [[nodiscard]] const std::vector<Node>& nodes() const { return _nodes; }
+  [[nodiscard]] const std::vector<double>& constants() const { return _constants; }
+  /// operand indices of a SUM or PRODUCT node
+  [[nodiscard]] std::span<const std::uint32_t> nary_operands(const Node& node) const {
+    return {_operands.data() + node.lhs, node.rhs};
+  }
+  /// calls f with the index of every operand of node, in order
+  template <typename F>
+  void for_each_operand(const Node& node, F&& f) const {
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+      case Node_TP::VARIABLE:
+        break;
+      case Node_TP::SUM:
+      case Node_TP::PRODUCT:
+        for (std::uint32_t operand : nary_operands(node)) {
+          f(operand);
+        }
+        break;
+      default:
+        f(node.lhs);
+        f(node.rhs);
+        break;
+    }
+  }
+  [[nodiscard]] std::uint32_t root() const { return _root; }
+  [[nodiscard]] std::size_t size() const { return _nodes.size(); }
+
+ private:
+  /// removes all nodes not reachable from the root
+  void prune();
+  /// throws if a variable without value is used
+  void check_bound(const std::vector<bool>& present) const;
+
+  std::vector<Node> _nodes;
+  std::vector<double> _constants;
+  std::vector<std::uint32_t> _operands;
+  std::vector<std::string> _symbols;
+  std::uint32_t _root {0};
+};
+
+/// Converts a term into its flat representation. Terms shared within the expression are stored once.
+FlatExpression flatten(const Term_I& term);
+
+namespace detail {
+
+template <Scalar T>
+constexpr T pow(const T& base, const T& exponent) {
+  using std::pow;
+  return pow(base, exponent);
+}
+
+}  // namespace detail
+
+/// Applies the operation of a non leaf node type to its operand values.
+template <Scalar T>
+constexpr T apply(Node_TP type, const T& lhs, const T& rhs) {
+  switch (type) {
+    case Node_TP::ADD:
+      return lhs + rhs;
+    case Node_TP::SUB:
+      return lhs - rhs;
+    case Node_TP::MUL:
+      return lhs * rhs;
+    case Node_TP::DIV:
+      return lhs / rhs;
+    case Node_TP::POW:
+      return detail::pow(lhs, rhs);
+    default:
+      throw std::invalid_argument("leaf nodes have no operation");
+  }
+}
+
+template <Scalar T>
+T FlatExpression::evaluate(const std::map<std::string, std::type_identity_t<T>>& var) const {
+  std::vector<T> values(_symbols.size(), T(0.0));
+  std::vector<bool> present(_symbols.size());
+  for (std::uint32_t i = 0; i < _symbols.size(); ++i) {
+    if (auto it = var.find(_symbols[i]); it != var.end()) {
+      values[i] = it->second;
+      present[i] = true;
+    }
+  }
+  check_bound(present);
+  return evaluate<T>(values);
+}
+
+template <Scalar T>
+T FlatExpression::evaluate(std::span<const std::type_identity_t<T>> values) const {
+  std::vector<T> scratch(_nodes.size(), T(0.0));
+  return evaluate<T>(values, scratch);
+}
+
+template <Scalar T>
+T FlatExpression::evaluate(std::span<const std::type_identity_t<T>> values,
+                           std::span<std::type_identity_t<T>> scratch) const {
+  if (_nodes.empty()) {
+    return T(0.0);
+  }
+  for (std::uint32_t i = 0; i < _nodes.size(); ++i) {
+    const Node& node = _nodes[i];
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        scratch[i] = T(_constants[node.lhs]);
+        break;
+      case Node_TP::VARIABLE:
+        scratch[i] = values[node.lhs];
+        break;
+      case Node_TP::ADD:
+        scratch[i] = scratch[node.lhs] + scratch[node.rhs];
+        break;
+      case Node_TP::SUB:
+        scratch[i] = scratch[node.lhs] - scratch[node.rhs];
+        break;
+      case Node_TP::MUL:
+        scratch[i] = scratch[node.lhs] * scratch[node.rhs];
+        break;
+      case Node_TP::DIV:
+        scratch[i] = scratch[node.lhs] / scratch[node.rhs];
+        break;
+      case Node_TP::POW:
+        scratch[i] = detail::pow(scratch[node.lhs], scratch[node.rhs]);
+        break;
+      case Node_TP::SUM: {
+        const std::uint32_t* operands = _operands.data() + node.lhs;
+        T sum = scratch[operands[0]];
+        for (std::uint32_t k = 1; k < node.rhs; ++k) {
+          sum = sum + scratch[operands[k]];
+        }
+        scratch[i] = sum;
+        break;
+      }
+      case Node_TP::PRODUCT: {
+        const std::uint32_t* operands = _operands.data() + node.lhs;
+        T product = scratch[operands[0]];
+        for (std::uint32_t k = 1; k < node.rhs; ++k) {
+          product = product * scratch[operands[k]];
+        }
+        scratch[i] = product;
+        break;
+      }
+    }
+  }
+  return scratch[_root];
+}
+
+template <Scalar T>
+void FlatExpression::evaluate(std::span<const std::type_identity_t<T>* const> columns,
+                              std::span<std::type_identity_t<T>> result) const {
+  if (_nodes.empty()) {
+    std::ranges::fill(result, T(0.0));
+    return;
+  }
+  constexpr std::size_t B = BATCH_BLOCK_SIZE;
+  std::vector<T> scratch(_nodes.size() * B, T(0.0));
+  // rows[i] points to the current block of values of node i: into scratch, or directly into an input column
+  std::vector<const T*> rows(_nodes.size());
+  for (std::uint32_t i = 0; i < _nodes.size(); ++i) {
+    if (_nodes[i].type == Node_TP::CONSTANT) {
+      std::fill_n(scratch.begin() + i * B, B, T(_constants[_nodes[i].lhs]));
+      rows[i] = scratch.data() + i * B;
+    }
+  }
+  for (std::size_t offset = 0; offset < result.size(); offset += B) {
+    const std::size_t n = std::min(B, result.size() - offset);
+    for (std::uint32_t i = 0; i < _nodes.size(); ++i) {
+      const Node& node = _nodes[i];
+      if (node.type == Node_TP::CONSTANT) {
+        continue;
+      }
+      if (node.type == Node_TP::VARIABLE) {
+        rows[i] = columns[node.lhs] + offset;
+        continue;
+      }
+      T* out = scratch.data() + i * B;
+      if (node.type == Node_TP::SUM || node.type == Node_TP::PRODUCT) {
+        // accumulate one operand after the other, each pass is a contiguous loop over the block
+        const std::uint32_t* operands = _operands.data() + node.lhs;
+        std::copy_n(rows[operands[0]], n, out);
+        for (std::uint32_t j = 1; j < node.rhs; ++j) {
+          const T* a = rows[operands[j]];
+          if (node.type == Node_TP::SUM) {
+            for (std::size_t k = 0; k < n; ++k) {
+              out[k] = out[k] + a[k];
+            }
+          } else {
+            for (std::size_t k = 0; k < n; ++k) {
+              out[k] = out[k] * a[k];
+            }
+          }
+        }
+        rows[i] = out;
+        continue;
+      }
+      const T* a = rows[node.lhs];
+      const T* b = rows[node.rhs];
+      switch (node.type) {
+        case Node_TP::ADD:
+          for (std::size_t k = 0; k < n; ++k) {
+            out[k] = a[k] + b[k];
+          }
+          break;
+        case Node_TP::SUB:
+          for (std::size_t k = 0; k < n; ++k) {
+            out[k] = a[k] - b[k];
+          }
+          break;
+        case Node_TP::MUL:
+          for (std::size_t k = 0; k < n; ++k) {
+            out[k] = a[k] * b[k];
+          }
+          break;
+        case Node_TP::DIV:
+          for (std::size_t k = 0; k < n; ++k) {
+            out[k] = a[k] / b[k];
+          }
+          break;
+        case Node_TP::POW:
+          for (std::size_t k = 0; k < n; ++k) {
+            out[k] = detail::pow(a[k], b[k]);
+          }
+          break;
+        default:
+          break;
+      }
+      rows[i] = out;
+    }
+    std::copy_n(rows[_root], n, result.begin() + offset);
+  }
+}
+
+// the double instantiations are compiled once into the library
+extern template double FlatExpression::evaluate<double>(const std::map<std::string, double>&) const;
+extern template double FlatExpression::evaluate<double>(std::span<const double>) const;
+extern template double FlatExpression::evaluate<double>(std::span<const double>, std::span<double>) const;
+extern template void FlatExpression::evaluate<double>(std::span<const double* const>, std::span<double>) const;
+
+/**
+ * Evaluates a term with the scalar type T through its flat representation, e.g. evaluate<float>(*expr, values). Prefer
+ * flattening once and evaluating the FlatExpression when evaluating repeatedly.
+ */
+template <Scalar T>
+T evaluate(const Term_I& term, const std::map<std::string, std::type_identity_t<T>>& var) {
+  return flatten(term).evaluate<T>(var);
+}
+
+}  // namespace fsd
@@ -0,0 +1,84 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/concepts.h>
+
+#include <string>
+
+namespace fsd {
+
+/**
+ * Closed interval [lower, upper] of doubles, usable as Scalar: evaluating an expression with intervals as variable values
+ * yields an interval containing the value of the expression for every point of the box, e.g.
+ *
+ *   fsd::evaluate<fsd::Interval>(*expr, {{"x", {0, 1}}, {"y", {-1, 1}}})
+ *
+ * Every operation rounds its bounds outwards, so the enclosure also holds for the exact real result. The arithmetic
+ * operations, integer powers and sqrt round in the right direction by computing their rounding error exactly (with fma)
+ * instead of switching the rounding mode, so exact results stay exact and nothing depends on compiler flags. Bounds of
+ * the other functions are computed by libm, assumed to be accurate to LIBM_ULPS, and widened by that much.
+ *
+ * The enclosure is not always tight: every occurrence of a variable is treated as independent, so x - x of [0, 1] is
+ * [-1, 1]. Functions are evaluated on the part of the interval inside their domain (sqrt([-1, 4]) is [0, 2]). If there
+ * is no such part or the result is undefined (division by an interval containing 0), the result is entire().
+ */
+class Interval {
+ public:
+  constexpr Interval() = default;
+  /// degenerate interval [value, value]
+  constexpr Interval(double value) : _lower(value), _upper(value) {}  // NOLINT(google-explicit-constructor)
+  /// throws std::invalid_argument unless lower <= upper
+  Interval(double lower, double upper);
+
+  /// the whole real line, the result of operations without any bound
+  [[nodiscard]] static Interval entire();
+
+  [[nodiscard]] double lower() const { return _lower; }
+  [[nodiscard]] double upper() const { return _upper; }
+  [[nodiscard]] double width() const { return _upper - _lower; }
+  [[nodiscard]] double mid() const;
+
+  [[nodiscard]] bool contains(double value) const { return _lower <= value && value <= _upper; }
+  [[nodiscard]] bool contains(const Interval& other) const {
+    return _lower <= other._lower && other._upper <= _upper;
+  }
+  [[nodiscard]] bool is_entire() const;
+
+  /// "[lower, upper]"
+  [[nodiscard]] std::string to_str() const;
+
+  bool operator==(const Interval&) const = default;
+
+  /// maximum error of the libm functions used, in units in the last place
+  static constexpr int LIBM_ULPS = 2;
+
+ private:
+  double _lower {0};
+  double _upper {0};
+};
+
+Interval operator-(const Interval& x);
+Interval operator+(const Interval& lhs, const Interval& rhs);
+Interval operator-(const Interval& lhs, const Interval& rhs);
+Interval operator*(const Interval& lhs, const Interval& rhs);
+Interval operator/(const Interval& lhs, const Interval& rhs);
+
+/// Integral degenerate exponents are evaluated as integer powers, so pow([-2, 1], 2) is [0, 4].
+Interval pow(const Interval& base, const Interval& exponent);
+
+// the functions of UnaryOperation_TP
+Interval exp(const Interval& x);
+Interval sqrt(const Interval& x);
+Interval sin(const Interval& x);
+Interval cos(const Interval& x);
+Interval tan(const Interval& x);
+Interval asin(const Interval& x);
+Interval acos(const Interval& x);
+Interval atan(const Interval& x);
+
+static_assert(Scalar<Interval>);
+
+}  // namespace fsd
@@ -0,0 +1,69 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/term.h>
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsd {
+
+/**
+ * Derivative of an expression by one variable that is not built as a term. The view only references the source
+ * expression and the variable: evaluate() computes the derivative in a single pass over the source (forward mode, every
+ * node yields its value and its derivative), is_zero(), is_constant() and depends_on() inspect the source. None of them
+ * builds a term, they only allocate the traversal stack and a cache of shared subterms, like Term_I::evaluate(). A term is
+ * only built by materialize() and the functions that need one, e.g.
+ *
+ *   fsd::LazyDerivative dfdx(f, "x");
+ *   if (!dfdx.is_zero()) {
+ *     double slope = dfdx.evaluate({{"x", 1}, {"y", 2}});
+ *   }
+ *
+ * The checks are structural and conservative: the derivative of x - x is zero, but is_zero() is false because x occurs.
+ * Like Term_I::derivative(), all functions throw std::runtime_error for powers with var in the exponent.
+ */
+class LazyDerivative {
+ public:
+  /// throws std::invalid_argument if source is null
+  LazyDerivative(Expression source, std::string var);
+
+  /// value of the derivative, equal to materialize()->evaluate(values) up to rounding
+  [[nodiscard]] double evaluate(const std::map<std::string, double>& values) const;
+
+  /// true if var does not occur in the source
+  [[nodiscard]] bool is_zero() const;
+  /// true if the derivative does not depend on any variable, i.e. the source is affine in var with a constant slope
+  [[nodiscard]] bool is_constant() const;
+  /// true if the derivative depends on the variable name
+  [[nodiscard]] bool depends_on(std::string_view name) const;
+  /// sorted names of all variables the derivative depends on
+  [[nodiscard]] std::vector<std::string> variables() const;
+
+  /// Builds the derivative term, Term_I::derivative() of the source. Every call builds a new term, keep the result if it
+  /// is used more than once.
+  [[nodiscard]] Expression materialize() const;
+  /// same as materialize(), for code treating the view like a term
+  [[nodiscard]] Expression clone() const { return materialize(); }
+  [[nodiscard]] std::string to_str() const;
+  /// lazy second derivative, the first derivative is materialized as its source
+  [[nodiscard]] LazyDerivative derivative(std::string var) const;
+
+  [[nodiscard]] const Expression& source() const { return _source; }
+  [[nodiscard]] const std::string& var() const { return _var; }
+
+ private:
+  Expression _source;
+  std::string _var;
+};
+
+inline LazyDerivative lazy_derivative(Expression source, std::string var) {
+  return {std::move(source), std::move(var)};
+}
+
+}  // namespace fsd
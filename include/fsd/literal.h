@@ -0,0 +1,576 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/concepts.h>
+#include <fsd/flat.h>
+#include <fsd/tokenizer.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace fsd {
+
+/// String literal usable as template argument.
+template <std::size_t N>
+struct FixedString {
+  consteval FixedString(const char (&str)[N]) { std::copy_n(str, N, data); }
+
+  [[nodiscard]] constexpr std::string_view view() const { return {data, N - 1}; }
+
+  char data[N] {};
+};
+
+namespace detail {
+
+/// base^exponent by repeated squaring, usable in constant expressions
+template <Scalar T>
+constexpr T integer_pow(const T& base, std::int64_t exponent) {
+  T result(1.0);
+  T factor = base;
+  for (std::int64_t e = exponent < 0 ? -exponent : exponent; e > 0; e /= 2) {
+    if (e % 2 != 0) {
+      result = result * factor;
+    }
+    factor = factor * factor;
+  }
+  return exponent < 0 ? T(1.0) / result : result;
+}
+
+}  // namespace detail
+
+/**
+ * Flat expression with a fixed capacity of N nodes that never allocates. It uses the node layout of FlatExpression
+ * (without n-ary nodes), but can be built, evaluated and differentiated in constant expressions. Create one with the
+ * _fsd literal:
+ *
+ *   using namespace fsd::literals;
+ *   constexpr auto f = "x**2 + 3*x*y"_fsd;
+ *   constexpr auto df = f.derivative("x");
+ *   double value = df.evaluate({{"x", 2.0}, {"y", 1.0}});
+ *
+ * Symbol names refer to the characters of the literal. In constant expressions only powers whose exponent is an
+ * integer built from integral constants can be evaluated (std::pow is not constexpr), others are compile errors.
+ */
+template <std::size_t N>
+class StaticExpression {
+ public:
+  /// every derivative rule appends at most five nodes per node
+  static constexpr std::size_t DERIVATIVE_CAPACITY = 6 * N + 2;
+
+  constexpr StaticExpression() = default;
+
+  [[nodiscard]] constexpr StaticExpression<DERIVATIVE_CAPACITY> derivative(std::string_view var) const;
+
+  /// values are indexed by symbol id
+  template <Scalar T = double>
+  [[nodiscard]] constexpr T evaluate(std::span<const std::type_identity_t<T>> values) const;
+  template <Scalar T = double>
+  [[nodiscard]] constexpr T evaluate(
+    std::initializer_list<std::pair<std::string_view, std::type_identity_t<T>>> values) const;
+
+  /// runtime copy as FlatExpression, symbol ids and node indices are kept
+  [[nodiscard]] FlatExpression to_flat() const;
+
+  // --- builder interface ---------------------------------------------------------------------------------------------
+  constexpr std::uint32_t intern(std::string_view name);
+  constexpr std::uint32_t emplace_constant(double value, bool integral = false);
+  constexpr std::uint32_t emplace_variable(std::uint32_t symbol) { return emplace(Node_TP::VARIABLE, symbol, 0); }
+  constexpr std::uint32_t emplace(Node_TP type, std::uint32_t lhs, std::uint32_t rhs);
+  constexpr void set_root(std::uint32_t root) { _root = root; }
+
+  // --- access --------------------------------------------------------------------------------------------------------
+  [[nodiscard]] constexpr std::optional<std::uint32_t> symbol_id(std::string_view name) const;
+  [[nodiscard]] constexpr std::span<const std::string_view> symbols() const { return {_symbols.data(), _symbol_count}; }
+  [[nodiscard]] constexpr std::span<const Node> nodes() const { return {_nodes.data(), _size}; }
+  [[nodiscard]] constexpr std::span<const double> constants() const { return {_constants.data(), _constant_count}; }
+  [[nodiscard]] constexpr std::uint32_t root() const { return _root; }
+  [[nodiscard]] constexpr std::size_t size() const { return _size; }
+  [[nodiscard]] static constexpr std::size_t capacity() { return N; }
+
+ private:
+  template <std::size_t M>
+  friend class StaticExpression;
+
+  /// removes all nodes not reachable from the root
+  constexpr void prune();
+  /// exact value of node if it is built from integral constants with +, -, * and ** and small enough, otherwise nullopt
+  [[nodiscard]] constexpr std::optional<std::int64_t> integer_value(std::uint32_t node) const;
+
+  std::array<Node, N> _nodes {};
+  std::array<double, N> _constants {};
+  std::array<std::string_view, N> _symbols {};
+  std::uint32_t _size {0};
+  std::uint32_t _constant_count {0};
+  std::uint32_t _symbol_count {0};
+  std::uint32_t _root {0};
+};
+
+template <std::size_t N>
+constexpr StaticExpression<StaticExpression<N>::DERIVATIVE_CAPACITY> StaticExpression<N>::derivative(
+  std::string_view var) const {
+  // same rules as FlatExpression::derivative(): the derivative is appended to a copy of this expression
+  constexpr std::uint32_t ZERO = std::numeric_limits<std::uint32_t>::max();
+  StaticExpression<DERIVATIVE_CAPACITY> result;
+  std::copy_n(_nodes.begin(), _size, result._nodes.begin());
+  std::copy_n(_constants.begin(), _constant_count, result._constants.begin());
+  std::copy_n(_symbols.begin(), _symbol_count, result._symbols.begin());
+  result._size = _size;
+  result._constant_count = _constant_count;
+  result._symbol_count = _symbol_count;
+  const std::optional<std::uint32_t> symbol = symbol_id(var);
+
+  std::array<std::uint32_t, N> d {};
+  std::uint32_t one = ZERO;
+  auto get_one = [&]() {
+    if (one == ZERO) {
+      one = result.emplace_constant(1, true);
+    }
+    return one;
+  };
+  auto add = [&](std::uint32_t lhs, std::uint32_t rhs) {
+    return lhs == ZERO ? rhs : rhs == ZERO ? lhs : result.emplace(Node_TP::ADD, lhs, rhs);
+  };
+  auto sub = [&](std::uint32_t lhs, std::uint32_t rhs) {
+    if (rhs == ZERO) {
+      return lhs;
+    }
+    return result.emplace(Node_TP::SUB, lhs == ZERO ? result.emplace_constant(0, true) : lhs, rhs);
+  };
+  auto mul = [&](std::uint32_t lhs, std::uint32_t rhs) {
+    if (lhs == ZERO || rhs == ZERO) {
+      return ZERO;
+    }
+    return lhs == one ? rhs : rhs == one ? lhs : result.emplace(Node_TP::MUL, lhs, rhs);
+  };
+
+  for (std::uint32_t i = 0; i < _size; ++i) {
+    const Node& node = _nodes[i];
+    const std::uint32_t a = node.lhs;
+    const std::uint32_t b = node.rhs;
+    d[i] = ZERO;
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        break;
+      case Node_TP::VARIABLE:
+        if (node.lhs == symbol) {
+          d[i] = get_one();
+        }
+        break;
+      case Node_TP::ADD:
+        d[i] = add(d[a], d[b]);
+        break;
+      case Node_TP::SUB:
+        d[i] = sub(d[a], d[b]);
+        break;
+      case Node_TP::MUL:
+        d[i] = add(mul(d[a], b), mul(a, d[b]));
+        break;
+      case Node_TP::DIV:
+        if (d[b] == ZERO) {
+          d[i] = d[a] == ZERO ? ZERO : result.emplace(Node_TP::DIV, d[a], b);
+        } else {
+          d[i] = result.emplace(Node_TP::DIV, sub(mul(d[a], b), mul(a, d[b])), result.emplace(Node_TP::MUL, b, b));
+        }
+        break;
+      case Node_TP::POW: {
+        if (d[b] != ZERO) {
+          throw std::runtime_error("derivative of a power with a non constant exponent is not supported");
+        }
+        if (d[a] == ZERO) {
+          break;
+        }
+        std::uint32_t exponent;
+        if (const Node& e = _nodes[b]; e.type == Node_TP::CONSTANT) {
+          exponent = result.emplace_constant(_constants[e.lhs] - 1, e.rhs != 0);
+        } else {
+          exponent = result.emplace(Node_TP::SUB, b, get_one());
+        }
+        d[i] = mul(result.emplace(Node_TP::MUL, b, result.emplace(Node_TP::POW, a, exponent)), d[a]);
+        break;
+      }
+      default:
+        throw std::invalid_argument("n-ary nodes are not supported by StaticExpression");
+    }
+  }
+  result.set_root(_size == 0 || d[_root] == ZERO ? result.emplace_constant(0, true) : d[_root]);
+  result.prune();
+  return result;
+}
+
+template <std::size_t N>
+template <Scalar T>
+constexpr T StaticExpression<N>::evaluate(std::span<const std::type_identity_t<T>> values) const {
+  std::array<T, N> scratch {};
+  for (std::uint32_t i = 0; i < _size; ++i) {
+    const Node& node = _nodes[i];
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        scratch[i] = T(_constants[node.lhs]);
+        break;
+      case Node_TP::VARIABLE:
+        scratch[i] = values[node.lhs];
+        break;
+      case Node_TP::POW:
+        if consteval {
+          // std::pow is not constexpr before C++26, the compiler only evaluates integer powers
+          const std::optional<std::int64_t> exponent = integer_value(node.rhs);
+          if (!exponent.has_value()) {
+            throw std::domain_error("only powers with an integral constant exponent are evaluated at compile time");
+          }
+          scratch[i] = detail::integer_pow(scratch[node.lhs], exponent.value());
+        } else {
+          scratch[i] = detail::pow(scratch[node.lhs], scratch[node.rhs]);
+        }
+        break;
+      default:
+        scratch[i] = apply(node.type, scratch[node.lhs], scratch[node.rhs]);
+        break;
+    }
+  }
+  return scratch[_root];
+}
+
+template <std::size_t N>
+template <Scalar T>
+constexpr T StaticExpression<N>::evaluate(
+  std::initializer_list<std::pair<std::string_view, std::type_identity_t<T>>> values) const {
+  std::array<T, N> by_id {};
+  std::array<bool, N> present {};
+  for (const auto& [name, value] : values) {
+    if (auto symbol = symbol_id(name); symbol.has_value()) {
+      by_id[symbol.value()] = value;
+      present[symbol.value()] = true;
+    }
+  }
+  for (std::uint32_t i = 0; i < _size; ++i) {
+    if (_nodes[i].type == Node_TP::VARIABLE && !present[_nodes[i].lhs]) {
+      throw std::runtime_error("no value for variable " + std::string(_symbols[_nodes[i].lhs]));
+    }
+  }
+  return evaluate<T>(std::span<const T>(by_id.data(), _symbol_count));
+}
+
+template <std::size_t N>
+FlatExpression StaticExpression<N>::to_flat() const {
+  FlatExpression flat;
+  for (std::string_view symbol : symbols()) {
+    flat.intern(symbol);
+  }
+  for (const Node& node : nodes()) {
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        flat.emplace_constant(_constants[node.lhs], node.rhs != 0);
+        break;
+      case Node_TP::VARIABLE:
+        flat.emplace_variable(node.lhs);
+        break;
+      default:
+        flat.emplace(node.type, node.lhs, node.rhs);
+        break;
+    }
+  }
+  flat.set_root(_root);
+  return flat;
+}
+
+template <std::size_t N>
+constexpr std::uint32_t StaticExpression<N>::intern(std::string_view name) {
+  if (auto symbol = symbol_id(name); symbol.has_value()) {
+    return symbol.value();
+  }
+  _symbols[_symbol_count] = name;
+  return _symbol_count++;
+}
+
+template <std::size_t N>
+constexpr std::uint32_t StaticExpression<N>::emplace_constant(double value, bool integral) {
+  _constants[_constant_count] = value;
+  return emplace(Node_TP::CONSTANT, _constant_count++, integral ? 1 : 0);
+}
+
+template <std::size_t N>
+constexpr std::uint32_t StaticExpression<N>::emplace(Node_TP type, std::uint32_t lhs, std::uint32_t rhs) {
+  if (_size == N) {
+    throw std::length_error("StaticExpression capacity exceeded");
+  }
+  _nodes[_size] = {type, lhs, rhs};
+  _root = _size;
+  return _size++;
+}
+
+template <std::size_t N>
+constexpr std::optional<std::uint32_t> StaticExpression<N>::symbol_id(std::string_view name) const {
+  for (std::uint32_t i = 0; i < _symbol_count; ++i) {
+    if (_symbols[i] == name) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+template <std::size_t N>
+constexpr std::optional<std::int64_t> StaticExpression<N>::integer_value(std::uint32_t node) const {
+  // operands up to 2^31 cannot overflow a product
+  constexpr std::int64_t LIMIT = std::int64_t {1} << 31;
+  const Node& n = _nodes[node];
+  if (n.type == Node_TP::CONSTANT) {
+    const double value = _constants[n.lhs];
+    if (n.rhs == 0 || value > LIMIT || value < -LIMIT) {
+      return std::nullopt;
+    }
+    return static_cast<std::int64_t>(value);
+  }
+  if (n.type == Node_TP::VARIABLE || n.type == Node_TP::DIV) {
+    return std::nullopt;
+  }
+  const std::optional<std::int64_t> lhs = integer_value(n.lhs);
+  const std::optional<std::int64_t> rhs = integer_value(n.rhs);
+  if (!lhs.has_value() || !rhs.has_value()) {
+    return std::nullopt;
+  }
+  std::int64_t result = 1;
+  switch (n.type) {
+    case Node_TP::ADD:
+      result = lhs.value() + rhs.value();
+      break;
+    case Node_TP::SUB:
+      result = lhs.value() - rhs.value();
+      break;
+    case Node_TP::MUL:
+      result = lhs.value() * rhs.value();
+      break;
+    default:
+      if (rhs.value() < 0) {
+        return std::nullopt;
+      }
+      if (lhs.value() >= -1 && lhs.value() <= 1) {
+        return lhs.value() == -1 && rhs.value() % 2 != 0 ? -1 : lhs.value() == 0 && rhs.value() != 0 ? 0 : 1;
+      }
+      for (std::int64_t i = 0; i < rhs.value(); ++i) {
+        result *= lhs.value();
+        if (result > LIMIT || result < -LIMIT) {
+          return std::nullopt;
+        }
+      }
+      break;
+  }
+  if (result > LIMIT || result < -LIMIT) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+template <std::size_t N>
+constexpr void StaticExpression<N>::prune() {
+  if (_size == 0) {
+    return;
+  }
+  std::array<bool, N> used {};
+  used[_root] = true;
+  for (std::uint32_t i = _root + 1; i-- > 0;) {
+    const Node& node = _nodes[i];
+    if (used[i] && node.type != Node_TP::CONSTANT && node.type != Node_TP::VARIABLE) {
+      used[node.lhs] = true;
+      used[node.rhs] = true;
+    }
+  }
+  std::array<std::uint32_t, N> index {};
+  std::uint32_t size = 0;
+  std::uint32_t constant_count = 0;
+  // nodes only move towards the front, so compacting in place never overwrites a node that is still to be read
+  for (std::uint32_t i = 0; i <= _root; ++i) {
+    if (!used[i]) {
+      continue;
+    }
+    Node node = _nodes[i];
+    if (node.type == Node_TP::CONSTANT) {
+      _constants[constant_count] = _constants[node.lhs];
+      node.lhs = constant_count++;
+    } else if (node.type != Node_TP::VARIABLE) {
+      node.lhs = index[node.lhs];
+      node.rhs = index[node.rhs];
+    }
+    index[i] = size;
+    _nodes[size++] = node;
+  }
+  _root = index[_root];
+  _size = size;
+  _constant_count = constant_count;
+}
+
+namespace detail {
+
+/// Not constexpr on purpose: reaching it while parsing a literal turns the syntax error into a compile error.
+[[noreturn]] inline void invalid_expression_literal(Error error) {
+  throw std::invalid_argument("invalid expression literal at position " + std::to_string(error.position));
+}
+
+/// upper bound for the number of nodes of the expression: its number of tokens
+consteval std::size_t count_tokens(std::string_view input) {
+  Tokenizer tokenizer(input);
+  std::size_t count = 0;
+  for (auto token : tokenizer) {
+    count++;
+  }
+  return std::max<std::size_t>(count, 1);
+}
+
+consteval double parse_number(std::string_view digits, std::size_t position) {
+  double mantissa = 0;
+  double scale = 1;
+  bool fraction = false;
+  for (char c : digits) {
+    if (c == '.') {
+      if (fraction) {
+        invalid_expression_literal(Error(ErrorType::UNKNOWN_TOKEN, position));
+      }
+      fraction = true;
+      continue;
+    }
+    mantissa = mantissa * 10 + (c - '0');
+    scale = fraction ? scale * 10 : scale;
+  }
+  return mantissa / scale;
+}
+
+/// Operator precedence parser following the grammar of Parser, emitting binary nodes only.
+template <std::size_t N>
+consteval StaticExpression<N> parse_literal(std::string_view input) {
+  StaticExpression<N> result;
+  std::array<std::uint32_t, N> operands {};
+  std::array<TokenType_TP, N> operators {};
+  std::size_t operand_count = 0;
+  std::size_t operator_count = 0;
+
+  auto reduce = [&]() {
+    if (operand_count < 2) {
+      invalid_expression_literal(Error(ErrorType::MISSING_OPERAND, input.size()));
+    }
+    const std::uint32_t rhs = operands[--operand_count];
+    const std::uint32_t lhs = operands[--operand_count];
+    Node_TP type = Node_TP::POW;
+    switch (operators[--operator_count]) {
+      case TokenType_TP::PLUS:
+        type = Node_TP::ADD;
+        break;
+      case TokenType_TP::MINUS:
+        type = Node_TP::SUB;
+        break;
+      case TokenType_TP::MUL:
+        type = Node_TP::MUL;
+        break;
+      case TokenType_TP::SLASH:
+        type = Node_TP::DIV;
+        break;
+      default:
+        break;
+    }
+    operands[operand_count++] = result.emplace(type, lhs, rhs);
+  };
+
+  Tokenizer tokenizer(input);
+  // true while an operand (number, variable or '(') is expected next
+  bool expect_operand = true;
+  while (true) {
+    auto exp_token = tokenizer.next_token();
+    if (!exp_token.has_value()) {
+      invalid_expression_literal(exp_token.error());
+    }
+    const Token token = exp_token.value();
+    const auto position =
+      static_cast<std::size_t>(tokenizer.get_current_position() - input.begin()) - token.value.size();
+    if (token.type == TokenType_TP::END) {
+      break;
+    }
+    switch (token.type) {
+      case TokenType_TP::NUMBER:
+      case TokenType_TP::LITERAL:
+      case TokenType_TP::LEFT_PAREN:
+        if (!expect_operand) {
+          invalid_expression_literal(Error(ErrorType::MISSING_OPERATOR, position));
+        }
+        if (token.type == TokenType_TP::NUMBER) {
+          operands[operand_count++] =
+            result.emplace_constant(parse_number(token.value, position), !token.value.contains('.'));
+        } else if (token.type == TokenType_TP::LITERAL) {
+          operands[operand_count++] = result.emplace_variable(result.intern(token.value));
+        } else {
+          operators[operator_count++] = TokenType_TP::LEFT_PAREN;
+        }
+        expect_operand = token.type == TokenType_TP::LEFT_PAREN;
+        break;
+      case TokenType_TP::RIGHT_PAREN:
+        if (expect_operand) {
+          invalid_expression_literal(Error(ErrorType::MISSING_OPERAND, position));
+        }
+        while (operator_count == 0 || operators[operator_count - 1] != TokenType_TP::LEFT_PAREN) {
+          if (operator_count == 0) {
+            // ')' without matching '('
+            invalid_expression_literal(Error(ErrorType::MISSING_OPERATOR, position));
+          }
+          reduce();
+        }
+        operator_count--;
+        break;
+      case TokenType_TP::COMMA:
+        break;
+      default:
+        if (expect_operand) {
+          invalid_expression_literal(Error(ErrorType::MISSING_OPERAND, position));
+        }
+        // reduce all pending operations binding at least as strong
+        while (operator_count > 0 && operators[operator_count - 1] != TokenType_TP::LEFT_PAREN) {
+          const int top = precedence(operators[operator_count - 1]);
+          if (top < precedence(token.type) || (top == precedence(token.type) && is_right_associative(token.type))) {
+            break;
+          }
+          reduce();
+        }
+        operators[operator_count++] = token.type;
+        expect_operand = true;
+        break;
+    }
+  }
+  if (expect_operand) {
+    invalid_expression_literal(Error(ErrorType::MISSING_OPERAND, input.size()));
+  }
+  while (operator_count > 0) {
+    if (operators[operator_count - 1] == TokenType_TP::LEFT_PAREN) {
+      // '(' without matching ')'
+      invalid_expression_literal(Error(ErrorType::MISSING_OPERATOR, input.size()));
+    }
+    reduce();
+  }
+  result.set_root(operands[0]);
+  return result;
+}
+
+}  // namespace detail
+
+namespace literals {
+
+/**
+ * Parses an expression at compile time, e.g. "x**2 + 3*x*y"_fsd. Syntax errors are compile errors. The result is a
+ * StaticExpression sized for the literal.
+ */
+template <FixedString S>
+consteval auto operator""_fsd() {
+  return detail::parse_literal<detail::count_tokens(S.view())>(S.view());
+}
+
+}  // namespace literals
+
+}  // namespace fsd
@@ -7,8 +7,11 @@
 #include <fsd/term.h>
 #include <fsd/constant.h>
 
+#include <array>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace fsd {
 
@@ -37,45 +40,100 @@ class UnaryOp final : public Term_I {};
 template <BinaryOperation_TP T>
 class BinaryOp final : public Term_I {
 public:
-  BinaryOp(std::unique_ptr<Term_I> lhs, std::unique_ptr<Term_I> rhs) : _lhs(std::move(lhs)), _rhs(std::move(rhs)) {}
+  BinaryOp(Expression lhs, Expression rhs) : _operands {std::move(lhs), std::move(rhs)} {}
+  ~BinaryOp() override { detail::release(_operands); }
 
-  [[nodiscard]] std::unique_ptr<Term_I> derivative(const std::string& var) const override;
+  [[nodiscard]] Expression derivative(const std::string& var) const override;
 
   [[nodiscard]] double evaluate(const std::map<std::string, double>& var) const override;
 
   [[nodiscard]] std::string to_str() const override;
 
-  [[nodiscard]] std::unique_ptr<Term_I> clone() const override {
-    return std::make_unique<BinaryOp<T>>(_lhs->clone(), _rhs->clone());
+  [[nodiscard]] std::unique_ptr<Term_I> clone_unique() const override {
+    return std::make_unique<BinaryOp<T>>(_operands[0], _operands[1]);
   }
 
+  [[nodiscard]] Node_TP node_type() const override;
+
+  [[nodiscard]] std::span<const Expression> operands() const override { return _operands; }
+
+  std::uint32_t flatten_into(FlatExpression& flat, std::span<const std::uint32_t> operands) const override;
+
+  [[nodiscard]] const Expression& lhs() const { return _operands[0]; }
+  [[nodiscard]] const Expression& rhs() const { return _operands[1]; }
+
 private:
-  std::unique_ptr<Term_I> _lhs {nullptr};
-  std::unique_ptr<Term_I> _rhs {nullptr};
+  std::array<Expression, 2> _operands;
 };
 
-inline std::unique_ptr<Term_I> operator+(std::unique_ptr<Term_I>& lhs, std::unique_ptr<Term_I>& rhs) {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::ADD>>(lhs->clone(), rhs->clone());
+/**
+ * Flattened sum (T = ADD) or product (T = MUL) of any number of operands. Long chains like a + b + c + ... are stored
+ * as a single node, so they are evaluated in a loop instead of one node per operand and the derivative of a product of
+ * n operands has O(n log n) operands instead of O(n^2).
+ */
+template <BinaryOperation_TP T>
+class NaryOp final : public Term_I {
+  static_assert(T == BinaryOperation_TP::ADD || T == BinaryOperation_TP::MUL, "only sums and products are n-ary");
+
+public:
+  explicit NaryOp(std::vector<Expression> operands) : _operands(std::move(operands)) {
+    if (_operands.empty()) {
+      throw std::invalid_argument("n-ary operation without operands");
+    }
+  }
+  ~NaryOp() override { detail::release(_operands); }
+
+  [[nodiscard]] Expression derivative(const std::string& var) const override;
+
+  [[nodiscard]] double evaluate(const std::map<std::string, double>& var) const override;
+
+  [[nodiscard]] std::string to_str() const override;
+
+  [[nodiscard]] std::unique_ptr<Term_I> clone_unique() const override {
+    return std::make_unique<NaryOp<T>>(_operands);
+  }
+
+  [[nodiscard]] Node_TP node_type() const override {
+    return T == BinaryOperation_TP::ADD ? Node_TP::SUM : Node_TP::PRODUCT;
+  }
+
+  [[nodiscard]] std::span<const Expression> operands() const override { return _operands; }
+
+  std::uint32_t flatten_into(FlatExpression& flat, std::span<const std::uint32_t> operands) const override;
+
+private:
+  std::vector<Expression> _operands;
+};
+
+/// Sum of all operands: 0 if there are none, the operand itself if there is only one.
+Expression sum(std::vector<Expression> operands);
+
+/// Product of all operands: 1 if there are none, the operand itself if there is only one.
+Expression product(std::vector<Expression> operands);
+
+inline Expression operator+(Expression lhs, Expression rhs) {
+  return std::make_shared<BinaryOp<BinaryOperation_TP::ADD>>(std::move(lhs), std::move(rhs));
 }
 
-inline std::unique_ptr<Term_I> operator+(std::unique_ptr<Term_I>&& lhs, std::unique_ptr<Term_I>&& rhs) {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::ADD>>(std::move(lhs), std::move(rhs));
+[[deprecated("use fsd::Expression instead of std::unique_ptr<Term_I>")]]
+inline Expression operator+(std::unique_ptr<Term_I>& lhs, std::unique_ptr<Term_I>& rhs) {
+  return lhs->clone() + rhs->clone();
 }
 
-inline std::unique_ptr<Term_I> operator-(std::unique_ptr<Term_I> lhs, std::unique_ptr<Term_I> rhs) {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::SUB>>(std::move(lhs), std::move(rhs));
+inline Expression operator-(Expression lhs, Expression rhs) {
+  return std::make_shared<BinaryOp<BinaryOperation_TP::SUB>>(std::move(lhs), std::move(rhs));
 }
 
-inline std::unique_ptr<Term_I> operator*(std::unique_ptr<Term_I> lhs, std::unique_ptr<Term_I> rhs) {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::MUL>>(std::move(lhs), std::move(rhs));
+inline Expression operator*(Expression lhs, Expression rhs) {
+  return std::make_shared<BinaryOp<BinaryOperation_TP::MUL>>(std::move(lhs), std::move(rhs));
 }
 
-inline std::unique_ptr<Term_I> operator/(std::unique_ptr<Term_I> lhs, std::unique_ptr<Term_I> rhs) {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::DIV>>(std::move(lhs), std::move(rhs));
+inline Expression operator/(Expression lhs, Expression rhs) {
+  return std::make_shared<BinaryOp<BinaryOperation_TP::DIV>>(std::move(lhs), std::move(rhs));
 }
 
-inline std::unique_ptr<Term_I> pow(std::unique_ptr<Term_I> lhs, std::unique_ptr<Term_I> rhs) {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::POW>>(std::move(lhs), std::move(rhs));
+inline Expression pow(Expression lhs, Expression rhs) {
+  return std::make_shared<BinaryOp<BinaryOperation_TP::POW>>(std::move(lhs), std::move(rhs));
 }
 
 }  // namespace fsd
\ No newline at end of file
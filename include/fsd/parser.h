@@ -12,9 +12,14 @@
 #include <optional>
 #include <stack>
 #include <string_view>
+#include <vector>
 
 namespace fsd {
 
+/**
+ * Operator precedence parser. Chains of additions or multiplications (a + b + c, a * b * c) are built as a single
+ * n-ary node, so the depth of the parsed term does not grow with the length of such chains.
+ */
 class Parser {
  public:
   explicit Parser(std::string_view input);
@@ -22,24 +27,31 @@ class Parser {
   std::expected<Expression, Error> parse();
 
  private:
+  enum class Operation_TP { ADD, SUB, MUL, DIV, POW, SIN, COS, TAN, ASIN, ACOS, ATAN, EXP, LPAR, RPAR };
+
+  /// operand of a pending operation: a term or an open chain of terms combined with chain (ADD or MUL)
+  struct Operand {
+    Expression term;
+    Operation_TP chain {Operation_TP::LPAR};
+    std::vector<Expression> terms {};
+
+    [[nodiscard]] Expression materialize() &&;
+  };
+
   static Expression parse_number(const Token& token);
-  std::optional<Error> handle_addition();
-  std::optional<Error> handle_subtraction();
-  std::optional<Error> handle_multiplication();
-  std::optional<Error> handle_division();
+  static int precedence(Operation_TP op);
+  std::optional<Error> handle_operator(Operation_TP op);
   std::optional<Error> handle_literal(std::string_view literal);
-  std::optional<Error> handle_right_paren();
+  std::optional<Error> handle_right_paren(std::size_t position);
 
   std::optional<Error> concatenate_next();
 
  private:
-  enum class Operation_TP { ADD, SUB, MUL, DIV, POW, SIN, COS, TAN, ASIN, ACOS, ATAN, EXP, LPAR, RPAR };
-
   Tokenizer _tokenizer;
   std::stack<Operation_TP> _operator_stack;
-  std::stack<Expression> _operand_stack;
+  std::stack<Operand> _operand_stack;
 };
 
-std::expected<std::unique_ptr<Term_I>, Error> parse(std::string_view input);
+std::expected<Expression, Error> parse(std::string_view input);
 
 }  // namespace fsd
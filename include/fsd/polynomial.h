@@ -0,0 +1,87 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/flat.h>
+#include <fsd/term.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsd {
+
+/**
+ * Sparse multivariate polynomial: a list of (coefficient, exponent vector) terms sorted by descending exponents in
+ * lexicographic variable order. This order lets evaluate() run a multivariate Horner scheme directly on the term list
+ * and keeps derivative() a single O(number of terms) pass.
+ */
+class Polynomial {
+ public:
+  explicit Polynomial(std::vector<std::string> variables);
+
+  static Polynomial constant(std::vector<std::string> variables, double value);
+  static Polynomial variable(std::vector<std::string> variables, std::uint32_t index);
+
+  [[nodiscard]] Polynomial derivative(std::string_view var) const;
+  [[nodiscard]] Polynomial derivative(std::uint32_t var) const;
+
+  [[nodiscard]] double evaluate(const std::map<std::string, double>& var) const;
+  /// values are ordered like variables()
+  [[nodiscard]] double evaluate(std::span<const double> values) const;
+
+  [[nodiscard]] Expression to_expression() const;
+  [[nodiscard]] std::string to_str() const;
+
+  [[nodiscard]] Polynomial operator+(const Polynomial& other) const;
+  [[nodiscard]] Polynomial operator-(const Polynomial& other) const;
+  [[nodiscard]] Polynomial operator*(const Polynomial& other) const;
+  [[nodiscard]] Polynomial scaled(double factor) const;
+  [[nodiscard]] Polynomial pow(std::uint32_t exponent) const;
+
+  [[nodiscard]] const std::vector<std::string>& variables() const { return _variables; }
+  /// number of terms
+  [[nodiscard]] std::size_t size() const { return _coefficients.size(); }
+  [[nodiscard]] double coefficient(std::size_t term) const { return _coefficients[term]; }
+  [[nodiscard]] std::span<const std::uint32_t> exponents(std::size_t term) const {
+    return {_exponents.data() + term * _variables.size(), _variables.size()};
+  }
+
+ private:
+  using Terms = std::map<std::vector<std::uint32_t>, double, std::greater<>>;
+
+  static Polynomial from_terms(std::vector<std::string> variables, const Terms& terms);
+  [[nodiscard]] Terms to_terms() const;
+  [[nodiscard]] double horner(std::size_t var, std::size_t begin, std::size_t end,
+                              std::span<const double> values) const;
+
+  std::vector<std::string> _variables;
+  std::vector<double> _coefficients;
+  /// row major, one row of variables().size() exponents per term
+  std::vector<std::uint32_t> _exponents;
+};
+
+/// A maximal subexpression of a FlatExpression that is a polynomial.
+struct PolynomialSubexpression {
+  std::uint32_t node;
+  Polynomial polynomial;
+};
+
+/**
+ * Converts an expression built from ADD, SUB, MUL, POW with constant non negative integer exponents and divisions by
+ * constants into a sparse polynomial over the symbols of flat. Returns std::nullopt for any other expression, and for
+ * exponents above 256 or expressions whose expansion could have more than 4096 terms or a degree above 65536.
+ */
+std::optional<Polynomial> to_polynomial(const FlatExpression& flat);
+std::optional<Polynomial> to_polynomial(const Term_I& term);
+
+/// Finds all maximal polynomial subexpressions of flat that are not a single constant or variable.
+std::vector<PolynomialSubexpression> polynomial_subexpressions(const FlatExpression& flat);
+
+}  // namespace fsd
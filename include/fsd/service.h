@@ -0,0 +1,102 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/flat.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fsd {
+
+/**
+ * In-process evaluation service that coalesces small requests. Requests for the same expression are queued and
+ * evaluated together in one batch evaluation as soon as either max_batch_size requests are pending or the oldest
+ * pending request waited for max_delay. This trades a bounded extra latency for a much lower per-request overhead.
+ */
+class EvaluationService {
+ public:
+  struct Options {
+    std::size_t max_batch_size {256};
+    std::chrono::microseconds max_delay {200};
+    std::size_t threads {1};
+  };
+
+  struct Metrics {
+    std::size_t queue_depth;      // requests currently waiting for their batch
+    std::size_t max_queue_depth;  // highest queue_depth observed
+    std::size_t requests;         // requests taken into a batch
+    std::size_t batches;          // batches taken for evaluation
+    std::size_t max_batch_size;   // largest batch
+
+    [[nodiscard]] double average_batch_size() const {
+      return batches == 0 ? 0 : static_cast<double>(requests) / static_cast<double>(batches);
+    }
+  };
+
+  /// invoked on a worker thread once the request has been evaluated
+  using Callback = std::function<void(double)>;
+  /// invoked on a worker thread instead of the callback if the evaluation failed, or if the callback threw
+  using ErrorCallback = std::function<void(std::exception_ptr)>;
+
+  EvaluationService();
+  explicit EvaluationService(Options options);
+  EvaluationService(const EvaluationService&) = delete;
+  EvaluationService& operator=(const EvaluationService&) = delete;
+  /// evaluates all pending requests before returning
+  ~EvaluationService();
+
+  /**
+   * Queues the evaluation of expr at one point. values are indexed by symbol id of expr and must provide a value for
+   * every symbol. Requests are grouped by expr, so the same shared FlatExpression should be used for all of them.
+   * Throws std::invalid_argument if expr is null or the number of values does not match. If the evaluation fails, the
+   * future holds the exception.
+   */
+  std::future<double> submit(std::shared_ptr<const FlatExpression> expr, std::vector<double> values);
+  /// Failures are passed to on_error. Without on_error they are dropped, they never affect other requests.
+  void submit(std::shared_ptr<const FlatExpression> expr, std::vector<double> values, Callback callback,
+              ErrorCallback on_error = {});
+
+  [[nodiscard]] Metrics metrics() const;
+
+ private:
+  struct Request {
+    std::vector<double> values;
+    std::promise<double> promise;
+    Callback callback;
+    ErrorCallback on_error;
+  };
+
+  struct Batch {
+    std::shared_ptr<const FlatExpression> expr;
+    std::vector<Request> requests;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  void enqueue(std::shared_ptr<const FlatExpression> expr, Request request);
+  void work();
+  static void evaluate(Batch& batch);
+  static void complete(Request& request, double value) noexcept;
+  static void fail(Request& request, const std::exception_ptr& error) noexcept;
+
+  Options _options;
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::unordered_map<const FlatExpression*, Batch> _pending;
+  bool _stop {false};
+  Metrics _metrics {};
+  std::vector<std::thread> _workers;
+};
+
+}  // namespace fsd
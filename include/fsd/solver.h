@@ -0,0 +1,88 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/compile.h>
+#include <fsd/flat.h>
+#include <fsd/term.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace fsd {
+
+enum class Method_TP {
+  NEWTON_RAPHSON,  // root of the expression in a single variable
+  DAMPED_NEWTON,   // minimum of the expression, Newton steps on the exact Hessian with backtracking line search
+  LBFGS,           // minimum of the expression, limited memory BFGS with backtracking line search
+};
+
+struct SolverOptions {
+  Method_TP method {Method_TP::LBFGS};
+  std::size_t max_iterations {200};
+  /// convergence threshold on |f| (NEWTON_RAPHSON) or on the largest gradient component (minimizers)
+  double tolerance {1e-10};
+  /// number of correction pairs kept by LBFGS
+  std::size_t history {8};
+  /// worker threads used by the batch solve(), 0 uses one per hardware thread
+  std::size_t threads {0};
+};
+
+struct SolverResult {
+  /// solution, ordered like the variables passed to the Solver
+  std::vector<double> x;
+  /// expression value at x
+  double value;
+  std::size_t iterations;
+  bool converged;
+};
+
+/**
+ * Root finder and minimizer for an expression. The expression is flattened and differentiated once on construction
+ * (including the Hessian for DAMPED_NEWTON). Value and gradient are compiled into one Kernel, so everything they share
+ * is computed once per evaluation, and so is the Hessian. Iterations evaluate them on preallocated buffers, without
+ * allocating.
+ */
+class Solver {
+ public:
+  /// variables are solved for, all other variables of expr are parameters bound on solve()
+  Solver(const Expression& expr, std::vector<std::string> variables, SolverOptions options = {});
+
+  [[nodiscard]] SolverResult solve(std::span<const double> start,
+                                   const std::map<std::string, double>& parameters = {}) const;
+
+  /**
+   * Solves many independent problems in parallel. parameters is either empty, holds a single set shared by all starts
+   * or one set per start.
+   */
+  [[nodiscard]] std::vector<SolverResult> solve(std::span<const std::vector<double>> starts,
+                                                std::span<const std::map<std::string, double>> parameters) const;
+
+  [[nodiscard]] const std::vector<std::string>& variables() const { return _variables; }
+
+ private:
+  class Workspace;
+
+  SolverResult newton_raphson(Workspace& ws) const;
+  SolverResult damped_newton(Workspace& ws) const;
+  SolverResult lbfgs(Workspace& ws) const;
+
+  SolverOptions _options;
+  std::vector<std::string> _variables;
+  std::vector<std::uint32_t> _symbols;
+  FlatExpression _value;
+  Program _value_program;
+  /// outputs are the value followed by the gradient
+  Kernel _value_gradient;
+  /// outputs are the upper triangle of the Hessian in row major order, only for DAMPED_NEWTON
+  Kernel _hessian;
+  std::size_t _registers {0};
+};
+
+}  // namespace fsd
@@ -0,0 +1,31 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#pragma once
+
+#include <fsd/flat.h>
+#include <fsd/term.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace fsd {
+
+struct Specialization {
+  Expression expr;
+  /// number of distinct nodes before and after specialization
+  std::size_t nodes_before;
+  std::size_t nodes_after;
+};
+
+/**
+ * Substitutes the bound variables and folds every subexpression that becomes constant. The result only depends on
+ * the remaining variables and is cheaper to evaluate repeatedly. Symbol ids are kept, bound symbols become unused.
+ */
+FlatExpression specialize(const FlatExpression& flat, const std::map<std::string, double>& bindings);
+
+Specialization specialize(const Term_I& term, const std::map<std::string, double>& bindings);
+
+}  // namespace fsd
@@ -4,22 +4,200 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 #include <map>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 namespace fsd {
 
-class Term_I {
+class FlatExpression;
+class Term_I;
+
+/// Type of a term node, shared by terms and FlatExpression nodes.
+enum class Node_TP : std::uint8_t {
+  CONSTANT,
+  VARIABLE,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  POW,
+  SUM,      // n-ary ADD
+  PRODUCT,  // n-ary MUL
+};
+
+/**
+ * Handle to an immutable, reference counted term. Terms are never mutated after construction, so subtrees are shared
+ * between expressions instead of being copied.
+ */
+using Expression = std::shared_ptr<const Term_I>;
+
+class Term_I : public std::enable_shared_from_this<Term_I> {
  public:
   virtual ~Term_I() = default;
-  [[nodiscard]] virtual std::unique_ptr<Term_I> derivative(const std::string& var) const = 0;
+  // the operator terms recurse only up to detail::MAX_FOLD_RECURSION and handle shared subterms once, so depth is not
+  // limited
+  [[nodiscard]] virtual Expression derivative(const std::string& var) const = 0;
   [[nodiscard]] virtual double evaluate(const std::map<std::string, double>& var) const = 0;
   [[nodiscard]] virtual std::string to_str() const = 0;
 
-  [[nodiscard]] virtual std::unique_ptr<Term_I> clone() const = 0;
+  /**
+   * Returns a handle sharing this term. This is O(1) for terms owned by an Expression. Terms still owned by a
+   * std::unique_ptr are copied shallowly (their operands are shared).
+   */
+  [[nodiscard]] Expression clone() const {
+    if (auto self = weak_from_this().lock()) {
+      return self;
+    }
+    return clone_unique();
+  }
+
+  /**
+   * Migration path for std::unique_ptr<Term_I> based code: returns a uniquely owned copy of this node. The operands of
+   * the copy are shared with this term.
+   */
+  [[nodiscard]] virtual std::unique_ptr<Term_I> clone_unique() const = 0;
+
+  /// Type of this node, lets traversals switch on it instead of casting.
+  [[nodiscard]] virtual Node_TP node_type() const = 0;
+
+  /// Operands of this term, empty for leaves.
+  [[nodiscard]] virtual std::span<const Expression> operands() const { return {}; }
+
+  /**
+   * Appends this single node to flat and returns its index. operands holds the indices of the already flattened
+   * operands(). Use fsd::flatten() to convert a whole term.
+   */
+  virtual std::uint32_t flatten_into(FlatExpression& flat, std::span<const std::uint32_t> operands) const = 0;
+};
+
+/**
+ * True if the variable var occurs in term. The walk is structural (x - x contains x), uses no recursion and visits
+ * shared subterms once.
+ */
+[[nodiscard]] bool occurs(const Term_I& term, std::string_view var);
+
+namespace detail {
+
+/**
+ * Releases the operands of a term that is being destroyed. Operands owned only by this term are destroyed in a loop by
+ * the outermost release() call of the thread instead of recursively, so destroying arbitrarily deep terms cannot
+ * overflow the stack. Call it from the destructor of every term with operands.
+ */
+void release(std::span<Expression> operands) noexcept;
+
+/// depth up to which fold() recurses, deeper subterms are combined with an explicit stack
+inline constexpr std::size_t MAX_FOLD_RECURSION = 256;
+
+template <typename R, typename Combine>
+class Fold {
+ public:
+  explicit Fold(Combine& combine) : _combine(combine) {}
+
+  /// result of term, whose operands are operands, at recursion depth depth
+  R node(const Term_I& term, std::span<const Expression> operands, std::size_t depth) {
+    if (depth >= MAX_FOLD_RECURSION) {
+      return iterate(term);
+    }
+    if (operands.size() <= 2) {
+      R results[2];
+      for (std::size_t i = 0; i < operands.size(); ++i) {
+        results[i] = operand(operands[i], depth + 1);
+      }
+      return _combine(term, std::span<R>(results, operands.size()));
+    }
+    std::vector<R> results;
+    results.reserve(operands.size());
+    for (const Expression& operand : operands) {
+      results.push_back(this->operand(operand, depth + 1));
+    }
+    return _combine(term, std::span<R>(results));
+  }
+
+ private:
+  R operand(const Expression& operand, std::size_t depth) {
+    const auto operands = operand->operands();
+    if (operands.empty()) {
+      return _combine(*operand, std::span<R>());
+    }
+    if (operand.use_count() == 1) {
+      return node(*operand, operands, depth);
+    }
+    if (const auto it = _shared.find(operand.get()); it != _shared.end()) {
+      return it->second;
+    }
+    R result = node(*operand, operands, depth);
+    _shared.emplace(operand.get(), result);
+    return result;
+  }
+
+  /// combines term bottom-up without recursion
+  R iterate(const Term_I& root) {
+    struct Frame {
+      const Term_I* term;
+      std::span<const Expression> operands;
+      std::size_t next;
+      bool shared;
+    };
+    std::vector<Frame> stack {{&root, root.operands(), 0, false}};
+    std::vector<R> results;
+    while (!stack.empty()) {
+      Frame& top = stack.back();
+      if (top.next < top.operands.size()) {
+        const Expression& operand = top.operands[top.next++];
+        const auto operands = operand->operands();
+        if (operands.empty()) {
+          results.push_back(_combine(*operand, std::span<R>()));
+          continue;
+        }
+        const bool is_shared = operand.use_count() > 1;
+        if (is_shared) {
+          if (const auto it = _shared.find(operand.get()); it != _shared.end()) {
+            results.push_back(it->second);
+            continue;
+          }
+        }
+        stack.push_back({operand.get(), operands, 0, is_shared});
+        continue;
+      }
+      const auto first = results.end() - static_cast<std::ptrdiff_t>(top.operands.size());
+      R result = _combine(*top.term, std::span<R>(first, results.end()));
+      results.erase(first, results.end());
+      if (top.shared) {
+        _shared.emplace(top.term, result);
+      }
+      results.push_back(std::move(result));
+      stack.pop_back();
+    }
+    return std::move(results.back());
+  }
+
+  Combine& _combine;
+  /// results of the operators held by more than one handle
+  std::unordered_map<const Term_I*, R> _shared;
 };
 
-typedef std::unique_ptr<Term_I> Expression;
+/**
+ * Combines the nodes of a term bottom-up: combine(node, results) is called for every node after all its operands,
+ * results holds the results of the operands in order. Operators held by more than one handle are combined once, so
+ * shared subterms cost their size only once. Terms up to MAX_FOLD_RECURSION deep are walked recursively without
+ * allocating, deeper subterms with an explicit stack, so depth is not limited. R must be default constructible.
+ */
+template <typename R, typename Combine>
+R fold(const Term_I& root, Combine&& combine) {
+  const auto operands = root.operands();
+  if (operands.empty()) {
+    return combine(root, std::span<R>());
+  }
+  return Fold<R, std::remove_reference_t<Combine>>(combine).node(root, operands, 0);
+}
+
+}  // namespace detail
 
-}  // namespace fsd
\ No newline at end of file
+}  // namespace fsd
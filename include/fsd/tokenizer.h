@@ -50,6 +50,29 @@ struct Token {
   auto operator<=>(const Token&) const = default;
 };
 
+/// binding strength of binary operator tokens, 0 for all other tokens
+constexpr int precedence(TokenType_TP type) {
+  switch (type) {
+    case TokenType_TP::PLUS:
+    case TokenType_TP::MINUS:
+      return 1;
+    case TokenType_TP::MUL:
+    case TokenType_TP::SLASH:
+      return 2;
+    case TokenType_TP::POW:
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+/// '**' is right associative, all other binary operators are left associative
+constexpr bool is_right_associative(TokenType_TP type) { return type == TokenType_TP::POW; }
+
+/**
+ * Splits an expression into tokens. The tokenizer is constexpr, so the same grammar is used for parsing at runtime and
+ * for parsing expression literals at compile time (see fsd/literal.h).
+ */
 class Tokenizer {
  public:
   class Iterator {
@@ -60,12 +83,21 @@ class Tokenizer {
     using pointer = Token*;
     using reference = Token&;
 
-    Iterator(Tokenizer& tokenizer, bool end);
-
-    std::expected<Token, Error> operator*();
-    std::expected<Token, Error>* operator->();
-    Iterator& operator++();
-    bool operator!=(const Iterator& other) const;
+    constexpr Iterator(Tokenizer& tokenizer, bool end) : _tokenizer(tokenizer) {
+      if (!end) {
+        _current_token = tokenizer.next_token();
+      }
+    }
+
+    constexpr std::expected<Token, Error> operator*() { return _current_token; }
+    constexpr std::expected<Token, Error>* operator->() { return &_current_token; }
+    constexpr Iterator& operator++() {
+      _current_token = _tokenizer.next_token();
+      return *this;
+    }
+    constexpr bool operator!=(const Iterator&) const {
+      return _current_token.has_value() && _current_token.value().type != TokenType_TP::END;
+    }
 
    private:
     Tokenizer& _tokenizer;
@@ -73,19 +105,89 @@ class Tokenizer {
   };
 
  public:
-  explicit Tokenizer(std::string_view input);
+  constexpr explicit Tokenizer(std::string_view input) : _input(input), _position(_input.begin()) {}
 
-  std::expected<Token, Error> next_token();
+  constexpr std::expected<Token, Error> next_token();
 
-  Iterator begin();
-  Iterator end();
+  constexpr Iterator begin() { return {*this, false}; }
+  constexpr Iterator end() { return {*this, true}; }
 
-  [[nodiscard]] std::string_view get_input() const;
-  [[nodiscard]] std::string_view::const_iterator get_current_position() const;
+  [[nodiscard]] constexpr std::string_view get_input() const { return _input; }
+  [[nodiscard]] constexpr std::string_view::const_iterator get_current_position() const { return _position; }
 
  private:
+  // locale independent replacements for <cctype>, usable in constant expressions
+  static constexpr bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+  static constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+  static constexpr bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+  static constexpr bool is_alnum(char c) { return is_alpha(c) || is_digit(c); }
+
   std::string_view _input;
   std::string_view::const_iterator _position;
 };
 
+constexpr std::expected<Token, Error> Tokenizer::next_token() {
+  while (_position != _input.end() && is_space(*_position)) {
+    _position++;
+  }
+
+  if (_position == _input.end()) {
+    return Token("", TokenType_TP::END);
+  }
+
+  if (is_digit(*_position)) {
+    // number[0] is digit
+    const auto start = _position;
+    _position++;
+    while (_position != _input.end() && (is_digit(*_position) || *_position == '.')) {
+      // number[1:] is digit or '.' (for floating point numbers)
+      _position++;
+    }
+    return Token(std::string_view(start, _position), TokenType_TP::NUMBER);
+  }
+  if (is_alpha(*_position)) {
+    // variable[1] is alpha
+    const auto start = _position;
+    _position++;
+    while (_position != _input.end() && is_alnum(*_position)) {
+      // variable[1:] are alpha or numeric
+      _position++;
+    }
+    return Token(std::string_view(start, _position), TokenType_TP::LITERAL);
+  }
+
+  switch (*_position) {
+    case '+':
+      _position++;
+      return Token(std::string_view(_position - 1, _position), TokenType_TP::PLUS);
+    case '-':
+      _position++;
+      return Token(std::string_view(_position - 1, _position), TokenType_TP::MINUS);
+    case '*':
+      _position++;
+      if (_position != _input.end() && *_position == '*') {
+        // check if **
+        Token token(std::string_view(_position - 1, _position + 1), TokenType_TP::POW);
+        _position++;
+        return token;
+      }
+      return Token(std::string_view(_position - 1, _position), TokenType_TP::MUL);
+    case '/':
+      _position++;
+      return Token(std::string_view(_position - 1, _position), TokenType_TP::SLASH);
+    case '(':
+      _position++;
+      return Token(std::string_view(_position - 1, _position), TokenType_TP::LEFT_PAREN);
+    case ')':
+      _position++;
+      return Token(std::string_view(_position - 1, _position), TokenType_TP::RIGHT_PAREN);
+    case ',':
+      _position++;
+      return Token(std::string_view(_position - 1, _position), TokenType_TP::COMMA);
+    default:
+      break;
+  }
+  return std::unexpected(Error(ErrorType::UNKNOWN_TOKEN, static_cast<std::size_t>(_position - _input.begin())));
+}
+
 }  // namespace fsd
\ No newline at end of file
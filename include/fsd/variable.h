@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <fsd/flat.h>
 #include <fsd/term.h>
 
 #include <memory>
@@ -18,11 +19,11 @@ class Variable final : public Term_I {
 public:
   explicit Variable(std::string name) : _name(std::move(name)) {}
 
-  [[nodiscard]] std::unique_ptr<Term_I> derivative(const std::string& var) const override {
+  [[nodiscard]] Expression derivative(const std::string& var) const override {
     if (_name == var) {
-      return std::make_unique<Constant<int>>(1);
+      return std::make_shared<Constant<int>>(1);
     }
-    return std::make_unique<Constant<int>>(0);
+    return std::make_shared<Constant<int>>(0);
   }
 
   [[nodiscard]] double evaluate(const std::map<std::string, double> &var) const override {
@@ -36,10 +37,16 @@ public:
     return _name;
   }
 
-  [[nodiscard]] std::unique_ptr<Term_I> clone() const override {
+  [[nodiscard]] std::unique_ptr<Term_I> clone_unique() const override {
     return std::make_unique<Variable>(_name);
   }
 
+  [[nodiscard]] Node_TP node_type() const override { return Node_TP::VARIABLE; }
+
+  std::uint32_t flatten_into(FlatExpression& flat, std::span<const std::uint32_t>) const override {
+    return flat.emplace_variable(flat.intern(_name));
+  }
+
   [[nodiscard]] const std::string& get_name() const {
     return _name;
   }
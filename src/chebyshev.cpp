@@ -0,0 +1,463 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/chebyshev.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace fsd {
+
+namespace {
+
+// number of interpolation points per variable of the first fit
+constexpr std::size_t INITIAL_POINTS = 16;
+
+constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+
+void check_domain(const Domain& domain) {
+  if (!(domain.lower < domain.upper) || !std::isfinite(domain.lower) || !std::isfinite(domain.upper)) {
+    throw std::invalid_argument("invalid domain of " + domain.var);
+  }
+}
+
+/// maps x of the domain onto [-1, 1]
+struct Scaling {
+  double mid;
+  double inverse_half_width;
+
+  explicit Scaling(const Domain& domain)
+      : mid(domain.lower / 2 + domain.upper / 2), inverse_half_width(2 / (domain.upper - domain.lower)) {}
+
+  [[nodiscard]] double operator()(double x) const { return (x - mid) * inverse_half_width; }
+};
+
+/// sum_k c[k * stride] T_k(t)
+double clenshaw(const double* c, std::size_t size, std::size_t stride, double t) {
+  double b1 = 0;
+  double b2 = 0;
+  for (std::size_t k = size - 1; k >= 1; --k) {
+    const double b0 = c[k * stride] + 2 * t * b1 - b2;
+    b2 = b1;
+    b1 = b0;
+  }
+  return c[0] + t * b1 - b2;
+}
+
+/// clenshaw() for n points at once, result may alias neither t nor the scratch arrays b1 and b2
+void clenshaw(const double* c, std::size_t size, std::size_t stride, const double* t, std::size_t n, double* b1,
+              double* b2, double* result) {
+  std::fill_n(b1, n, 0.0);
+  std::fill_n(b2, n, 0.0);
+  for (std::size_t k = size - 1; k >= 1; --k) {
+    const double coefficient = c[k * stride];
+    for (std::size_t p = 0; p < n; ++p) {
+      const double b0 = coefficient + 2 * t[p] * b1[p] - b2[p];
+      b2[p] = b1[p];
+      b1[p] = b0;
+    }
+  }
+  for (std::size_t p = 0; p < n; ++p) {
+    result[p] = c[0] + t[p] * b1[p] - b2[p];
+  }
+}
+
+/**
+ * Coefficients of the derivative of the series c[0], c[stride], ... with respect to t, written to d with the same
+ * stride: d_{k-1} = d_{k+1} + 2k c_k. d must hold size - 1 entries (at least one).
+ */
+void differentiate(const double* c, std::size_t size, std::size_t stride, double scale, double* d) {
+  if (size == 1) {
+    d[0] = 0;
+    return;
+  }
+  double next = 0;     // d_{k+1}
+  double current = 0;  // d_k
+  for (std::size_t k = size - 1; k >= 1; --k) {
+    const double previous = next + 2 * static_cast<double>(k) * c[k * stride];
+    next = current;
+    current = previous;
+    d[(k - 1) * stride] = previous * scale;
+  }
+  d[0] /= 2;
+}
+
+/// Chebyshev points of the first kind mapped onto domain, cos(pi (k + 1/2) / n) descending
+std::vector<double> chebyshev_points(const Domain& domain, std::size_t n) {
+  std::vector<double> points(n);
+  const double mid = domain.lower / 2 + domain.upper / 2;
+  const double half_width = (domain.upper - domain.lower) / 2;
+  for (std::size_t k = 0; k < n; ++k) {
+    points[k] = mid + half_width * std::cos(std::numbers::pi * (static_cast<double>(k) + 0.5) / static_cast<double>(n));
+  }
+  return points;
+}
+
+/// n equally spaced points including both bounds, the error of an interpolant is checked there
+std::vector<double> check_points(const Domain& domain, std::size_t n) {
+  std::vector<double> points(n);
+  for (std::size_t k = 0; k < n; ++k) {
+    const double s = static_cast<double>(k) / static_cast<double>(n - 1);
+    points[k] = domain.lower + s * (domain.upper - domain.lower);
+  }
+  points.back() = domain.upper;
+  return points;
+}
+
+/**
+ * Discrete cosine transform of n values at the Chebyshev points along one axis: the interpolating series has the
+ * coefficients c_j = 2/n sum_k f_k cos(pi j (k + 1/2) / n), c_0 halved. Values and coefficients use the given stride.
+ */
+void transform(const double* values, std::size_t n, std::size_t stride, const std::vector<double>& cosines,
+               double* coefficients) {
+  const std::size_t period = 4 * n;
+  for (std::size_t j = 0; j < n; ++j) {
+    double sum = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+      // cos(pi j (2k + 1) / 2n) from the table of cos(pi m / 2n)
+      sum += values[k * stride] * cosines[(j * (2 * k + 1)) % period];
+    }
+    coefficients[j * stride] = sum * 2 / static_cast<double>(n);
+  }
+  coefficients[0] /= 2;
+}
+
+std::vector<double> cosine_table(std::size_t n) {
+  std::vector<double> cosines(4 * n);
+  for (std::size_t m = 0; m < cosines.size(); ++m) {
+    cosines[m] = std::cos(std::numbers::pi * static_cast<double>(m) / static_cast<double>(2 * n));
+  }
+  return cosines;
+}
+
+/// Evaluates a function of the domain variables over a grid of points. Points of 1D grids are given by x only.
+class Sampler {
+ public:
+  Sampler(const FlatExpression& flat, std::vector<std::string_view> vars) : _flat(flat), _ids(vars.size()) {
+    for (const Node& node : flat.nodes()) {
+      if (node.type == Node_TP::VARIABLE &&
+          std::ranges::find(vars, std::string_view(flat.symbols()[node.lhs])) == vars.end()) {
+        throw std::invalid_argument("expression depends on " + flat.symbols()[node.lhs] +
+                                    ", which is not a variable of the approximation");
+      }
+    }
+    for (std::size_t i = 0; i < vars.size(); ++i) {
+      _ids[i] = flat.symbol_id(vars[i]);
+    }
+  }
+
+  /// values at (x[k], y[l]), row major, finite or throws std::runtime_error
+  [[nodiscard]] std::vector<double> evaluate(std::span<const double> x, std::span<const double> y = {}) const {
+    const std::size_t ny = std::max<std::size_t>(y.size(), 1);
+    std::vector<double> xs(x.size() * ny);
+    std::vector<double> ys(x.size() * ny);
+    for (std::size_t k = 0; k < x.size(); ++k) {
+      for (std::size_t l = 0; l < ny; ++l) {
+        xs[k * ny + l] = x[k];
+        ys[k * ny + l] = y.empty() ? 0 : y[l];
+      }
+    }
+    std::vector<const double*> columns(_flat.symbols().size(), nullptr);
+    if (_ids[0].has_value()) {
+      columns[*_ids[0]] = xs.data();
+    }
+    if (_ids.size() > 1 && _ids[1].has_value()) {
+      columns[*_ids[1]] = ys.data();
+    }
+    std::vector<double> result(xs.size());
+    if (_flat.nodes().empty()) {
+      std::ranges::fill(result, 0.0);
+    } else {
+      _flat.evaluate(columns, result);
+    }
+    if (!std::ranges::all_of(result, [](double value) { return std::isfinite(value); })) {
+      throw std::runtime_error("expression is not finite on the domain");
+    }
+    return result;
+  }
+
+ private:
+  const FlatExpression& _flat;
+  std::vector<std::optional<std::uint32_t>> _ids;
+};
+
+double max_difference(std::span<const double> a, std::span<const double> b) {
+  double result = 0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    result = std::max(result, std::abs(a[i] - b[i]));
+  }
+  return result;
+}
+
+}  // namespace
+
+ChebyshevSeries::ChebyshevSeries(Domain domain, std::vector<double> coefficients, double max_error)
+    : _domain(std::move(domain)), _coefficients(std::move(coefficients)), _max_error(max_error) {
+  check_domain(_domain);
+  if (_coefficients.empty()) {
+    throw std::invalid_argument("Chebyshev series without coefficients");
+  }
+}
+
+double ChebyshevSeries::evaluate(double x) const {
+  return clenshaw(_coefficients.data(), _coefficients.size(), 1, Scaling(_domain)(x));
+}
+
+void ChebyshevSeries::evaluate(std::span<const double> x, std::span<double> result) const {
+  constexpr std::size_t B = BATCH_BLOCK_SIZE;
+  const Scaling scaling(_domain);
+  double t[B];
+  double b1[B];
+  double b2[B];
+  for (std::size_t offset = 0; offset < x.size(); offset += B) {
+    const std::size_t n = std::min(B, x.size() - offset);
+    for (std::size_t p = 0; p < n; ++p) {
+      t[p] = scaling(x[offset + p]);
+    }
+    clenshaw(_coefficients.data(), _coefficients.size(), 1, t, n, b1, b2, result.data() + offset);
+  }
+}
+
+ChebyshevSeries ChebyshevSeries::derivative() const {
+  std::vector<double> d(std::max<std::size_t>(_coefficients.size() - 1, 1));
+  differentiate(_coefficients.data(), _coefficients.size(), 1, Scaling(_domain).inverse_half_width, d.data());
+  return {_domain, std::move(d), NaN};
+}
+
+ChebyshevSeries2D::ChebyshevSeries2D(Domain x, Domain y, std::size_t degree_x, std::size_t degree_y,
+                                     std::vector<double> coefficients, double max_error)
+    : _x(std::move(x)),
+      _y(std::move(y)),
+      _degree_x(degree_x),
+      _degree_y(degree_y),
+      _coefficients(std::move(coefficients)),
+      _max_error(max_error) {
+  check_domain(_x);
+  check_domain(_y);
+  if (_coefficients.size() != (_degree_x + 1) * (_degree_y + 1)) {
+    throw std::invalid_argument("number of coefficients does not match the degrees");
+  }
+}
+
+double ChebyshevSeries2D::evaluate(double x, double y) const {
+  const std::size_t columns = _degree_y + 1;
+  const double s = Scaling(_x)(x);
+  const double t = Scaling(_y)(y);
+  // Clenshaw in x over the rows, each row evaluated in y
+  double b1 = 0;
+  double b2 = 0;
+  for (std::size_t i = _degree_x; i >= 1; --i) {
+    const double b0 = clenshaw(_coefficients.data() + i * columns, columns, 1, t) + 2 * s * b1 - b2;
+    b2 = b1;
+    b1 = b0;
+  }
+  return clenshaw(_coefficients.data(), columns, 1, t) + s * b1 - b2;
+}
+
+void ChebyshevSeries2D::evaluate(std::span<const double> x, std::span<const double> y, std::span<double> result) const {
+  constexpr std::size_t B = BATCH_BLOCK_SIZE;
+  const std::size_t columns = _degree_y + 1;
+  const Scaling scale_x(_x);
+  const Scaling scale_y(_y);
+  double s[B];
+  double t[B];
+  double row[B];
+  double b1[B];
+  double b2[B];
+  double c1[B];
+  double c2[B];
+  for (std::size_t offset = 0; offset < x.size(); offset += B) {
+    const std::size_t n = std::min(B, x.size() - offset);
+    for (std::size_t p = 0; p < n; ++p) {
+      s[p] = scale_x(x[offset + p]);
+      t[p] = scale_y(y[offset + p]);
+    }
+    std::fill_n(b1, n, 0.0);
+    std::fill_n(b2, n, 0.0);
+    for (std::size_t i = _degree_x; i >= 1; --i) {
+      clenshaw(_coefficients.data() + i * columns, columns, 1, t, n, c1, c2, row);
+      for (std::size_t p = 0; p < n; ++p) {
+        const double b0 = row[p] + 2 * s[p] * b1[p] - b2[p];
+        b2[p] = b1[p];
+        b1[p] = b0;
+      }
+    }
+    clenshaw(_coefficients.data(), columns, 1, t, n, c1, c2, row);
+    for (std::size_t p = 0; p < n; ++p) {
+      result[offset + p] = row[p] + s[p] * b1[p] - b2[p];
+    }
+  }
+}
+
+ChebyshevSeries2D ChebyshevSeries2D::derivative(std::size_t axis) const {
+  const std::size_t rows = _degree_x + 1;
+  const std::size_t columns = _degree_y + 1;
+  if (axis == 0) {
+    const std::size_t degree = rows > 1 ? _degree_x - 1 : 0;
+    std::vector<double> d((degree + 1) * columns);
+    for (std::size_t j = 0; j < columns; ++j) {
+      differentiate(_coefficients.data() + j, rows, columns, Scaling(_x).inverse_half_width, d.data() + j);
+    }
+    return {_x, _y, degree, _degree_y, std::move(d), NaN};
+  }
+  if (axis == 1) {
+    const std::size_t degree = columns > 1 ? _degree_y - 1 : 0;
+    std::vector<double> d(rows * (degree + 1));
+    for (std::size_t i = 0; i < rows; ++i) {
+      differentiate(_coefficients.data() + i * columns, columns, 1, Scaling(_y).inverse_half_width,
+                    d.data() + i * (degree + 1));
+    }
+    return {_x, _y, _degree_x, degree, std::move(d), NaN};
+  }
+  throw std::invalid_argument("axis must be 0 or 1");
+}
+
+ChebyshevSeries2D ChebyshevSeries2D::derivative(std::string_view var) const {
+  if (var == _x.var) {
+    return derivative(0);
+  }
+  if (var == _y.var) {
+    return derivative(1);
+  }
+  throw std::invalid_argument("not a variable of the series: " + std::string(var));
+}
+
+ChebyshevSeries approximate(const FlatExpression& flat, const Domain& domain, const ApproximationOptions& options) {
+  check_domain(domain);
+  const Sampler sampler(flat, {domain.var});
+  std::optional<ChebyshevSeries> best;
+  for (std::size_t n = std::min(INITIAL_POINTS, options.max_degree + 1);; n *= 2) {
+    const std::vector<double> values = sampler.evaluate(chebyshev_points(domain, n));
+    std::vector<double> coefficients(n);
+    transform(values.data(), n, 1, cosine_table(n), coefficients.data());
+    // truncating changes the value by at most the sum of the dropped coefficients, as |T_k| <= 1
+    double dropped = 0;
+    while (coefficients.size() > 1 && dropped + std::abs(coefficients.back()) <= options.tolerance / 4) {
+      dropped += std::abs(coefficients.back());
+      coefficients.pop_back();
+    }
+    ChebyshevSeries series(domain, std::move(coefficients), 0);
+    const std::vector<double> points = check_points(domain, 4 * n + 1);
+    std::vector<double> approximation(points.size());
+    series.evaluate(points, approximation);
+    series._max_error = max_difference(approximation, sampler.evaluate(points));
+    if (!best.has_value() || series.max_error() < best->max_error()) {
+      best = std::move(series);
+    }
+    if (best->max_error() <= options.tolerance || 2 * n > options.max_degree + 1) {
+      return *std::move(best);
+    }
+  }
+}
+
+ChebyshevSeries approximate(const Term_I& term, const Domain& domain, const ApproximationOptions& options) {
+  return approximate(flatten(term), domain, options);
+}
+
+ChebyshevSeries2D approximate(const FlatExpression& flat, const Domain& x, const Domain& y,
+                              const ApproximationOptions& options) {
+  check_domain(x);
+  check_domain(y);
+  if (x.var == y.var) {
+    throw std::invalid_argument("both variables of the approximation are " + x.var);
+  }
+  const Sampler sampler(flat, {x.var, y.var});
+  std::optional<ChebyshevSeries2D> best;
+  std::size_t nx = std::min(INITIAL_POINTS, options.max_degree + 1);
+  std::size_t ny = nx;
+  while (true) {
+    const std::vector<double> values = sampler.evaluate(chebyshev_points(x, nx), chebyshev_points(y, ny));
+    // transform the rows in y, then the columns in x
+    std::vector<double> partial(nx * ny);
+    const std::vector<double> cosines_y = cosine_table(ny);
+    for (std::size_t k = 0; k < nx; ++k) {
+      transform(values.data() + k * ny, ny, 1, cosines_y, partial.data() + k * ny);
+    }
+    std::vector<double> c(nx * ny);
+    const std::vector<double> cosines_x = cosine_table(nx);
+    for (std::size_t j = 0; j < ny; ++j) {
+      transform(partial.data() + j, nx, ny, cosines_x, c.data() + j);
+    }
+
+    // magnitude of the last two rows / columns: large if the series is not resolved in that variable yet
+    auto row = [&c, ny](std::size_t i) {
+      double sum = 0;
+      for (std::size_t j = 0; j < ny; ++j) {
+        sum += std::abs(c[i * ny + j]);
+      }
+      return sum;
+    };
+    auto column = [&c, nx, ny](std::size_t j, std::size_t rows) {
+      double sum = 0;
+      for (std::size_t i = 0; i < rows; ++i) {
+        sum += std::abs(c[i * ny + j]);
+      }
+      return sum;
+    };
+    const double tail_x = row(nx - 1) + row(nx - 2);
+    const double tail_y = column(ny - 1, nx) + column(ny - 2, nx);
+
+    // drop trailing rows and columns within a quarter of the tolerance
+    double dropped = 0;
+    std::size_t rows = nx;
+    while (rows > 1 && dropped + row(rows - 1) <= options.tolerance / 8) {
+      dropped += row(--rows);
+    }
+    std::size_t columns = ny;
+    while (columns > 1 && dropped + column(columns - 1, rows) <= options.tolerance / 4) {
+      dropped += column(--columns, rows);
+    }
+    std::vector<double> coefficients(rows * columns);
+    for (std::size_t i = 0; i < rows; ++i) {
+      std::copy_n(c.begin() + static_cast<std::ptrdiff_t>(i * ny), columns,
+                  coefficients.begin() + static_cast<std::ptrdiff_t>(i * columns));
+    }
+    ChebyshevSeries2D series(x, y, rows - 1, columns - 1, std::move(coefficients), 0);
+
+    const std::vector<double> px = check_points(x, 2 * nx + 1);
+    const std::vector<double> py = check_points(y, 2 * ny + 1);
+    std::vector<double> xs;
+    std::vector<double> ys;
+    for (double u : px) {
+      for (double v : py) {
+        xs.push_back(u);
+        ys.push_back(v);
+      }
+    }
+    std::vector<double> approximation(xs.size());
+    series.evaluate(xs, ys, approximation);
+    series._max_error = max_difference(approximation, sampler.evaluate(px, py));
+    if (!best.has_value() || series.max_error() < best->max_error()) {
+      best = std::move(series);
+    }
+    if (best->max_error() <= options.tolerance) {
+      return *std::move(best);
+    }
+
+    // refine the unresolved variables, both if the tails do not tell
+    bool refine_x = 2 * nx <= options.max_degree + 1 && tail_x > options.tolerance / 8;
+    bool refine_y = 2 * ny <= options.max_degree + 1 && tail_y > options.tolerance / 8;
+    if (!refine_x && !refine_y) {
+      refine_x = 2 * nx <= options.max_degree + 1;
+      refine_y = 2 * ny <= options.max_degree + 1;
+    }
+    if (!refine_x && !refine_y) {
+      return *std::move(best);
+    }
+    nx = refine_x ? 2 * nx : nx;
+    ny = refine_y ? 2 * ny : ny;
+  }
+}
+
+ChebyshevSeries2D approximate(const Term_I& term, const Domain& x, const Domain& y,
+                              const ApproximationOptions& options) {
+  return approximate(flatten(term), x, y, options);
+}
+
+}  // namespace fsd
@@ -0,0 +1,771 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/compile.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+namespace fsd {
+
+namespace {
+
+// integer powers up to this exponent are expanded into multiplications
+constexpr double MAX_EXPANDED_EXPONENT = 64;
+
+constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+/// Program in static single assignment form: every instruction defines a new value, dst is its value id.
+struct Code {
+  std::vector<Instruction> instructions;
+  std::vector<double> constants;
+  /// enclosure of the exact value of every constant, wider than the constant for rounded reciprocals
+  std::vector<Interval> bounds;
+  std::uint32_t values {0};
+  /// one value per output
+  std::vector<std::uint32_t> results;
+
+  std::uint32_t emit(OpCode_TP op, std::uint32_t a, std::uint32_t b = 0, std::uint32_t c = 0) {
+    instructions.push_back({op, values, a, b, c});
+    return values++;
+  }
+
+  std::uint32_t emit_constant(double value, Interval bound) {
+    constants.push_back(value);
+    bounds.push_back(bound);
+    return emit(OpCode_TP::CONST, static_cast<std::uint32_t>(constants.size() - 1));
+  }
+  std::uint32_t emit_constant(double value) { return emit_constant(value, value); }
+};
+
+bool is_fused(OpCode_TP op) { return op == OpCode_TP::FMA || op == OpCode_TP::FMS || op == OpCode_TP::FNMA; }
+
+/// calls f with a reference to every register operand of instruction
+template <typename I, typename F>
+void for_each_operand(I& instruction, F&& f) {
+  if (instruction.op == OpCode_TP::CONST || instruction.op == OpCode_TP::LOAD) {
+    return;
+  }
+  f(instruction.a);
+  f(instruction.b);
+  if (is_fused(instruction.op)) {
+    f(instruction.c);
+  }
+}
+
+/// copies code, renaming operands through rename and emitting new instructions through rewrite
+template <typename F>
+Code transform(const Code& code, F&& rewrite) {
+  Code result;
+  result.constants = code.constants;
+  result.bounds = code.bounds;
+  std::vector<std::uint32_t> rename(code.values, NONE);
+  for (Instruction instruction : code.instructions) {
+    for_each_operand(instruction, [&rename](std::uint32_t& operand) { operand = rename[operand]; });
+    rename[instruction.dst] = rewrite(result, instruction);
+  }
+  for (std::uint32_t value : code.results) {
+    result.results.push_back(rename[value]);
+  }
+  return result;
+}
+
+OpCode_TP opcode(Node_TP type) {
+  switch (type) {
+    case Node_TP::ADD:
+    case Node_TP::SUM:
+      return OpCode_TP::ADD;
+    case Node_TP::SUB:
+      return OpCode_TP::SUB;
+    case Node_TP::MUL:
+    case Node_TP::PRODUCT:
+      return OpCode_TP::MUL;
+    case Node_TP::DIV:
+      return OpCode_TP::DIV;
+    default:
+      return OpCode_TP::POW;
+  }
+}
+
+/**
+ * Translates flat into SSA code. The nodes are scheduled depth first from the root instead of in the order of flat,
+ * which computes all operands of a sum before adding them up: an operand is added to the running sum as soon as it is
+ * computed, so few values are live at a time. Nodes not reachable from the root are dropped.
+ *
+ * The code is appended to code, symbols maps the symbol ids of flat to the ones of code. Returns the value of the root.
+ */
+std::uint32_t lower(const FlatExpression& flat, Code& code, std::span<const std::uint32_t> symbols) {
+  if (flat.nodes().empty()) {
+    return code.emit_constant(0);
+  }
+  const auto constants = static_cast<std::uint32_t>(code.constants.size());
+  code.constants.insert(code.constants.end(), flat.constants().begin(), flat.constants().end());
+  code.bounds.insert(code.bounds.end(), flat.constants().begin(), flat.constants().end());
+  struct Frame {
+    std::uint32_t node;
+    std::uint32_t next;
+    std::uint32_t accumulator;
+  };
+  std::vector<std::uint32_t> values(flat.size(), NONE);
+  std::vector<Frame> stack {{flat.root(), 0, NONE}};
+  while (!stack.empty()) {
+    Frame& frame = stack.back();
+    const Node& node = flat.nodes()[frame.node];
+    if (node.type == Node_TP::CONSTANT || node.type == Node_TP::VARIABLE) {
+      values[frame.node] = node.type == Node_TP::CONSTANT ? code.emit(OpCode_TP::CONST, constants + node.lhs)
+                                                          : code.emit(OpCode_TP::LOAD, symbols[node.lhs]);
+      stack.pop_back();
+      continue;
+    }
+    const bool nary = node.type == Node_TP::SUM || node.type == Node_TP::PRODUCT;
+    const std::uint32_t binary[] = {node.lhs, node.rhs};
+    const auto operands = nary ? flat.nary_operands(node) : std::span<const std::uint32_t>(binary);
+    if (frame.next < operands.size()) {
+      const std::uint32_t operand = operands[frame.next];
+      if (values[operand] == NONE) {
+        stack.push_back({operand, 0, NONE});
+        continue;
+      }
+      if (nary) {
+        frame.accumulator =
+            frame.next == 0 ? values[operand] : code.emit(opcode(node.type), frame.accumulator, values[operand]);
+      }
+      ++frame.next;
+      continue;
+    }
+    values[frame.node] = nary ? frame.accumulator : code.emit(opcode(node.type), values[node.lhs], values[node.rhs]);
+    stack.pop_back();
+  }
+  return values[flat.root()];
+}
+
+Code strength_reduction(const Code& code) {
+  // value of every value defined by a CONST instruction of the output
+  std::unordered_map<std::uint32_t, double> constants;
+  return transform(code, [&constants](Code& out, const Instruction& instruction) {
+    auto constant = [&](std::uint32_t value) -> std::optional<double> {
+      if (auto it = constants.find(value); it != constants.end()) {
+        return it->second;
+      }
+      return std::nullopt;
+    };
+    switch (instruction.op) {
+      case OpCode_TP::CONST: {
+        const std::uint32_t value = out.emit(OpCode_TP::CONST, instruction.a);
+        constants.emplace(value, out.constants[instruction.a]);
+        return value;
+      }
+      case OpCode_TP::POW: {
+        const auto k = constant(instruction.b);
+        if (!k.has_value() || *k != std::trunc(*k) || std::abs(*k) > MAX_EXPANDED_EXPONENT) {
+          break;
+        }
+        if (*k == 0) {
+          return out.emit_constant(1);
+        }
+        // square and multiply: x^13 = x * x^4 * x^8
+        auto n = static_cast<std::uint32_t>(std::abs(*k));
+        std::uint32_t power = instruction.a;
+        std::uint32_t product = NONE;
+        while (true) {
+          if ((n & 1U) != 0) {
+            product = product == NONE ? power : out.emit(OpCode_TP::MUL, product, power);
+          }
+          n >>= 1U;
+          if (n == 0) {
+            break;
+          }
+          power = out.emit(OpCode_TP::MUL, power, power);
+        }
+        return *k > 0 ? product : out.emit(OpCode_TP::DIV, out.emit_constant(1), product);
+      }
+      case OpCode_TP::DIV: {
+        const auto divisor = constant(instruction.b);
+        if (!divisor.has_value() || *divisor == 0 || !std::isfinite(1 / *divisor)) {
+          break;
+        }
+        // the interval evaluation keeps the exact reciprocal
+        const std::uint32_t reciprocal = out.emit_constant(1 / *divisor, Interval(1) / Interval(*divisor));
+        constants.emplace(reciprocal, 1 / *divisor);
+        return out.emit(OpCode_TP::MUL, instruction.a, reciprocal);
+      }
+      default:
+        break;
+    }
+    return out.emit(instruction.op, instruction.a, instruction.b, instruction.c);
+  });
+}
+
+/**
+ * Global value numbering: an instruction computing the same operation on the same values as an earlier one is replaced
+ * by it. Constants are compared by bit pattern and enclosure, so 0 and -0 stay distinct and a rounded reciprocal is not
+ * shared with a constant of the same value. Operands of commutative operations are
+ * ordered first, which also shares x * y with y * x.
+ */
+Code common_subexpression_elimination(const Code& code) {
+  std::map<Instruction, std::uint32_t> computed;
+  std::map<std::array<std::uint64_t, 3>, std::uint32_t> constants;
+  return transform(code, [&](Code& out, Instruction instruction) {
+    if (instruction.op == OpCode_TP::CONST) {
+      const Interval& bound = code.bounds[instruction.a];
+      const std::array key {std::bit_cast<std::uint64_t>(code.constants[instruction.a]),
+                            std::bit_cast<std::uint64_t>(bound.lower()), std::bit_cast<std::uint64_t>(bound.upper())};
+      auto [it, inserted] = constants.try_emplace(key, 0);
+      if (inserted) {
+        it->second = out.emit(OpCode_TP::CONST, instruction.a);
+      }
+      return it->second;
+    }
+    const bool commutative = instruction.op == OpCode_TP::ADD || instruction.op == OpCode_TP::MUL;
+    if (commutative && instruction.a > instruction.b) {
+      std::swap(instruction.a, instruction.b);
+    }
+    instruction.dst = 0;
+    auto [it, inserted] = computed.try_emplace(instruction, 0);
+    if (inserted) {
+      it->second = out.emit(instruction.op, instruction.a, instruction.b, instruction.c);
+    }
+    return it->second;
+  });
+}
+
+Code fma_fusion(const Code& code) {
+  std::vector<std::uint32_t> uses(code.values);
+  std::vector<const Instruction*> definition(code.values);
+  for (const Instruction& instruction : code.instructions) {
+    definition[instruction.dst] = &instruction;
+    for_each_operand(instruction, [&uses](std::uint32_t operand) { uses[operand]++; });
+  }
+  for (std::uint32_t value : code.results) {
+    uses[value]++;
+  }
+  // A product is fused if all its users absorb it: then it becomes dead and is removed by dead code elimination, and a
+  // product shared by k sums costs k fused instructions instead of k + 1. A sum absorbs its lhs if that is fusible,
+  // otherwise its rhs. Products not absorbed by every user are dropped until the choice is stable.
+  std::vector<bool> fusible(code.values);
+  for (const Instruction& instruction : code.instructions) {
+    fusible[instruction.dst] = instruction.op == OpCode_TP::MUL;
+  }
+  auto absorbed = [&fusible](const Instruction& instruction) {
+    if (instruction.op != OpCode_TP::ADD && instruction.op != OpCode_TP::SUB) {
+      return NONE;
+    }
+    return fusible[instruction.a] ? instruction.a : fusible[instruction.b] ? instruction.b : NONE;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    std::vector<std::uint32_t> absorptions(code.values);
+    for (const Instruction& instruction : code.instructions) {
+      if (const std::uint32_t value = absorbed(instruction); value != NONE) {
+        absorptions[value]++;
+      }
+    }
+    for (std::uint32_t value = 0; value < code.values; ++value) {
+      if (fusible[value] && absorptions[value] != uses[value]) {
+        fusible[value] = false;
+        changed = true;
+      }
+    }
+  }
+  auto product = [&](std::uint32_t value) -> const Instruction* { return fusible[value] ? definition[value] : nullptr; };
+  std::vector<std::uint32_t> rename(code.values, NONE);
+  Code result;
+  result.constants = code.constants;
+  result.bounds = code.bounds;
+  for (Instruction instruction : code.instructions) {
+    const Instruction original = instruction;
+    for_each_operand(instruction, [&rename](std::uint32_t& operand) { operand = rename[operand]; });
+    std::uint32_t value = NONE;
+    if (original.op == OpCode_TP::ADD || original.op == OpCode_TP::SUB) {
+      const bool add = original.op == OpCode_TP::ADD;
+      if (const Instruction* lhs = product(original.a); lhs != nullptr) {
+        value = result.emit(add ? OpCode_TP::FMA : OpCode_TP::FMS, rename[lhs->a], rename[lhs->b], instruction.b);
+      } else if (const Instruction* rhs = product(original.b); rhs != nullptr) {
+        value = result.emit(add ? OpCode_TP::FMA : OpCode_TP::FNMA, rename[rhs->a], rename[rhs->b], instruction.a);
+      }
+    }
+    if (value == NONE) {
+      value = result.emit(instruction.op, instruction.a, instruction.b, instruction.c);
+    }
+    rename[original.dst] = value;
+  }
+  for (std::uint32_t value : code.results) {
+    result.results.push_back(rename[value]);
+  }
+  return result;
+}
+
+Code dead_code_elimination(const Code& code) {
+  std::vector<bool> live(code.values);
+  for (std::uint32_t value : code.results) {
+    live[value] = true;
+  }
+  for (auto it = code.instructions.rbegin(); it != code.instructions.rend(); ++it) {
+    if (live[it->dst]) {
+      for_each_operand(*it, [&live](std::uint32_t operand) { live[operand] = true; });
+    }
+  }
+  return transform(code, [&live](Code& out, const Instruction& instruction) {
+    // dst is still the value id of the input here
+    return live[instruction.dst] ? out.emit(instruction.op, instruction.a, instruction.b, instruction.c) : NONE;
+  });
+}
+
+/**
+ * Assigns registers to the values of code, the result uses register ids as values. With reuse, the register of a value
+ * is released after its last use (linear scan over the straight line code), otherwise every value keeps its own.
+ */
+Code allocate(const Code& code, bool reuse) {
+  std::vector<std::uint32_t> last_use(code.values, NONE);
+  for (std::uint32_t i = 0; i < code.instructions.size(); ++i) {
+    for_each_operand(code.instructions[i], [&last_use, i](std::uint32_t operand) { last_use[operand] = i; });
+  }
+  for (std::uint32_t value : code.results) {
+    last_use[value] = static_cast<std::uint32_t>(code.instructions.size());
+  }
+
+  std::vector<std::uint32_t> registers(code.values, NONE);
+  std::vector<std::uint32_t> free;
+  std::uint32_t count = 0;
+  std::vector<Instruction> instructions;
+  for (std::uint32_t i = 0; i < code.instructions.size(); ++i) {
+    Instruction instruction = code.instructions[i];
+    const std::uint32_t value = instruction.dst;
+    for_each_operand(instruction, [&](std::uint32_t& operand) {
+      const std::uint32_t reg = registers[operand];
+      // operands are read before the result is written, so the result may reuse the register of its last operand
+      if (reuse && last_use[operand] == i && std::ranges::find(free, reg) == free.end()) {
+        free.push_back(reg);
+      }
+      operand = reg;
+    });
+    if (free.empty()) {
+      instruction.dst = count++;
+    } else {
+      instruction.dst = free.back();
+      free.pop_back();
+    }
+    registers[value] = instruction.dst;
+    if (reuse && last_use[value] == NONE) {
+      free.push_back(instruction.dst);
+    }
+    instructions.push_back(instruction);
+  }
+  Code result;
+  result.instructions = std::move(instructions);
+  result.constants = code.constants;
+  result.bounds = code.bounds;
+  result.values = count;
+  for (std::uint32_t value : code.results) {
+    result.results.push_back(registers[value]);
+  }
+  return result;
+}
+
+/// sample points of the verification, all values are in [0.5, 2] to stay in the domain of most expressions
+std::vector<double> sample(std::size_t symbols, std::size_t point) {
+  std::vector<double> values(symbols);
+  for (std::size_t i = 0; i < symbols; ++i) {
+    const double phase = static_cast<double>(i + 1) * 0.6180339887498949 + static_cast<double>(point) * 0.414213562;
+    values[i] = 0.5 + 1.5 * (phase - std::floor(phase));
+  }
+  return values;
+}
+
+bool close(double a, double b) {
+  if (std::isnan(a) || std::isnan(b)) {
+    return std::isnan(a) && std::isnan(b);
+  }
+  return a == b || std::abs(a - b) <= 1e-9 * std::max({1.0, std::abs(a), std::abs(b)});
+}
+
+/// a * b + c, rounded once for doubles. Other scalars (intervals) have no fused operation and compute a product and a sum.
+template <typename T>
+T multiply_add(const T& a, const T& b, const T& c) {
+  if constexpr (std::is_same_v<T, double>) {
+    return std::fma(a, b, c);
+  } else {
+    return a * b + c;
+  }
+}
+
+/// evaluates instructions once, registers must hold enough values for every dst
+template <typename T>
+void execute(std::span<const Instruction> instructions, std::span<const std::type_identity_t<T>> constants,
+             std::span<const std::type_identity_t<T>> values, T* r) {
+  for (const Instruction& instruction : instructions) {
+    switch (instruction.op) {
+      case OpCode_TP::CONST:
+        r[instruction.dst] = constants[instruction.a];
+        break;
+      case OpCode_TP::LOAD:
+        r[instruction.dst] = values[instruction.a];
+        break;
+      case OpCode_TP::ADD:
+        r[instruction.dst] = r[instruction.a] + r[instruction.b];
+        break;
+      case OpCode_TP::SUB:
+        r[instruction.dst] = r[instruction.a] - r[instruction.b];
+        break;
+      case OpCode_TP::MUL:
+        r[instruction.dst] = r[instruction.a] * r[instruction.b];
+        break;
+      case OpCode_TP::DIV:
+        r[instruction.dst] = r[instruction.a] / r[instruction.b];
+        break;
+      case OpCode_TP::POW:
+        r[instruction.dst] = detail::pow(r[instruction.a], r[instruction.b]);
+        break;
+      case OpCode_TP::FMA:
+        r[instruction.dst] = multiply_add(r[instruction.a], r[instruction.b], r[instruction.c]);
+        break;
+      case OpCode_TP::FMS:
+        r[instruction.dst] = multiply_add(r[instruction.a], r[instruction.b], -r[instruction.c]);
+        break;
+      case OpCode_TP::FNMA:
+        r[instruction.dst] = multiply_add(-r[instruction.a], r[instruction.b], r[instruction.c]);
+        break;
+    }
+  }
+}
+
+/**
+ * Evaluates instructions for the n <= Program::BATCH_BLOCK_SIZE points starting at offset. Every register holds a block
+ * of values, few registers keep the working set in the L1 cache.
+ */
+void execute_block(std::span<const Instruction> instructions, std::span<const double> constants,
+                   std::span<const double* const> columns, std::size_t offset, std::size_t n, double* registers) {
+  constexpr std::size_t B = Program::BATCH_BLOCK_SIZE;
+  for (const Instruction& instruction : instructions) {
+    double* out = registers + instruction.dst * B;
+    const double* a = registers + instruction.a * B;
+    const double* b = registers + instruction.b * B;
+    const double* c = registers + instruction.c * B;
+    switch (instruction.op) {
+      case OpCode_TP::CONST:
+        std::fill_n(out, n, constants[instruction.a]);
+        break;
+      case OpCode_TP::LOAD:
+        std::copy_n(columns[instruction.a] + offset, n, out);
+        break;
+      case OpCode_TP::ADD:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = a[k] + b[k];
+        }
+        break;
+      case OpCode_TP::SUB:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = a[k] - b[k];
+        }
+        break;
+      case OpCode_TP::MUL:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = a[k] * b[k];
+        }
+        break;
+      case OpCode_TP::DIV:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = a[k] / b[k];
+        }
+        break;
+      case OpCode_TP::POW:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = std::pow(a[k], b[k]);
+        }
+        break;
+      case OpCode_TP::FMA:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = std::fma(a[k], b[k], c[k]);
+        }
+        break;
+      case OpCode_TP::FMS:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = std::fma(a[k], b[k], -c[k]);
+        }
+        break;
+      case OpCode_TP::FNMA:
+        for (std::size_t k = 0; k < n; ++k) {
+          out[k] = std::fma(-a[k], b[k], c[k]);
+        }
+        break;
+    }
+  }
+}
+
+/// values of the loaded symbols taken from var, indexed by symbol id
+std::vector<double> bind(std::span<const Instruction> instructions, const std::vector<std::string>& symbols,
+                         const std::map<std::string, double>& var) {
+  std::vector<double> values(symbols.size());
+  for (const Instruction& instruction : instructions) {
+    if (instruction.op != OpCode_TP::LOAD) {
+      continue;
+    }
+    auto it = var.find(symbols[instruction.a]);
+    if (it == var.end()) {
+      throw std::runtime_error("no value for variable " + symbols[instruction.a]);
+    }
+    values[instruction.a] = it->second;
+  }
+  return values;
+}
+
+/// one instruction per line
+std::string disassemble(std::span<const Instruction> instructions, std::span<const double> constants,
+                        const std::vector<std::string>& symbols) {
+  std::string result;
+  for (const Instruction& i : instructions) {
+    switch (i.op) {
+      case OpCode_TP::CONST:
+        result += std::format("r{} = {}\n", i.dst, constants[i.a]);
+        break;
+      case OpCode_TP::LOAD:
+        result += std::format("r{} = {}\n", i.dst, symbols[i.a]);
+        break;
+      case OpCode_TP::ADD:
+        result += std::format("r{} = r{} + r{}\n", i.dst, i.a, i.b);
+        break;
+      case OpCode_TP::SUB:
+        result += std::format("r{} = r{} - r{}\n", i.dst, i.a, i.b);
+        break;
+      case OpCode_TP::MUL:
+        result += std::format("r{} = r{} * r{}\n", i.dst, i.a, i.b);
+        break;
+      case OpCode_TP::DIV:
+        result += std::format("r{} = r{} / r{}\n", i.dst, i.a, i.b);
+        break;
+      case OpCode_TP::POW:
+        result += std::format("r{} = r{}^r{}\n", i.dst, i.a, i.b);
+        break;
+      case OpCode_TP::FMA:
+        result += std::format("r{} = fma(r{}, r{}, r{})\n", i.dst, i.a, i.b, i.c);
+        break;
+      case OpCode_TP::FMS:
+        result += std::format("r{} = fms(r{}, r{}, r{})\n", i.dst, i.a, i.b, i.c);
+        break;
+      case OpCode_TP::FNMA:
+        result += std::format("r{} = fnma(r{}, r{}, r{})\n", i.dst, i.a, i.b, i.c);
+        break;
+    }
+  }
+  return result;
+}
+
+std::size_t count_operations(std::span<const Instruction> instructions) {
+  return static_cast<std::size_t>(std::ranges::count_if(instructions, [](const Instruction& instruction) {
+    return instruction.op != OpCode_TP::CONST && instruction.op != OpCode_TP::LOAD;
+  }));
+}
+
+/// runs the passes enabled in options on code and returns the register allocated result
+Code run_passes(const Code& reference, std::size_t symbols, const CompileOptions& options) {
+  std::vector<std::vector<double>> samples;
+  std::vector<std::vector<double>> expected;
+  auto evaluate = [&samples](const Code& allocated, std::size_t point) {
+    std::vector<double> registers(allocated.values);
+    execute<double>(allocated.instructions, allocated.constants, samples[point], registers.data());
+    std::vector<double> results;
+    for (std::uint32_t value : allocated.results) {
+      results.push_back(registers[value]);
+    }
+    return results;
+  };
+  if (options.verify) {
+    const Code unoptimized = allocate(reference, false);
+    for (std::size_t point = 0; point < 3; ++point) {
+      samples.push_back(sample(symbols, point));
+      expected.push_back(evaluate(unoptimized, point));
+    }
+  }
+  auto verify = [&](const Code& code, bool reuse, std::string_view pass) {
+    if (!options.verify) {
+      return;
+    }
+    const Code optimized = allocate(code, reuse);
+    for (std::size_t point = 0; point < samples.size(); ++point) {
+      const std::vector<double> values = evaluate(optimized, point);
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        if (!close(values[i], expected[point][i])) {
+          throw std::logic_error(
+              std::format("{} changed output {} from {} to {}", pass, i, expected[point][i], values[i]));
+        }
+      }
+    }
+  };
+
+  Code code = reference;
+  if (options.strength_reduction) {
+    code = strength_reduction(code);
+    verify(code, false, "strength reduction");
+  }
+  if (options.common_subexpression_elimination) {
+    code = common_subexpression_elimination(code);
+    verify(code, false, "common subexpression elimination");
+  }
+  if (options.fma_fusion) {
+    code = fma_fusion(code);
+    verify(code, false, "fma fusion");
+  }
+  if (options.dead_code_elimination) {
+    code = dead_code_elimination(code);
+    verify(code, false, "dead code elimination");
+  }
+  verify(code, options.register_reuse, "register allocation");
+  return allocate(code, options.register_reuse);
+}
+
+/// lowers flat with its own symbol ids
+Code lower(const FlatExpression& flat) {
+  std::vector<std::uint32_t> symbols(flat.symbols().size());
+  std::iota(symbols.begin(), symbols.end(), 0);
+  Code code;
+  code.results.push_back(lower(flat, code, symbols));
+  return code;
+}
+
+}  // namespace
+
+double Program::evaluate(const std::map<std::string, double>& var) const {
+  return evaluate(bind(_instructions, _symbols, var));
+}
+
+double Program::evaluate(std::span<const double> values) const {
+  std::vector<double> registers(_registers);
+  return evaluate(values, registers);
+}
+
+double Program::evaluate(std::span<const double> values, std::span<double> registers) const {
+  execute<double>(_instructions, _constants, values, registers.data());
+  return registers[_result];
+}
+
+void Program::evaluate(std::span<const double* const> columns, std::span<double> result) const {
+  constexpr std::size_t B = BATCH_BLOCK_SIZE;
+  std::vector<double> registers(static_cast<std::size_t>(_registers) * B);
+  for (std::size_t offset = 0; offset < result.size(); offset += B) {
+    const std::size_t n = std::min(B, result.size() - offset);
+    execute_block(_instructions, _constants, columns, offset, n, registers.data());
+    std::copy_n(registers.data() + _result * B, n, result.begin() + offset);
+  }
+}
+
+Interval Program::evaluate(std::span<const Interval> values) const {
+  std::vector<Interval> registers(_registers);
+  execute<Interval>(_instructions, _bounds, values, registers.data());
+  return registers[_result];
+}
+
+std::string Program::to_str() const {
+  return disassemble(_instructions, _constants, _symbols) + std::format("return r{}", _result);
+}
+
+std::vector<double> Kernel::evaluate(const std::map<std::string, double>& var) const {
+  std::vector<double> outputs(_outputs.size());
+  evaluate(bind(_instructions, _symbols, var), outputs);
+  return outputs;
+}
+
+void Kernel::evaluate(std::span<const double> values, std::span<double> outputs) const {
+  std::vector<double> registers(_registers);
+  evaluate(values, registers, outputs);
+}
+
+void Kernel::evaluate(std::span<const double> values, std::span<double> registers, std::span<double> outputs) const {
+  execute<double>(_instructions, _constants, values, registers.data());
+  for (std::size_t i = 0; i < _outputs.size(); ++i) {
+    outputs[i] = registers[_outputs[i]];
+  }
+}
+
+void Kernel::evaluate(std::span<const Interval> values, std::span<Interval> outputs) const {
+  std::vector<Interval> registers(_registers);
+  execute<Interval>(_instructions, _bounds, values, registers.data());
+  for (std::size_t i = 0; i < _outputs.size(); ++i) {
+    outputs[i] = registers[_outputs[i]];
+  }
+}
+
+void Kernel::evaluate(std::span<const double* const> columns, std::span<double* const> outputs,
+                      std::size_t count) const {
+  constexpr std::size_t B = Program::BATCH_BLOCK_SIZE;
+  std::vector<double> registers(static_cast<std::size_t>(_registers) * B);
+  for (std::size_t offset = 0; offset < count; offset += B) {
+    const std::size_t n = std::min(B, count - offset);
+    execute_block(_instructions, _constants, columns, offset, n, registers.data());
+    for (std::size_t i = 0; i < _outputs.size(); ++i) {
+      std::copy_n(registers.data() + _outputs[i] * B, n, outputs[i] + offset);
+    }
+  }
+}
+
+std::string Kernel::to_str() const {
+  std::string result = disassemble(_instructions, _constants, _symbols) + "return ";
+  for (std::size_t i = 0; i < _outputs.size(); ++i) {
+    result += std::format("{}r{}", i == 0 ? "" : ", ", _outputs[i]);
+  }
+  return result;
+}
+
+std::size_t Program::operations() const { return count_operations(_instructions); }
+
+std::size_t Kernel::operations() const { return count_operations(_instructions); }
+
+Program compile(const FlatExpression& flat, const CompileOptions& options) {
+  const Code code = run_passes(lower(flat), flat.symbols().size(), options);
+  Program program;
+  program._instructions = code.instructions;
+  program._constants = code.constants;
+  program._bounds = code.bounds;
+  program._symbols = flat.symbols();
+  program._registers = code.values;
+  program._result = code.results.front();
+  return program;
+}
+
+Program compile(const Term_I& term, const CompileOptions& options) { return compile(flatten(term), options); }
+
+Kernel compile_kernel(std::span<const FlatExpression> outputs, const CompileOptions& options) {
+  Kernel kernel;
+  Code code;
+  // the symbol tables of the outputs are merged by name
+  std::unordered_map<std::string_view, std::uint32_t> symbol_ids;
+  for (const FlatExpression& flat : outputs) {
+    std::vector<std::uint32_t> symbols;
+    for (const std::string& symbol : flat.symbols()) {
+      auto [it, inserted] = symbol_ids.try_emplace(symbol, static_cast<std::uint32_t>(kernel._symbols.size()));
+      if (inserted) {
+        kernel._symbols.push_back(symbol);
+      }
+      symbols.push_back(it->second);
+    }
+    code.results.push_back(lower(flat, code, symbols));
+    kernel._separate_operations += compile(flat, options).operations();
+  }
+  code = run_passes(code, kernel._symbols.size(), options);
+  kernel._instructions = std::move(code.instructions);
+  kernel._constants = std::move(code.constants);
+  kernel._bounds = std::move(code.bounds);
+  kernel._registers = code.values;
+  kernel._outputs = std::move(code.results);
+  return kernel;
+}
+
+Kernel compile_kernel(std::span<const Expression> outputs, const CompileOptions& options) {
+  std::vector<FlatExpression> flats;
+  for (const Expression& output : outputs) {
+    flats.push_back(flatten(*output));
+  }
+  return compile_kernel(flats, options);
+}
+
+}  // namespace fsd
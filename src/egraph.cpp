@@ -0,0 +1,504 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/egraph.h>
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fsd {
+
+namespace {
+
+// integer powers up to this exponent are rewritten into multiplications
+constexpr double MAX_EXPANDED_EXPONENT = 64;
+
+/**
+ * Node of the e-graph. Operands refer to e-classes instead of nodes.
+ *  - CONSTANT: lhs is 1 if the constant is integral, value holds the constant
+ *  - VARIABLE: lhs is the symbol id
+ *  - others:   lhs and rhs are the operand classes
+ */
+struct ENode {
+  Node_TP type;
+  std::uint32_t lhs;
+  std::uint32_t rhs;
+  double value;
+
+  bool operator==(const ENode&) const = default;
+};
+
+struct ENodeHash {
+  std::size_t operator()(const ENode& node) const {
+    std::size_t hash = static_cast<std::size_t>(node.type);
+    hash = hash * 0x9e3779b97f4a7c15ULL + node.lhs;
+    hash = hash * 0x9e3779b97f4a7c15ULL + node.rhs;
+    return hash * 0x9e3779b97f4a7c15ULL + std::bit_cast<std::uint64_t>(node.value == 0 ? 0.0 : node.value);
+  }
+};
+
+bool is_leaf(Node_TP type) { return type == Node_TP::CONSTANT || type == Node_TP::VARIABLE; }
+
+bool is_integral(double value) { return value == std::trunc(value) && std::abs(value) < 1e15; }
+
+class EGraph {
+ public:
+  struct EClass {
+    std::vector<ENode> nodes;
+    /// value of the class if it is known to be constant
+    std::optional<double> constant;
+    bool integral {false};
+  };
+
+  /// adds node (if no equivalent node exists yet) and returns its class
+  std::uint32_t add(ENode node) {
+    if (!is_leaf(node.type)) {
+      node.lhs = find(node.lhs);
+      node.rhs = find(node.rhs);
+    }
+    if (auto it = _memo.find(node); it != _memo.end()) {
+      return find(it->second);
+    }
+    const auto id = static_cast<std::uint32_t>(_classes.size());
+    EClass eclass {{node}, std::nullopt, false};
+    if (node.type == Node_TP::CONSTANT) {
+      eclass.constant = node.value;
+      eclass.integral = node.lhs != 0;
+    }
+    _classes.push_back(std::move(eclass));
+    _parents.push_back(id);
+    _memo.emplace(node, id);
+    if (!is_leaf(node.type)) {
+      // constant folding: the class of an operation on constants also holds the constant itself
+      if (auto folded = fold(node); folded.has_value()) {
+        merge(id, constant(folded->first, folded->second));
+      }
+    }
+    return find(id);
+  }
+
+  std::uint32_t add(Node_TP type, std::uint32_t lhs, std::uint32_t rhs) { return add({type, lhs, rhs, 0}); }
+
+  std::uint32_t constant(double value, bool integral) {
+    return add({Node_TP::CONSTANT, integral ? 1U : 0U, 0, value == 0 ? 0.0 : value});
+  }
+
+  std::uint32_t find(std::uint32_t id) {
+    while (_parents[id] != id) {
+      _parents[id] = _parents[_parents[id]];
+      id = _parents[id];
+    }
+    return id;
+  }
+
+  /// records that the classes a and b are equivalent, returns false if they already were
+  bool merge(std::uint32_t a, std::uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+      return false;
+    }
+    if (_classes[a].nodes.size() < _classes[b].nodes.size()) {
+      std::swap(a, b);
+    }
+    _parents[b] = a;
+    EClass& target = _classes[a];
+    EClass& source = _classes[b];
+    target.nodes.insert(target.nodes.end(), source.nodes.begin(), source.nodes.end());
+    source.nodes = {};
+    if (!target.constant.has_value()) {
+      target.constant = source.constant;
+      target.integral = source.integral;
+    }
+    _unions++;
+    return true;
+  }
+
+  /// restores the invariants after merges: equal nodes in different classes are merged and every node is canonical
+  void rebuild() {
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pending;
+    do {
+      for (const auto& [a, b] : pending) {
+        merge(a, b);
+      }
+      pending.clear();
+      _memo.clear();
+      for (std::uint32_t id = 0; id < _classes.size(); ++id) {
+        if (find(id) != id) {
+          continue;
+        }
+        for (const ENode& node : _classes[id].nodes) {
+          auto [it, inserted] = _memo.try_emplace(canonical(node), id);
+          if (!inserted && find(it->second) != id) {
+            pending.emplace_back(it->second, id);
+          }
+        }
+      }
+    } while (!pending.empty());
+    for (auto& eclass : _classes) {
+      eclass.nodes.clear();
+    }
+    for (const auto& [node, id] : _memo) {
+      _classes[find(id)].nodes.push_back(node);
+    }
+  }
+
+  [[nodiscard]] ENode canonical(ENode node) {
+    if (!is_leaf(node.type)) {
+      node.lhs = find(node.lhs);
+      node.rhs = find(node.rhs);
+    }
+    return node;
+  }
+
+  /// copy of the nodes of a class, stays valid while nodes are added
+  [[nodiscard]] std::vector<ENode> nodes(std::uint32_t id) { return _classes[find(id)].nodes; }
+
+  [[nodiscard]] std::optional<double> constant_value(std::uint32_t id) { return _classes[find(id)].constant; }
+
+  [[nodiscard]] bool is_constant(std::uint32_t id, double value) {
+    auto constant = constant_value(id);
+    return constant.has_value() && constant.value() == value;
+  }
+
+  /// value and integrality of node if all its operands are constant
+  [[nodiscard]] std::optional<std::pair<double, bool>> fold(const ENode& node) {
+    const EClass& lhs = _classes[find(node.lhs)];
+    const EClass& rhs = _classes[find(node.rhs)];
+    if (!lhs.constant.has_value() || !rhs.constant.has_value()) {
+      return std::nullopt;
+    }
+    const double value = apply(node.type, *lhs.constant, *rhs.constant);
+    if (!std::isfinite(value)) {
+      return std::nullopt;
+    }
+    return std::pair {value, lhs.integral && rhs.integral && is_integral(value)};
+  }
+
+  [[nodiscard]] std::size_t size() const { return _memo.size(); }
+  [[nodiscard]] std::size_t classes() const { return _classes.size(); }
+  [[nodiscard]] std::size_t unions() const { return _unions; }
+
+ private:
+  std::vector<EClass> _classes;
+  std::vector<std::uint32_t> _parents;
+  std::unordered_map<ENode, std::uint32_t, ENodeHash> _memo;
+  std::size_t _unions {0};
+};
+
+/// applies all rewrite rules to node, a member of the class id
+void rewrite(EGraph& graph, std::uint32_t id, const ENode& node) {
+  const std::uint32_t a = node.lhs;
+  const std::uint32_t b = node.rhs;
+  auto one = [&graph]() { return graph.constant(1, true); };
+
+  if (is_leaf(node.type)) {
+    return;
+  }
+  if (auto folded = graph.fold(node); folded.has_value()) {
+    graph.merge(id, graph.constant(folded->first, folded->second));
+    return;
+  }
+
+  switch (node.type) {
+    case Node_TP::ADD:
+    case Node_TP::MUL: {
+      // commutativity and associativity: (a . c) . b = a . (c . b)
+      graph.merge(id, graph.add(node.type, b, a));
+      for (const ENode& left : graph.nodes(a)) {
+        if (left.type == node.type) {
+          graph.merge(id, graph.add(node.type, left.lhs, graph.add(node.type, left.rhs, b)));
+        }
+      }
+      const double identity = node.type == Node_TP::ADD ? 0 : 1;
+      if (graph.is_constant(b, identity)) {
+        graph.merge(id, a);
+      }
+      if (node.type == Node_TP::MUL && graph.is_constant(b, 0)) {
+        graph.merge(id, b);
+      }
+      if (node.type == Node_TP::MUL) {
+        // x * x = x^2, x * x^k = x^(k + 1), x^j * x^k = x^(j + k) for integers j, k of the same sign: otherwise the
+        // product can be NaN where the power is not, e.g. x^0.5 * x^0.5 for x < 0 or x^-1 * x^2 for x = 0
+        auto power = [&graph](std::uint32_t operand) {
+          for (const ENode& n : graph.nodes(operand)) {
+            if (n.type == Node_TP::POW) {
+              if (auto k = graph.constant_value(n.rhs); k.has_value()) {
+                return std::pair {graph.find(n.lhs), *k};
+              }
+            }
+          }
+          return std::pair {graph.find(operand), 1.0};
+        };
+        auto lhs = power(a);
+        auto rhs = power(b);
+        const double k = lhs.second + rhs.second;
+        if (lhs.first == rhs.first && is_integral(lhs.second) && is_integral(rhs.second) &&
+            lhs.second * rhs.second > 0 && std::abs(k) <= MAX_EXPANDED_EXPONENT) {
+          graph.merge(id, graph.add(Node_TP::POW, lhs.first, graph.constant(k, is_integral(k))));
+        }
+      }
+      if (node.type == Node_TP::ADD && graph.find(a) == graph.find(b)) {
+        graph.merge(id, graph.add(Node_TP::MUL, graph.constant(2, true), a));
+      }
+      break;
+    }
+    case Node_TP::SUB:
+      if (graph.is_constant(b, 0)) {
+        graph.merge(id, a);
+      }
+      if (graph.find(a) == graph.find(b)) {
+        graph.merge(id, graph.constant(0, true));
+      }
+      break;
+    case Node_TP::DIV:
+      if (graph.is_constant(b, 1)) {
+        graph.merge(id, a);
+      }
+      break;
+    case Node_TP::POW: {
+      const auto k = graph.constant_value(b);
+      if (!k.has_value() || !is_integral(*k) || std::abs(*k) > MAX_EXPANDED_EXPONENT) {
+        break;
+      }
+      if (*k == 0) {
+        graph.merge(id, one());
+      } else if (*k == 1) {
+        graph.merge(id, a);
+      } else if (*k < 0) {
+        graph.merge(id, graph.add(Node_TP::DIV, one(), graph.add(Node_TP::POW, a, graph.constant(-*k, true))));
+      } else {
+        // x^k = x^(k - 1) * x and, for even k, x^k = (x * x)^(k / 2)
+        graph.merge(id, graph.add(Node_TP::MUL, graph.add(Node_TP::POW, a, graph.constant(*k - 1, true)), a));
+        if (std::fmod(*k, 2) == 0) {
+          graph.merge(id, graph.add(Node_TP::POW, graph.add(Node_TP::MUL, a, a), graph.constant(*k / 2, true)));
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+
+  if (node.type == Node_TP::ADD || node.type == Node_TP::SUB) {
+    // factoring: x * p +- x * q = x * (p +- q), x +- x * q = x * (1 +- q) and x * p +- x = x * (p +- 1)
+    const auto lhs = graph.nodes(a);
+    const auto rhs = graph.nodes(b);
+    for (const ENode& left : lhs) {
+      if (left.type != Node_TP::MUL) {
+        continue;
+      }
+      if (graph.find(left.lhs) == graph.find(b)) {
+        graph.merge(id, graph.add(Node_TP::MUL, b, graph.add(node.type, left.rhs, one())));
+      }
+      for (const ENode& right : rhs) {
+        if (right.type == Node_TP::MUL && graph.find(left.lhs) == graph.find(right.lhs)) {
+          graph.merge(id, graph.add(Node_TP::MUL, left.lhs, graph.add(node.type, left.rhs, right.rhs)));
+        }
+      }
+    }
+    for (const ENode& right : rhs) {
+      if (right.type == Node_TP::MUL && graph.find(right.lhs) == graph.find(a)) {
+        graph.merge(id, graph.add(Node_TP::MUL, a, graph.add(node.type, one(), right.rhs)));
+      }
+    }
+  }
+}
+
+/// extracts the cheapest term of the class root
+FlatExpression extract(EGraph& graph, std::uint32_t root, const std::vector<std::string>& symbols,
+                       const CostModel& costs) {
+  constexpr double INF = std::numeric_limits<double>::infinity();
+  std::vector<double> best(graph.classes(), INF);
+  std::vector<ENode> choice(graph.classes());
+  // relax until no cost improves, costs only decrease so this terminates
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (std::uint32_t id = 0; id < graph.classes(); ++id) {
+      if (graph.find(id) != id) {
+        continue;
+      }
+      for (const ENode& node : graph.nodes(id)) {
+        double cost = costs(node.type);
+        if (!is_leaf(node.type)) {
+          // an operand used twice (x * x) is evaluated once
+          const std::uint32_t lhs = graph.find(node.lhs);
+          const std::uint32_t rhs = graph.find(node.rhs);
+          cost += best[lhs] + (lhs == rhs ? 0 : best[rhs]);
+        }
+        if (cost < best[id]) {
+          best[id] = cost;
+          choice[id] = node;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  FlatExpression result;
+  for (const auto& symbol : symbols) {
+    result.intern(symbol);
+  }
+  constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+  std::vector<std::uint32_t> index(graph.classes(), NONE);
+  std::vector<std::uint32_t> stack {graph.find(root)};
+  while (!stack.empty()) {
+    const std::uint32_t id = stack.back();
+    if (index[id] != NONE) {
+      stack.pop_back();
+      continue;
+    }
+    const ENode& node = choice[id];
+    if (node.type == Node_TP::CONSTANT) {
+      index[id] = result.emplace_constant(node.value, node.lhs != 0);
+    } else if (node.type == Node_TP::VARIABLE) {
+      index[id] = result.emplace_variable(node.lhs);
+    } else {
+      const std::uint32_t lhs = graph.find(node.lhs);
+      const std::uint32_t rhs = graph.find(node.rhs);
+      if (index[lhs] == NONE || index[rhs] == NONE) {
+        // the chosen operands are strictly cheaper than their user, so this never cycles
+        stack.push_back(lhs);
+        stack.push_back(rhs);
+        continue;
+      }
+      index[id] = result.emplace(node.type, index[lhs], index[rhs]);
+    }
+    stack.pop_back();
+  }
+  result.set_root(index[graph.find(root)]);
+  return result;
+}
+
+}  // namespace
+
+double CostModel::operator()(Node_TP type) const {
+  switch (type) {
+    case Node_TP::CONSTANT:
+      return constant;
+    case Node_TP::VARIABLE:
+      return variable;
+    case Node_TP::ADD:
+    case Node_TP::SUM:
+      return add;
+    case Node_TP::SUB:
+      return sub;
+    case Node_TP::MUL:
+    case Node_TP::PRODUCT:
+      return mul;
+    case Node_TP::DIV:
+      return div;
+    case Node_TP::POW:
+      return pow;
+  }
+  return 0;
+}
+
+double cost(const FlatExpression& flat, const CostModel& costs) {
+  if (flat.nodes().empty()) {
+    return 0;
+  }
+  // only nodes reachable from the root are evaluated
+  std::vector<bool> used(flat.size());
+  used[flat.root()] = true;
+  double result = 0;
+  for (std::uint32_t i = flat.root() + 1; i-- > 0;) {
+    if (!used[i]) {
+      continue;
+    }
+    const Node& node = flat.nodes()[i];
+    const bool nary = node.type == Node_TP::SUM || node.type == Node_TP::PRODUCT;
+    result += costs(node.type) * (nary ? node.rhs - 1 : 1);
+    flat.for_each_operand(node, [&used](std::uint32_t operand) { used[operand] = true; });
+  }
+  return result;
+}
+
+Optimization optimize(const FlatExpression& flat, const OptimizerOptions& options) {
+  const auto start = std::chrono::steady_clock::now();
+  const CostModel& c = options.costs;
+  for (const double entry : {c.constant, c.variable, c.add, c.sub, c.mul, c.div, c.pow}) {
+    // extraction relies on every node adding to the cost of its operands, otherwise cycles look free
+    if (!(entry > 0)) {
+      throw std::invalid_argument("optimize: every cost must be positive");
+    }
+  }
+  const double cost_before = cost(flat, options.costs);
+  if (flat.nodes().empty()) {
+    return {flat, 0, 0, 0, 0, true};
+  }
+
+  EGraph graph;
+  std::vector<std::uint32_t> classes(flat.size());
+  for (std::uint32_t i = 0; i < flat.size(); ++i) {
+    const Node& node = flat.nodes()[i];
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        classes[i] = graph.constant(flat.constants()[node.lhs], node.rhs != 0);
+        break;
+      case Node_TP::VARIABLE:
+        classes[i] = graph.add({Node_TP::VARIABLE, node.lhs, 0, 0});
+        break;
+      case Node_TP::SUM:
+      case Node_TP::PRODUCT: {
+        // n-ary nodes enter the e-graph as chains of binary nodes, associativity finds the best grouping
+        const Node_TP type = node.type == Node_TP::SUM ? Node_TP::ADD : Node_TP::MUL;
+        const auto operands = flat.nary_operands(node);
+        classes[i] = classes[operands[0]];
+        for (std::size_t k = 1; k < operands.size(); ++k) {
+          classes[i] = graph.add(type, classes[i], classes[operands[k]]);
+        }
+        break;
+      }
+      default:
+        classes[i] = graph.add(node.type, classes[node.lhs], classes[node.rhs]);
+        break;
+    }
+  }
+  graph.rebuild();
+
+  auto exhausted = [&]() {
+    return graph.size() >= options.max_nodes || std::chrono::steady_clock::now() - start >= options.max_time;
+  };
+  bool saturated = false;
+  std::size_t iterations = 0;
+  while (iterations < options.max_iterations && !exhausted()) {
+    const std::size_t nodes_before = graph.size();
+    const std::size_t unions_before = graph.unions();
+    const std::size_t classes_before = graph.classes();
+    iterations++;
+    for (std::uint32_t id = 0; id < classes_before && !exhausted(); ++id) {
+      // a constant class is represented by its constant, rewriting its other members only grows the graph
+      if (graph.find(id) != id || graph.constant_value(id).has_value()) {
+        continue;
+      }
+      for (const ENode& node : graph.nodes(id)) {
+        rewrite(graph, id, node);
+      }
+    }
+    graph.rebuild();
+    if (graph.size() == nodes_before && graph.unions() == unions_before) {
+      saturated = true;
+      break;
+    }
+  }
+
+  FlatExpression result = extract(graph, classes[flat.root()], flat.symbols(), options.costs);
+  const double cost_after = cost(result, options.costs);
+  if (cost_after > cost_before) {
+    // extraction minimizes the cost of the term as a tree, which can lose sharing of the input
+    return {flat, cost_before, cost_before, iterations, graph.size(), saturated};
+  }
+  return {std::move(result), cost_before, cost_after, iterations, graph.size(), saturated};
+}
+
+Optimization optimize(const Term_I& term, const OptimizerOptions& options) { return optimize(flatten(term), options); }
+
+}  // namespace fsd
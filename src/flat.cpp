@@ -0,0 +1,398 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/constant.h>
+#include <fsd/flat.h>
+#include <fsd/operations.h>
+#include <fsd/variable.h>
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fsd {
+
+namespace {
+
+// marks a derivative that is identically zero, no node is emitted for it
+constexpr std::uint32_t ZERO = std::numeric_limits<std::uint32_t>::max();
+
+}  // namespace
+
+FlatExpression FlatExpression::derivative(std::string_view var) const {
+  if (auto symbol = symbol_id(var); symbol.has_value()) {
+    return derivative(symbol.value());
+  }
+  FlatExpression result;
+  result._symbols = _symbols;
+  result.set_root(result.emplace_constant(0, true));
+  return result;
+}
+
+FlatExpression FlatExpression::derivative(std::uint32_t symbol) const {
+  // the derivative is appended to a copy of this expression, so the primal nodes keep their indices
+  FlatExpression result = *this;
+  std::vector<std::uint32_t> d(_nodes.size(), ZERO);
+  std::uint32_t one = ZERO;
+  std::vector<std::uint32_t> terms;
+
+  auto get_one = [&]() {
+    if (one == ZERO) {
+      one = result.emplace_constant(1, true);
+    }
+    return one;
+  };
+  auto add = [&](std::uint32_t lhs, std::uint32_t rhs) {
+    if (lhs == ZERO) {
+      return rhs;
+    }
+    if (rhs == ZERO) {
+      return lhs;
+    }
+    return result.emplace(Node_TP::ADD, lhs, rhs);
+  };
+  auto sub = [&](std::uint32_t lhs, std::uint32_t rhs) {
+    if (rhs == ZERO) {
+      return lhs;
+    }
+    if (lhs == ZERO) {
+      return result.emplace(Node_TP::SUB, result.emplace_constant(0, true), rhs);
+    }
+    return result.emplace(Node_TP::SUB, lhs, rhs);
+  };
+  auto mul = [&](std::uint32_t lhs, std::uint32_t rhs) {
+    if (lhs == ZERO || rhs == ZERO) {
+      return ZERO;
+    }
+    if (lhs == one) {
+      return rhs;
+    }
+    if (rhs == one) {
+      return lhs;
+    }
+    return result.emplace(Node_TP::MUL, lhs, rhs);
+  };
+
+  for (std::uint32_t i = 0; i < _nodes.size(); ++i) {
+    const Node& node = _nodes[i];
+    const std::uint32_t a = node.lhs;
+    const std::uint32_t b = node.rhs;
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        break;
+      case Node_TP::VARIABLE:
+        if (node.lhs == symbol) {
+          d[i] = get_one();
+        }
+        break;
+      case Node_TP::ADD:
+        d[i] = add(d[a], d[b]);
+        break;
+      case Node_TP::SUB:
+        d[i] = sub(d[a], d[b]);
+        break;
+      case Node_TP::MUL:
+        d[i] = add(mul(d[a], b), mul(a, d[b]));
+        break;
+      case Node_TP::DIV:
+        if (d[b] == ZERO) {
+          d[i] = d[a] == ZERO ? ZERO : result.emplace(Node_TP::DIV, d[a], b);
+        } else {
+          d[i] = result.emplace(Node_TP::DIV, sub(mul(d[a], b), mul(a, d[b])), result.emplace(Node_TP::MUL, b, b));
+        }
+        break;
+      case Node_TP::POW: {
+        if (d[b] != ZERO) {
+          throw std::runtime_error("derivative of a power with a non constant exponent is not supported");
+        }
+        if (d[a] == ZERO) {
+          break;
+        }
+        std::uint32_t exponent;
+        if (const Node& e = _nodes[b]; e.type == Node_TP::CONSTANT) {
+          exponent = result.emplace_constant(_constants[e.lhs] - 1, e.rhs != 0);
+        } else {
+          exponent = result.emplace(Node_TP::SUB, b, get_one());
+        }
+        d[i] = mul(result.emplace(Node_TP::MUL, b, result.emplace(Node_TP::POW, a, exponent)), d[a]);
+        break;
+      }
+      case Node_TP::SUM: {
+        terms.clear();
+        for (std::uint32_t operand : nary_operands(node)) {
+          if (d[operand] != ZERO) {
+            terms.push_back(d[operand]);
+          }
+        }
+        if (terms.size() == 1) {
+          d[i] = terms.front();
+        } else if (!terms.empty()) {
+          d[i] = result.emplace_nary(Node_TP::SUM, terms);
+        }
+        break;
+      }
+      case Node_TP::PRODUCT: {
+        // product rule with shared prefix and suffix products of the operands, linear in the number of operands
+        const auto operands = nary_operands(node);
+        const std::size_t n = operands.size();
+        std::vector<std::uint32_t> prefix(n + 1, ZERO);
+        std::vector<std::uint32_t> suffix(n + 1, ZERO);
+        auto times = [&](std::uint32_t lhs, std::uint32_t rhs) {
+          return lhs == ZERO ? rhs : rhs == ZERO ? lhs : result.emplace(Node_TP::MUL, lhs, rhs);
+        };
+        std::size_t first = n;
+        std::size_t last = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+          if (d[operands[k]] != ZERO) {
+            first = std::min(first, k);
+            last = k;
+          }
+        }
+        if (first == n) {
+          break;
+        }
+        // only the prefixes up to the last and the suffixes down to the first dependent operand are ever used
+        for (std::size_t k = 1; k <= last; ++k) {
+          prefix[k] = times(prefix[k - 1], operands[k - 1]);
+        }
+        for (std::size_t k = n - 1; k > first; --k) {
+          suffix[k] = times(operands[k], suffix[k + 1]);
+        }
+        terms.clear();
+        for (std::size_t k = first; k <= last; ++k) {
+          if (d[operands[k]] != ZERO) {
+            const std::uint32_t others = times(prefix[k], suffix[k + 1]);
+            terms.push_back(others == ZERO ? d[operands[k]] : mul(others, d[operands[k]]));
+          }
+        }
+        d[i] = terms.size() == 1 ? terms.front() : result.emplace_nary(Node_TP::SUM, terms);
+        break;
+      }
+    }
+  }
+  result.set_root(d[_root] == ZERO ? result.emplace_constant(0, true) : d[_root]);
+  result.prune();
+  return result;
+}
+
+template double FlatExpression::evaluate<double>(const std::map<std::string, double>&) const;
+template double FlatExpression::evaluate<double>(std::span<const double>) const;
+template double FlatExpression::evaluate<double>(std::span<const double>, std::span<double>) const;
+template void FlatExpression::evaluate<double>(std::span<const double* const>, std::span<double>) const;
+
+std::string FlatExpression::to_str() const {
+  std::vector<std::string> strings(_nodes.size());
+  for (std::uint32_t i = 0; i < _nodes.size(); ++i) {
+    const Node& node = _nodes[i];
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        strings[i] = node.rhs != 0 ? std::to_string(static_cast<long long>(_constants[node.lhs]))
+                                   : std::to_string(_constants[node.lhs]);
+        break;
+      case Node_TP::VARIABLE:
+        strings[i] = _symbols[node.lhs];
+        break;
+      case Node_TP::ADD:
+        strings[i] = std::format("({} + {})", strings[node.lhs], strings[node.rhs]);
+        break;
+      case Node_TP::SUB:
+        strings[i] = std::format("({} - {})", strings[node.lhs], strings[node.rhs]);
+        break;
+      case Node_TP::MUL:
+        strings[i] = std::format("({} * {})", strings[node.lhs], strings[node.rhs]);
+        break;
+      case Node_TP::DIV:
+        strings[i] = std::format("({} / {})", strings[node.lhs], strings[node.rhs]);
+        break;
+      case Node_TP::POW:
+        strings[i] = std::format("{}^({})", strings[node.lhs], strings[node.rhs]);
+        break;
+      case Node_TP::SUM:
+      case Node_TP::PRODUCT: {
+        const auto operands = nary_operands(node);
+        std::string& out = strings[i];
+        out = "(" + strings[operands[0]];
+        for (std::size_t k = 1; k < operands.size(); ++k) {
+          out += node.type == Node_TP::SUM ? " + " : " * ";
+          out += strings[operands[k]];
+        }
+        out += ")";
+        break;
+      }
+    }
+  }
+  return strings[_root];
+}
+
+Expression FlatExpression::to_expression() const {
+  std::vector<Expression> terms(_nodes.size());
+  for (std::uint32_t i = 0; i < _nodes.size(); ++i) {
+    const Node& node = _nodes[i];
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        if (node.rhs != 0) {
+          terms[i] = constant(static_cast<int>(_constants[node.lhs]));
+        } else {
+          terms[i] = constant(_constants[node.lhs]);
+        }
+        break;
+      case Node_TP::VARIABLE:
+        terms[i] = variable(_symbols[node.lhs]);
+        break;
+      case Node_TP::ADD:
+        terms[i] = terms[node.lhs] + terms[node.rhs];
+        break;
+      case Node_TP::SUB:
+        terms[i] = terms[node.lhs] - terms[node.rhs];
+        break;
+      case Node_TP::MUL:
+        terms[i] = terms[node.lhs] * terms[node.rhs];
+        break;
+      case Node_TP::DIV:
+        terms[i] = terms[node.lhs] / terms[node.rhs];
+        break;
+      case Node_TP::POW:
+        terms[i] = fsd::pow(terms[node.lhs], terms[node.rhs]);
+        break;
+      case Node_TP::SUM:
+      case Node_TP::PRODUCT: {
+        std::vector<Expression> operands;
+        operands.reserve(node.rhs);
+        for (std::uint32_t operand : nary_operands(node)) {
+          operands.push_back(terms[operand]);
+        }
+        terms[i] = node.type == Node_TP::SUM ? sum(std::move(operands)) : product(std::move(operands));
+        break;
+      }
+    }
+  }
+  return terms[_root];
+}
+
+std::uint32_t FlatExpression::intern(std::string_view name) {
+  if (auto symbol = symbol_id(name); symbol.has_value()) {
+    return symbol.value();
+  }
+  _symbols.emplace_back(name);
+  return static_cast<std::uint32_t>(_symbols.size() - 1);
+}
+
+std::uint32_t FlatExpression::emplace_constant(double value, bool integral) {
+  _constants.push_back(value);
+  return emplace(Node_TP::CONSTANT, static_cast<std::uint32_t>(_constants.size() - 1), integral ? 1 : 0);
+}
+
+std::uint32_t FlatExpression::emplace_variable(std::uint32_t symbol) { return emplace(Node_TP::VARIABLE, symbol, 0); }
+
+std::uint32_t FlatExpression::emplace(Node_TP type, std::uint32_t lhs, std::uint32_t rhs) {
+  _nodes.push_back({type, lhs, rhs});
+  _root = static_cast<std::uint32_t>(_nodes.size() - 1);
+  return _root;
+}
+
+std::uint32_t FlatExpression::emplace_nary(Node_TP type, std::span<const std::uint32_t> operands) {
+  if ((type != Node_TP::SUM && type != Node_TP::PRODUCT) || operands.empty()) {
+    throw std::invalid_argument("n-ary nodes are non empty sums or products");
+  }
+  const auto offset = static_cast<std::uint32_t>(_operands.size());
+  _operands.insert(_operands.end(), operands.begin(), operands.end());
+  return emplace(type, offset, static_cast<std::uint32_t>(operands.size()));
+}
+
+void FlatExpression::set_root(std::uint32_t root) { _root = root; }
+
+std::optional<std::uint32_t> FlatExpression::symbol_id(std::string_view name) const {
+  for (std::uint32_t i = 0; i < _symbols.size(); ++i) {
+    if (_symbols[i] == name) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+void FlatExpression::check_bound(const std::vector<bool>& present) const {
+  for (const Node& node : _nodes) {
+    if (node.type == Node_TP::VARIABLE && !present[node.lhs]) {
+      throw std::runtime_error("no value for variable " + _symbols[node.lhs]);
+    }
+  }
+}
+
+void FlatExpression::prune() {
+  if (_nodes.empty()) {
+    return;
+  }
+  std::vector<bool> used(_nodes.size());
+  used[_root] = true;
+  for (std::uint32_t i = _root + 1; i-- > 0;) {
+    if (used[i]) {
+      for_each_operand(_nodes[i], [&used](std::uint32_t operand) { used[operand] = true; });
+    }
+  }
+  std::vector<std::uint32_t> index(_nodes.size());
+  std::vector<Node> nodes;
+  std::vector<double> constants;
+  std::vector<std::uint32_t> operands;
+  for (std::uint32_t i = 0; i <= _root; ++i) {
+    if (!used[i]) {
+      continue;
+    }
+    Node node = _nodes[i];
+    if (node.type == Node_TP::CONSTANT) {
+      constants.push_back(_constants[node.lhs]);
+      node.lhs = static_cast<std::uint32_t>(constants.size() - 1);
+    } else if (node.type == Node_TP::SUM || node.type == Node_TP::PRODUCT) {
+      const auto offset = static_cast<std::uint32_t>(operands.size());
+      for (std::uint32_t operand : nary_operands(node)) {
+        operands.push_back(index[operand]);
+      }
+      node.lhs = offset;
+    } else if (node.type != Node_TP::VARIABLE) {
+      node.lhs = index[node.lhs];
+      node.rhs = index[node.rhs];
+    }
+    index[i] = static_cast<std::uint32_t>(nodes.size());
+    nodes.push_back(node);
+  }
+  _root = index[_root];
+  _nodes = std::move(nodes);
+  _constants = std::move(constants);
+  _operands = std::move(operands);
+}
+
+FlatExpression flatten(const Term_I& term) {
+  struct Frame {
+    const Term_I* term;
+    std::size_t next;
+  };
+
+  FlatExpression flat;
+  std::unordered_map<const Term_I*, std::uint32_t> indices;
+  std::vector<Frame> stack {{&term, 0}};
+  std::vector<std::uint32_t> operand_indices;
+  while (!stack.empty()) {
+    Frame& frame = stack.back();
+    const auto operands = frame.term->operands();
+    if (frame.next < operands.size()) {
+      const Term_I* operand = operands[frame.next++].get();
+      if (!indices.contains(operand)) {
+        stack.push_back({operand, 0});
+      }
+      continue;
+    }
+    operand_indices.clear();
+    for (const auto& operand : operands) {
+      operand_indices.push_back(indices.at(operand.get()));
+    }
+    indices.emplace(frame.term, frame.term->flatten_into(flat, operand_indices));
+    stack.pop_back();
+  }
+  flat.set_root(indices.at(&term));
+  return flat;
+}
+
+}  // namespace fsd
@@ -0,0 +1,327 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/interval.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <numbers>
+#include <optional>
+#include <stdexcept>
+
+namespace fsd {
+
+namespace {
+
+constexpr double INF = std::numeric_limits<double>::infinity();
+constexpr double TWO_PI = 2 * std::numbers::pi;
+
+// beyond this magnitude the period of the trigonometric functions is not resolved by doubles anymore
+constexpr double MAX_TRIGONOMETRIC_ARGUMENT = 1e15;
+
+double down(double value, int ulps = 1) {
+  for (int i = 0; i < ulps; ++i) {
+    value = std::nextafter(value, -INF);
+  }
+  return value;
+}
+
+double up(double value, int ulps = 1) {
+  for (int i = 0; i < ulps; ++i) {
+    value = std::nextafter(value, INF);
+  }
+  return value;
+}
+
+/// interval from bounds computed in round to nearest, widened by ulps
+Interval outward(double lower, double upper, int ulps) {
+  if (std::isnan(lower) || std::isnan(upper)) {
+    return Interval::entire();
+  }
+  return {down(lower, ulps), up(upper, ulps)};
+}
+
+/// interval spanning four corner values, as of pow()
+Interval hull(double a, double b, double c, double d, int ulps) {
+  if (std::isnan(a) || std::isnan(b) || std::isnan(c) || std::isnan(d)) {
+    return Interval::entire();
+  }
+  return outward(std::min({a, b, c, d}), std::max({a, b, c, d}), ulps);
+}
+
+// below this magnitude the error terms of products and quotients may be inexact because of gradual underflow
+constexpr double MIN_EXACT_ERROR = 0x1p-969;
+
+/// A result rounded to nearest together with the sign of its rounding error, the exact value is value + error.
+struct Rounded {
+  double value;
+  double error;
+
+  /// the exact value rounded towards -inf, a step to the next double if the error is unknown (NaN)
+  [[nodiscard]] double down() const {
+    if (!std::isfinite(value) || std::isnan(error)) {
+      return fsd::down(value);
+    }
+    return error < 0 ? fsd::down(value) : value;
+  }
+
+  /// the exact value rounded towards +inf
+  [[nodiscard]] double up() const {
+    if (!std::isfinite(value) || std::isnan(error)) {
+      return fsd::up(value);
+    }
+    return error > 0 ? fsd::up(value) : value;
+  }
+};
+
+constexpr double UNKNOWN = std::numeric_limits<double>::quiet_NaN();
+
+/// error free transformation (TwoSum): the error of a + b is exactly representable
+Rounded sum(double a, double b) {
+  const double s = a + b;
+  const double bb = s - a;
+  return {s, (a - (s - bb)) + (b - bb)};
+}
+
+/// a * b with 0 * inf = 0: a zero bound means the value 0 is attained, infinite bounds are only approached
+Rounded product(double a, double b) {
+  if (a == 0 || b == 0) {
+    return {0, 0};
+  }
+  const double p = a * b;
+  return {p, std::abs(p) < MIN_EXACT_ERROR ? UNKNOWN : std::fma(a, b, -p)};
+}
+
+Rounded quotient(double a, double b) {
+  if (a == 0) {
+    return {0, 0};
+  }
+  const double q = a / b;
+  if (std::isnan(q)) {
+    return {q, UNKNOWN};
+  }
+  if (std::abs(q) < MIN_EXACT_ERROR || !std::isfinite(b)) {
+    return {q, UNKNOWN};
+  }
+  // a / b = q + r / b with the exact remainder r
+  const double r = std::fma(-q, b, a);
+  return {q, b > 0 ? r : -r};
+}
+
+/// interval spanning the four corner results of multiplication or division
+Interval hull(const Rounded& a, const Rounded& b, const Rounded& c, const Rounded& d) {
+  if (std::isnan(a.value) || std::isnan(b.value) || std::isnan(c.value) || std::isnan(d.value)) {
+    return Interval::entire();
+  }
+  return {std::min({a.down(), b.down(), c.down(), d.down()}), std::max({a.up(), b.up(), c.up(), d.up()})};
+}
+
+/// true if phase + k * period lies in [lower, upper] for some integer k, in doubt true
+bool reaches(double lower, double upper, double phase, double period) {
+  const double slack = 1e-9 * std::max({1.0, std::abs(lower), std::abs(upper)});
+  const double k = std::ceil((lower - phase) / period);
+  for (double candidate : {phase + (k - 1) * period, phase + k * period}) {
+    if (lower - slack <= candidate && candidate <= upper + slack) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool is_bounded(const Interval& x) { return std::isfinite(x.lower()) && std::isfinite(x.upper()); }
+
+/// sin or cos: maximal at max_phase, minimal at max_phase + pi
+Interval periodic(const Interval& x, double (*f)(double), double max_phase) {
+  if (!is_bounded(x) || x.width() >= TWO_PI ||
+      std::max(std::abs(x.lower()), std::abs(x.upper())) > MAX_TRIGONOMETRIC_ARGUMENT) {
+    return {-1, 1};
+  }
+  const double a = f(x.lower());
+  const double b = f(x.upper());
+  double lower = down(std::min(a, b), Interval::LIBM_ULPS);
+  double upper = up(std::max(a, b), Interval::LIBM_ULPS);
+  if (reaches(x.lower(), x.upper(), max_phase, TWO_PI)) {
+    upper = 1;
+  }
+  if (reaches(x.lower(), x.upper(), max_phase + std::numbers::pi, TWO_PI)) {
+    lower = -1;
+  }
+  return {std::max(lower, -1.0), std::min(upper, 1.0)};
+}
+
+/// x intersected with [lower, upper], nullopt if they are disjoint
+std::optional<Interval> restrict(const Interval& x, double lower, double upper) {
+  if (x.upper() < lower || x.lower() > upper) {
+    return std::nullopt;
+  }
+  return Interval(std::max(x.lower(), lower), std::min(x.upper(), upper));
+}
+
+/// x^n for x >= 0 and integral n >= 1 by square and multiply, every step rounded down or up (exact powers stay exact)
+double power(double x, double n, bool upward) {
+  auto multiply = [upward](double a, double b) { return upward ? product(a, b).up() : product(a, b).down(); };
+  auto k = static_cast<std::uint32_t>(n);
+  double result = 1;
+  while (true) {
+    if ((k & 1U) != 0) {
+      result = multiply(result, x);
+    }
+    k >>= 1U;
+    if (k == 0) {
+      return result;
+    }
+    x = multiply(x, x);
+  }
+}
+
+/// bound of x^n for odd n, which is monotone
+double odd_power(double x, double n, bool upward) { return x >= 0 ? power(x, n, upward) : -power(-x, n, !upward); }
+
+bool is_integral(double value) {
+  return value == std::trunc(value) && std::abs(value) <= std::numeric_limits<int>::max();
+}
+
+}  // namespace
+
+Interval::Interval(double lower, double upper) : _lower(lower), _upper(upper) {
+  if (!(lower <= upper)) {
+    throw std::invalid_argument(std::format("invalid interval [{}, {}]", lower, upper));
+  }
+}
+
+Interval Interval::entire() { return {-INF, INF}; }
+
+double Interval::mid() const {
+  if (is_entire()) {
+    return 0;
+  }
+  if (std::isinf(_lower)) {
+    return std::numeric_limits<double>::lowest();
+  }
+  if (std::isinf(_upper)) {
+    return std::numeric_limits<double>::max();
+  }
+  // halving first cannot overflow
+  return _lower / 2 + _upper / 2;
+}
+
+bool Interval::is_entire() const { return _lower == -INF && _upper == INF; }
+
+std::string Interval::to_str() const { return std::format("[{}, {}]", _lower, _upper); }
+
+Interval operator-(const Interval& x) { return {-x.upper(), -x.lower()}; }
+
+Interval operator+(const Interval& lhs, const Interval& rhs) {
+  const double lower = sum(lhs.lower(), rhs.lower()).down();
+  const double upper = sum(lhs.upper(), rhs.upper()).up();
+  // inf + -inf
+  if (std::isnan(lower) || std::isnan(upper)) {
+    return Interval::entire();
+  }
+  return {lower, upper};
+}
+
+Interval operator-(const Interval& lhs, const Interval& rhs) { return lhs + -rhs; }
+
+Interval operator*(const Interval& lhs, const Interval& rhs) {
+  return hull(product(lhs.lower(), rhs.lower()), product(lhs.lower(), rhs.upper()), product(lhs.upper(), rhs.lower()),
+              product(lhs.upper(), rhs.upper()));
+}
+
+Interval operator/(const Interval& lhs, const Interval& rhs) {
+  if (rhs.contains(0)) {
+    return Interval::entire();
+  }
+  return hull(quotient(lhs.lower(), rhs.lower()), quotient(lhs.lower(), rhs.upper()),
+              quotient(lhs.upper(), rhs.lower()), quotient(lhs.upper(), rhs.upper()));
+}
+
+Interval pow(const Interval& base, const Interval& exponent) {
+  constexpr int ulps = Interval::LIBM_ULPS;
+  if (exponent.lower() == exponent.upper() && is_integral(exponent.lower())) {
+    const double n = exponent.lower();
+    if (n == 0) {
+      return 1;
+    }
+    if (n < 0) {
+      return Interval(1) / pow(base, -n);
+    }
+    if (std::fmod(n, 2) == 1) {
+      return {odd_power(base.lower(), n, false), odd_power(base.upper(), n, true)};
+    }
+    // even powers are symmetric, the minimum is at the point closest to 0
+    const double near = base.contains(0) ? 0 : std::min(std::abs(base.lower()), std::abs(base.upper()));
+    const double far = std::max(std::abs(base.lower()), std::abs(base.upper()));
+    return {power(near, n, false), power(far, n, true)};
+  }
+  // real exponents are only defined for non-negative bases, x^y is monotone in x and in y, so the bounds are corners
+  const auto domain = restrict(base, 0, INF);
+  if (!domain.has_value()) {
+    return Interval::entire();
+  }
+  const Interval result =
+      hull(std::pow(domain->lower(), exponent.lower()), std::pow(domain->lower(), exponent.upper()),
+           std::pow(domain->upper(), exponent.lower()), std::pow(domain->upper(), exponent.upper()), ulps);
+  return {std::max(0.0, result.lower()), result.upper()};
+}
+
+Interval exp(const Interval& x) {
+  constexpr int ulps = Interval::LIBM_ULPS;
+  return {std::max(0.0, down(std::exp(x.lower()), ulps)), up(std::exp(x.upper()), ulps)};
+}
+
+Interval sqrt(const Interval& x) {
+  const auto domain = restrict(x, 0, INF);
+  if (!domain.has_value()) {
+    return Interval::entire();
+  }
+  // sqrt(x) = s + r / (sqrt(x) + s) with the exact residual r = x - s^2
+  auto root = [](double x) -> Rounded {
+    const double s = std::sqrt(x);
+    return {s, std::isfinite(s) && s >= MIN_EXACT_ERROR ? std::fma(-s, s, x) : (s == 0 ? 0 : UNKNOWN)};
+  };
+  return {std::max(0.0, root(domain->lower()).down()), root(domain->upper()).up()};
+}
+
+Interval sin(const Interval& x) {
+  return periodic(x, static_cast<double (*)(double)>(std::sin), std::numbers::pi / 2);
+}
+
+Interval cos(const Interval& x) { return periodic(x, static_cast<double (*)(double)>(std::cos), 0); }
+
+Interval tan(const Interval& x) {
+  if (!is_bounded(x) || x.width() >= std::numbers::pi ||
+      std::max(std::abs(x.lower()), std::abs(x.upper())) > MAX_TRIGONOMETRIC_ARGUMENT ||
+      reaches(x.lower(), x.upper(), std::numbers::pi / 2, std::numbers::pi)) {
+    return Interval::entire();
+  }
+  return outward(std::tan(x.lower()), std::tan(x.upper()), Interval::LIBM_ULPS);
+}
+
+Interval asin(const Interval& x) {
+  const auto domain = restrict(x, -1, 1);
+  if (!domain.has_value()) {
+    return Interval::entire();
+  }
+  return outward(std::asin(domain->lower()), std::asin(domain->upper()), Interval::LIBM_ULPS);
+}
+
+Interval acos(const Interval& x) {
+  const auto domain = restrict(x, -1, 1);
+  if (!domain.has_value()) {
+    return Interval::entire();
+  }
+  // decreasing
+  const Interval result = outward(std::acos(domain->upper()), std::acos(domain->lower()), Interval::LIBM_ULPS);
+  return {std::max(0.0, result.lower()), result.upper()};
+}
+
+Interval atan(const Interval& x) {
+  return outward(std::atan(x.lower()), std::atan(x.upper()), Interval::LIBM_ULPS);
+}
+
+}  // namespace fsd
@@ -0,0 +1,196 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/lazy.h>
+#include <fsd/variable.h>
+
+#include <cmath>
+#include <set>
+#include <stdexcept>
+
+namespace fsd {
+
+namespace {
+
+const std::string& name(const Term_I& variable) { return static_cast<const Variable&>(variable).get_name(); }
+
+void check_exponent(bool var_occurs) {
+  if (var_occurs) {
+    throw std::runtime_error("derivative of a power with a non constant exponent is not supported");
+  }
+}
+
+/// value and derivative of a term, and whether var occurs in it
+struct Dual {
+  double value;
+  double derivative;
+  bool var;
+};
+
+Dual evaluate_dual(const Term_I& term, const std::string& var, const std::map<std::string, double>& values) {
+  return detail::fold<Dual>(term, [&var, &values](const Term_I& node, std::span<Dual> operands) -> Dual {
+    switch (node.node_type()) {
+      case Node_TP::CONSTANT:
+        return {node.evaluate(values), 0, false};
+      case Node_TP::VARIABLE: {
+        const bool is_var = name(node) == var;
+        return {node.evaluate(values), is_var ? 1.0 : 0.0, is_var};
+      }
+      case Node_TP::ADD:
+      case Node_TP::SUM: {
+        Dual result = operands[0];
+        for (std::size_t i = 1; i < operands.size(); ++i) {
+          result = {result.value + operands[i].value, result.derivative + operands[i].derivative,
+                    result.var || operands[i].var};
+        }
+        return result;
+      }
+      case Node_TP::SUB:
+        return {operands[0].value - operands[1].value, operands[0].derivative - operands[1].derivative,
+                operands[0].var || operands[1].var};
+      case Node_TP::MUL:
+      case Node_TP::PRODUCT: {
+        Dual result = operands[0];
+        for (std::size_t i = 1; i < operands.size(); ++i) {
+          const Dual& operand = operands[i];
+          result = {result.value * operand.value,
+                    result.derivative * operand.value + result.value * operand.derivative, result.var || operand.var};
+        }
+        return result;
+      }
+      case Node_TP::DIV: {
+        const Dual& lhs = operands[0];
+        const Dual& rhs = operands[1];
+        return {lhs.value / rhs.value,
+                (lhs.derivative * rhs.value - lhs.value * rhs.derivative) / (rhs.value * rhs.value),
+                lhs.var || rhs.var};
+      }
+      case Node_TP::POW: {
+        check_exponent(operands[1].var);
+        const Dual& base = operands[0];
+        const double exponent = operands[1].value;
+        // a base without var has the derivative 0 even where base^(exponent - 1) is not finite, like the derivative
+        // term
+        const double derivative =
+            base.derivative == 0 ? 0 : exponent * std::pow(base.value, exponent - 1) * base.derivative;
+        return {std::pow(base.value, exponent), derivative, base.var};
+      }
+    }
+    return {0, 0, false};
+  });
+}
+
+/**
+ * What a term contains: var, the target variable (any variable if target is null), and whether its derivative by var
+ * depends on the target. A term without var has the derivative 0, so its variables only matter as factors.
+ */
+struct Dependency {
+  bool var = false;
+  bool target = false;
+  bool derivative = false;
+};
+
+Dependency dependency(const Term_I& term, const std::string& var, const std::string_view* target) {
+  return detail::fold<Dependency>(term, [&var, target](const Term_I& node, std::span<Dependency> operands) {
+    switch (node.node_type()) {
+      case Node_TP::CONSTANT:
+        return Dependency {};
+      case Node_TP::VARIABLE:
+        return Dependency {name(node) == var, target == nullptr || name(node) == *target, false};
+      case Node_TP::ADD:
+      case Node_TP::SUB:
+      case Node_TP::SUM: {
+        Dependency result;
+        for (const auto& other : operands) {
+          result = {result.var || other.var, result.target || other.target, result.derivative || other.derivative};
+        }
+        return result;
+      }
+      case Node_TP::MUL:
+      case Node_TP::PRODUCT: {
+        // the product rule multiplies the derivative of every operand with var by all other operands, so the target is
+        // a factor if another operand than one with var contains it
+        Dependency result;
+        std::size_t targets = 0;
+        std::size_t with_var = 0;
+        std::size_t with_both = 0;
+        for (const auto& other : operands) {
+          targets += other.target ? 1 : 0;
+          with_var += other.var ? 1 : 0;
+          with_both += other.var && other.target ? 1 : 0;
+          result = {result.var || other.var, result.target || other.target,
+                    result.derivative || (other.var && other.derivative)};
+        }
+        result.derivative =
+            result.derivative || (with_var > with_both && targets > 0) || (with_both > 0 && targets > 1);
+        return result;
+      }
+      case Node_TP::DIV: {
+        const Dependency& lhs = operands[0];
+        const Dependency& rhs = operands[1];
+        // (lhs' * rhs - lhs * rhs') / rhs^2 contains both operands unless rhs is free of var
+        const bool derivative = rhs.var ? lhs.target || rhs.target : lhs.var && (lhs.derivative || rhs.target);
+        return Dependency {lhs.var || rhs.var, lhs.target || rhs.target, derivative};
+      }
+      case Node_TP::POW: {
+        const Dependency& base = operands[0];
+        const Dependency& exponent = operands[1];
+        check_exponent(exponent.var);
+        // exponent * base^(exponent - 1) * base'
+        return Dependency {base.var, base.target || exponent.target, base.var && (base.target || exponent.target)};
+      }
+    }
+    return Dependency {};
+  });
+}
+
+void collect_variables(const Term_I& term, std::set<std::string>& names) {
+  // shared subterms are visited once, the result is unused
+  detail::fold<char>(term, [&names](const Term_I& node, std::span<char>) {
+    if (node.node_type() == Node_TP::VARIABLE) {
+      names.insert(name(node));
+    }
+    return char {};
+  });
+}
+
+}  // namespace
+
+LazyDerivative::LazyDerivative(Expression source, std::string var) : _source(std::move(source)), _var(std::move(var)) {
+  if (_source == nullptr) {
+    throw std::invalid_argument("derivative of a null expression");
+  }
+}
+
+double LazyDerivative::evaluate(const std::map<std::string, double>& values) const {
+  return evaluate_dual(*_source, _var, values).derivative;
+}
+
+bool LazyDerivative::is_zero() const { return !occurs(*_source, _var); }
+
+bool LazyDerivative::is_constant() const { return !dependency(*_source, _var, nullptr).derivative; }
+
+bool LazyDerivative::depends_on(std::string_view name) const {
+  return dependency(*_source, _var, &name).derivative;
+}
+
+std::vector<std::string> LazyDerivative::variables() const {
+  std::set<std::string> names;
+  collect_variables(*_source, names);
+  std::vector<std::string> result;
+  for (const auto& name : names) {
+    if (depends_on(name)) {
+      result.push_back(name);
+    }
+  }
+  return result;
+}
+
+Expression LazyDerivative::materialize() const { return _source->derivative(_var); }
+
+std::string LazyDerivative::to_str() const { return materialize()->to_str(); }
+
+LazyDerivative LazyDerivative::derivative(std::string var) const { return {materialize(), std::move(var)}; }
+
+}  // namespace fsd
@@ -8,103 +8,398 @@
 
 #include <format>
 #include <cmath>
+#include <stdexcept>
+#include <variant>
+#include <vector>
 
 namespace fsd {
 
-template <>
-std::unique_ptr<Term_I> BinaryOp<BinaryOperation_TP::ADD>::derivative(const std::string& var) const {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::ADD>>(_lhs->derivative(var), _rhs->derivative(var));
+namespace {
+
+using enum BinaryOperation_TP;
+
+constexpr Node_TP to_node_type(BinaryOperation_TP type) {
+  switch (type) {
+    case ADD:
+      return Node_TP::ADD;
+    case SUB:
+      return Node_TP::SUB;
+    case MUL:
+      return Node_TP::MUL;
+    case DIV:
+      return Node_TP::DIV;
+    case POW:
+      return Node_TP::POW;
+  }
+  return Node_TP::ADD;
+}
+
+double evaluate_term(const Term_I& term, const std::map<std::string, double>& var) {
+  return detail::fold<double>(term, [&var](const Term_I& node, std::span<double> operands) {
+    switch (node.node_type()) {
+      case Node_TP::CONSTANT:
+      case Node_TP::VARIABLE:
+        return node.evaluate(var);
+      case Node_TP::ADD:
+        return operands[0] + operands[1];
+      case Node_TP::SUB:
+        return operands[0] - operands[1];
+      case Node_TP::MUL:
+        return operands[0] * operands[1];
+      case Node_TP::DIV:
+        return operands[0] / operands[1];
+      case Node_TP::POW:
+        return std::pow(operands[0], operands[1]);
+      case Node_TP::SUM: {
+        double result = operands[0];
+        for (std::size_t i = 1; i < operands.size(); ++i) {
+          result += operands[i];
+        }
+        return result;
+      }
+      case Node_TP::PRODUCT: {
+        double result = operands[0];
+        for (std::size_t i = 1; i < operands.size(); ++i) {
+          result *= operands[i];
+        }
+        return result;
+      }
+    }
+    return 0.0;
+  });
+}
+
+/**
+ * Nesting depth of the operator evaluate() and derivative() calls of this thread. Below MAX_FOLD_RECURSION they recurse
+ * with one virtual call per node, deeper operators are handed to fold(), which does not recurse further than that.
+ */
+thread_local std::size_t recursion_depth = 0;
+
+/**
+ * Evaluates the operand of an operator below the recursion bound. Unshared operands are evaluated by their own
+ * evaluate(), one virtual call per node like a plain recursive evaluation. Shared operators go through evaluate_term(),
+ * which evaluates their shared subterms once.
+ */
+double evaluate_operand(const Expression& operand, const std::map<std::string, double>& var) {
+  if (operand.use_count() > 1 && !operand->operands().empty()) {
+    return evaluate_term(*operand, var);
+  }
+  return operand->evaluate(var);
+}
+
+/// counts an operator evaluate() or derivative() call in recursion_depth while it is running
+class RecursionScope {
+ public:
+  RecursionScope() { ++recursion_depth; }
+  ~RecursionScope() { --recursion_depth; }
+  RecursionScope(const RecursionScope&) = delete;
+  RecursionScope& operator=(const RecursionScope&) = delete;
+};
+
+std::string term_to_str(const Term_I& term) {
+  // what is left to write, last piece first: terms to expand and text between them
+  std::vector<std::variant<const Term_I*, std::string_view>> pending {&term};
+  std::string result;
+  while (!pending.empty()) {
+    const auto piece = pending.back();
+    pending.pop_back();
+    if (const auto* text = std::get_if<std::string_view>(&piece)) {
+      result += *text;
+      continue;
+    }
+    const Term_I& node = *std::get<const Term_I*>(piece);
+    const auto operands = node.operands();
+    std::string_view separator;
+    switch (node.node_type()) {
+      case Node_TP::CONSTANT:
+      case Node_TP::VARIABLE:
+        result += node.to_str();
+        continue;
+      case Node_TP::POW:
+        pending.insert(pending.end(), {")", operands[1].get(), "^(", operands[0].get()});
+        continue;
+      case Node_TP::ADD:
+      case Node_TP::SUM:
+        separator = " + ";
+        break;
+      case Node_TP::SUB:
+        separator = " - ";
+        break;
+      case Node_TP::MUL:
+      case Node_TP::PRODUCT:
+        separator = " * ";
+        break;
+      case Node_TP::DIV:
+        separator = " / ";
+        break;
+    }
+    result += "(";
+    pending.emplace_back(")");
+    for (std::size_t i = operands.size(); i-- > 1;) {
+      pending.insert(pending.end(), {operands[i].get(), separator});
+    }
+    pending.emplace_back(operands[0].get());
+  }
+  return result;
+}
+
+/// derivative of a node and whether the variable occurs in it
+struct Derivative {
+  Expression term;
+  bool var;
+};
+
+/**
+ * Derivative of the product of factors, all of which contain the variable. The halves A and B are combined by
+ * d(A * B) = d(A) * B + A * d(B) with A and B as n-ary products, so the result has O(n log n) operands and depth
+ * O(log n), where prefix and suffix products need a chain of depth n.
+ */
+Expression product_derivative(std::span<const Expression> factors, std::span<Derivative> derivatives) {
+  if (factors.size() == 1) {
+    return std::move(derivatives[0].term);
+  }
+  const std::size_t middle = factors.size() / 2;
+  Expression left = product_derivative(factors.first(middle), derivatives.first(middle));
+  Expression right = product_derivative(factors.subspan(middle), derivatives.subspan(middle));
+  std::vector<Expression> lhs {std::move(left)};
+  lhs.insert(lhs.end(), factors.begin() + static_cast<std::ptrdiff_t>(middle), factors.end());
+  std::vector<Expression> rhs(factors.begin(), factors.begin() + static_cast<std::ptrdiff_t>(middle));
+  rhs.push_back(std::move(right));
+  return product(std::move(lhs)) + product(std::move(rhs));
 }
 
-template <>
-std::unique_ptr<Term_I> BinaryOp<BinaryOperation_TP::SUB>::derivative(const std::string& var) const {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::SUB>>(_lhs->derivative(var), _rhs->derivative(var));
+/// derivative of lhs + rhs, lhs - rhs, lhs * rhs or lhs / rhs from the derivatives d_lhs and d_rhs of the operands
+template <BinaryOperation_TP T>
+Expression binary_derivative(const Expression& lhs, const Expression& rhs, Expression d_lhs, Expression d_rhs) {
+  switch (T) {
+    case ADD:
+      return std::make_shared<BinaryOp<ADD>>(std::move(d_lhs), std::move(d_rhs));
+    case SUB:
+      return std::make_shared<BinaryOp<SUB>>(std::move(d_lhs), std::move(d_rhs));
+    case MUL:
+      return std::make_shared<BinaryOp<ADD>>(
+        std::make_shared<BinaryOp<MUL>>(std::move(d_lhs), rhs),
+        std::make_shared<BinaryOp<MUL>>(lhs, std::move(d_rhs))
+      );
+    case DIV:
+      return std::make_shared<BinaryOp<DIV>>(
+        std::make_shared<BinaryOp<SUB>>(
+          std::make_shared<BinaryOp<MUL>>(std::move(d_lhs), rhs),
+          std::make_shared<BinaryOp<MUL>>(lhs, std::move(d_rhs))
+        ),
+        std::make_shared<BinaryOp<MUL>>(
+          rhs,
+          rhs
+        )
+      );
+    case POW:
+      break;
+  }
+  throw std::logic_error("the power rule needs to know where the variable occurs");
 }
 
-template <>
-std::unique_ptr<Term_I> BinaryOp<BinaryOperation_TP::MUL>::derivative(const std::string& var) const {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::ADD>>(
-    std::make_unique<BinaryOp<BinaryOperation_TP::MUL>>(_lhs->derivative(var), _rhs->clone()),
-    std::make_unique<BinaryOp<BinaryOperation_TP::MUL>>(_lhs->clone(), _rhs->derivative(var))
-  );
+Expression term_derivative(const Term_I& term, const std::string& var) {
+  return detail::fold<Derivative>(term, [&var](const Term_I& node, std::span<Derivative> d) -> Derivative {
+    const auto operands = node.operands();
+    switch (node.node_type()) {
+      case Node_TP::CONSTANT:
+        return {node.derivative(var), false};
+      case Node_TP::VARIABLE:
+        return {node.derivative(var), static_cast<const Variable&>(node).get_name() == var};
+      case Node_TP::ADD:
+        return {binary_derivative<ADD>(operands[0], operands[1], std::move(d[0].term), std::move(d[1].term)),
+                d[0].var || d[1].var};
+      case Node_TP::SUB:
+        return {binary_derivative<SUB>(operands[0], operands[1], std::move(d[0].term), std::move(d[1].term)),
+                d[0].var || d[1].var};
+      case Node_TP::MUL:
+        return {binary_derivative<MUL>(operands[0], operands[1], std::move(d[0].term), std::move(d[1].term)),
+                d[0].var || d[1].var};
+      case Node_TP::DIV:
+        return {binary_derivative<DIV>(operands[0], operands[1], std::move(d[0].term), std::move(d[1].term)),
+                d[0].var || d[1].var};
+      case Node_TP::POW: {
+        if (d[1].var) {
+          throw std::runtime_error("derivative of a power with a non constant exponent is not supported");
+        }
+        if (!d[0].var) {
+          return {constant(0), false};
+        }
+        // power rule: c * x^(c - 1), chain rule for any other base
+        auto result = std::make_shared<BinaryOp<MUL>>(
+          operands[1],
+          std::make_shared<BinaryOp<POW>>(
+            operands[0],
+            std::make_shared<BinaryOp<SUB>>(operands[1], constant(1))
+          )
+        );
+        if (operands[0]->node_type() == Node_TP::VARIABLE) {
+          return {result, true};
+        }
+        return {std::make_shared<BinaryOp<MUL>>(result, std::move(d[0].term)), true};
+      }
+      case Node_TP::SUM: {
+        std::vector<Expression> terms;
+        terms.reserve(d.size());
+        bool var_occurs = false;
+        for (auto& operand : d) {
+          terms.push_back(std::move(operand.term));
+          var_occurs = var_occurs || operand.var;
+        }
+        return {sum(std::move(terms)), var_occurs};
+      }
+      case Node_TP::PRODUCT: {
+        // product rule over the factors containing var, the others form a common factor
+        std::vector<Expression> independent;
+        std::vector<Expression> dependent;
+        std::vector<Derivative> derivatives;
+        for (std::size_t i = 0; i < operands.size(); ++i) {
+          if (d[i].var) {
+            dependent.push_back(operands[i]);
+            derivatives.push_back(std::move(d[i]));
+          } else {
+            independent.push_back(operands[i]);
+          }
+        }
+        if (dependent.empty()) {
+          return {constant(0), false};
+        }
+        independent.push_back(product_derivative(dependent, derivatives));
+        return {product(std::move(independent)), true};
+      }
+    }
+    return {constant(0), false};
+  }).term;
 }
 
-template <>
-std::unique_ptr<Term_I> BinaryOp<BinaryOperation_TP::DIV>::derivative(const std::string& var) const {
-  return std::make_unique<BinaryOp<BinaryOperation_TP::DIV>>(
-    std::make_unique<BinaryOp<BinaryOperation_TP::SUB>>(
-      std::make_unique<BinaryOp<BinaryOperation_TP::MUL>>(_lhs->derivative(var), _rhs->clone()),
-      std::make_unique<BinaryOp<BinaryOperation_TP::MUL>>(_lhs->clone(), _rhs->derivative(var))
-    ),
-    std::make_unique<BinaryOp<BinaryOperation_TP::MUL>>(
-      _rhs->clone(),
-      _rhs->clone()
-    )
-  );
+/// derivative of the operand of an operator below the recursion bound, like evaluate_operand()
+Expression derivative_operand(const Expression& operand, const std::string& var) {
+  if (operand.use_count() > 1 && !operand->operands().empty()) {
+    return term_derivative(*operand, var);
+  }
+  return operand->derivative(var);
 }
 
-template <>
-std::unique_ptr<Term_I> BinaryOp<BinaryOperation_TP::POW>::derivative(const std::string& var) const {
-  if (const auto* left = dynamic_cast<Variable*>(_lhs.get()); left == nullptr || left->get_name() != var) {
-    return left->derivative(var);
+}  // namespace
+
+template <BinaryOperation_TP T>
+Expression BinaryOp<T>::derivative(const std::string& var) const {
+  // the power rule depends on where var occurs, which fold() tracks
+  if (T == POW || recursion_depth >= detail::MAX_FOLD_RECURSION) {
+    return term_derivative(*this, var);
   }
-  return std::make_unique<BinaryOp<BinaryOperation_TP::MUL>>(
-    _rhs->clone(),
-    std::make_unique<BinaryOp<BinaryOperation_TP::POW>>(
-      _lhs->clone(),
-      std::make_unique<BinaryOp<BinaryOperation_TP::SUB>>(_rhs->clone(), constant(1))
-    )
-  );
+  const RecursionScope scope;
+  return binary_derivative<T>(_operands[0], _operands[1], derivative_operand(_operands[0], var),
+                              derivative_operand(_operands[1], var));
 }
 
-template <>
-double BinaryOp<BinaryOperation_TP::ADD>::evaluate(const std::map<std::string, double>& var) const {
-  return _lhs->evaluate(var) + _rhs->evaluate(var);
+template <BinaryOperation_TP T>
+double BinaryOp<T>::evaluate(const std::map<std::string, double>& var) const {
+  if (recursion_depth >= detail::MAX_FOLD_RECURSION) {
+    return evaluate_term(*this, var);
+  }
+  const RecursionScope scope;
+  const double lhs = evaluate_operand(_operands[0], var);
+  const double rhs = evaluate_operand(_operands[1], var);
+  switch (T) {
+    case ADD:
+      return lhs + rhs;
+    case SUB:
+      return lhs - rhs;
+    case MUL:
+      return lhs * rhs;
+    case DIV:
+      return lhs / rhs;
+    case POW:
+      return std::pow(lhs, rhs);
+  }
+  return 0;
 }
 
-template <>
-double BinaryOp<BinaryOperation_TP::SUB>::evaluate(const std::map<std::string, double>& var) const {
-  return _lhs->evaluate(var) - _rhs->evaluate(var);
+template <BinaryOperation_TP T>
+std::string BinaryOp<T>::to_str() const {
+  return term_to_str(*this);
 }
 
-template <>
-double BinaryOp<BinaryOperation_TP::MUL>::evaluate(const std::map<std::string, double>& var) const {
-  return _lhs->evaluate(var) * _rhs->evaluate(var);
+template <BinaryOperation_TP T>
+Node_TP BinaryOp<T>::node_type() const {
+  return to_node_type(T);
 }
 
-template <>
-double BinaryOp<BinaryOperation_TP::DIV>::evaluate(const std::map<std::string, double>& var) const {
-  return _lhs->evaluate(var) / _rhs->evaluate(var);
+template <BinaryOperation_TP T>
+std::uint32_t BinaryOp<T>::flatten_into(FlatExpression& flat, std::span<const std::uint32_t> operands) const {
+  return flat.emplace(to_node_type(T), operands[0], operands[1]);
 }
 
-template <>
-double BinaryOp<BinaryOperation_TP::POW>::evaluate(const std::map<std::string, double>& var) const {
-  return std::pow(_lhs->evaluate(var), _rhs->evaluate(var));
+template class BinaryOp<BinaryOperation_TP::ADD>;
+template class BinaryOp<BinaryOperation_TP::SUB>;
+template class BinaryOp<BinaryOperation_TP::MUL>;
+template class BinaryOp<BinaryOperation_TP::DIV>;
+template class BinaryOp<BinaryOperation_TP::POW>;
+
+template <BinaryOperation_TP T>
+Expression NaryOp<T>::derivative(const std::string& var) const {
+  // the product rule depends on which factors contain var, which fold() tracks
+  if (T == MUL || recursion_depth >= detail::MAX_FOLD_RECURSION) {
+    return term_derivative(*this, var);
+  }
+  const RecursionScope scope;
+  std::vector<Expression> terms;
+  terms.reserve(_operands.size());
+  for (const Expression& operand : _operands) {
+    terms.push_back(derivative_operand(operand, var));
+  }
+  return sum(std::move(terms));
 }
 
-template <>
-std::string BinaryOp<BinaryOperation_TP::ADD>::to_str() const {
-  return std::format("({} + {})", _lhs->to_str(), _rhs->to_str());
+template <BinaryOperation_TP T>
+double NaryOp<T>::evaluate(const std::map<std::string, double>& var) const {
+  if (recursion_depth >= detail::MAX_FOLD_RECURSION) {
+    return evaluate_term(*this, var);
+  }
+  const RecursionScope scope;
+  double result = evaluate_operand(_operands[0], var);
+  for (std::size_t i = 1; i < _operands.size(); ++i) {
+    if constexpr (T == ADD) {
+      result += evaluate_operand(_operands[i], var);
+    } else {
+      result *= evaluate_operand(_operands[i], var);
+    }
+  }
+  return result;
 }
 
-template <>
-std::string BinaryOp<BinaryOperation_TP::SUB>::to_str() const {
-  return std::format("({} - {})", _lhs->to_str(), _rhs->to_str());
+template <BinaryOperation_TP T>
+std::string NaryOp<T>::to_str() const {
+  return term_to_str(*this);
 }
 
-template <>
-std::string BinaryOp<BinaryOperation_TP::MUL>::to_str() const {
-  return std::format("({} * {})", _lhs->to_str(), _rhs->to_str());
+template <BinaryOperation_TP T>
+std::uint32_t NaryOp<T>::flatten_into(FlatExpression& flat, std::span<const std::uint32_t> operands) const {
+  return flat.emplace_nary(T == BinaryOperation_TP::ADD ? Node_TP::SUM : Node_TP::PRODUCT, operands);
 }
 
-template <>
-std::string BinaryOp<BinaryOperation_TP::DIV>::to_str() const {
-  return std::format("({} / {})", _lhs->to_str(), _rhs->to_str());
+template class NaryOp<BinaryOperation_TP::ADD>;
+template class NaryOp<BinaryOperation_TP::MUL>;
+
+Expression sum(std::vector<Expression> operands) {
+  if (operands.empty()) {
+    return constant(0);
+  }
+  if (operands.size() == 1) {
+    return std::move(operands.front());
+  }
+  return std::make_shared<NaryOp<BinaryOperation_TP::ADD>>(std::move(operands));
 }
 
-template <>
-std::string BinaryOp<BinaryOperation_TP::POW>::to_str() const {
-  return std::format("{}^({})", _lhs->to_str(), _rhs->to_str());
+Expression product(std::vector<Expression> operands) {
+  if (operands.empty()) {
+    return constant(1);
+  }
+  if (operands.size() == 1) {
+    return std::move(operands.front());
+  }
+  return std::make_shared<NaryOp<BinaryOperation_TP::MUL>>(std::move(operands));
 }
 
 }  // namespace fsd
\ No newline at end of file
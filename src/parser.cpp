@@ -12,116 +12,134 @@ namespace fsd {
 Parser::Parser(std::string_view input) : _tokenizer(input) {}
 
 std::expected<Expression, Error> Parser::parse() {
-  for (auto exp_token : _tokenizer) {
+  const std::string_view input = _tokenizer.get_input();
+  // true while an operand (number, variable or '(') is expected next
+  bool expect_operand = true;
+  while (true) {
+    auto exp_token = _tokenizer.next_token();
     if (!exp_token.has_value()) {
       return std::unexpected(exp_token.error());
     }
-    Token token = exp_token.value();
+    const Token token = exp_token.value();
+    const auto position =
+      static_cast<std::size_t>(_tokenizer.get_current_position() - input.begin()) - token.value.size();
+    if (token.type == TokenType_TP::END) {
+      break;
+    }
+    std::optional<Error> error;
     switch (token.type) {
       case TokenType_TP::NUMBER:
-        _operand_stack.push(parse_number(token));
-        break;
-      case TokenType_TP::PLUS:
-        handle_addition();
-        break;
-      case TokenType_TP::MINUS:
-        handle_subtraction();
-        break;
       case TokenType_TP::LITERAL:
-        handle_literal(token.value);
+      case TokenType_TP::LEFT_PAREN:
+        if (!expect_operand) {
+          return std::unexpected(Error(ErrorType::MISSING_OPERATOR, position));
+        }
+        if (token.type == TokenType_TP::NUMBER) {
+          _operand_stack.push({parse_number(token)});
+        } else if (token.type == TokenType_TP::LITERAL) {
+          error = handle_literal(token.value);
+        } else {
+          _operator_stack.push(Operation_TP::LPAR);
+        }
+        expect_operand = token.type == TokenType_TP::LEFT_PAREN;
         break;
       case TokenType_TP::RIGHT_PAREN:
-        handle_right_paren();
-        break;
-      case TokenType_TP::END:
-          break;
-      case TokenType_TP::LEFT_PAREN:
-        _operator_stack.push(Operation_TP::LPAR);
+        if (expect_operand) {
+          return std::unexpected(Error(ErrorType::MISSING_OPERAND, position));
+        }
+        error = handle_right_paren(position);
         break;
+      case TokenType_TP::PLUS:
+      case TokenType_TP::MINUS:
       case TokenType_TP::MUL:
-        handle_multiplication();
-        break;
       case TokenType_TP::POW:
-        _operator_stack.push(Operation_TP::POW);
-        break;
-      case TokenType_TP::SLASH:
-        handle_division();
+      case TokenType_TP::SLASH: {
+        if (expect_operand) {
+          return std::unexpected(Error(ErrorType::MISSING_OPERAND, position));
+        }
+        constexpr auto to_operation = [](TokenType_TP type) {
+          switch (type) {
+            case TokenType_TP::PLUS:
+              return Operation_TP::ADD;
+            case TokenType_TP::MINUS:
+              return Operation_TP::SUB;
+            case TokenType_TP::MUL:
+              return Operation_TP::MUL;
+            case TokenType_TP::SLASH:
+              return Operation_TP::DIV;
+            default:
+              return Operation_TP::POW;
+          }
+        };
+        error = handle_operator(to_operation(token.type));
+        expect_operand = true;
         break;
+      }
       case TokenType_TP::COMMA:
         // comma is skipped, we "know" the number of arguments for supported functions
         break;
+      case TokenType_TP::END:
+        break;
+    }
+    if (error.has_value()) {
+      return std::unexpected(error.value());
     }
   }
-  while (true) {
-    if (_operator_stack.empty()) {
-      break;
+  if (expect_operand) {
+    return std::unexpected(Error(ErrorType::MISSING_OPERAND, input.size()));
+  }
+  while (!_operator_stack.empty()) {
+    if (_operator_stack.top() == Operation_TP::LPAR) {
+      // '(' without matching ')'
+      return std::unexpected(Error(ErrorType::MISSING_OPERATOR, input.size()));
     }
-    if (concatenate_next().has_value()) {
-      return std::unexpected(Error());
+    if (auto error = concatenate_next(); error.has_value()) {
+      return std::unexpected(error.value());
     }
   }
   if (_operand_stack.size() == 1) {
-    auto expr = std::move(_operand_stack.top());
+    auto expr = std::move(_operand_stack.top()).materialize();
     _operand_stack.pop();
     return {std::move(expr)};
   }
-  return std::unexpected(Error());
-}
-
-std::optional<Error> Parser::handle_addition() {
-  std::optional<Error> result;
-  if (!_operator_stack.empty() && (_operator_stack.top() == Operation_TP::MUL || _operator_stack.top() == Operation_TP::DIV || _operator_stack.top() == Operation_TP::POW)) {
-    result = concatenate_next();
-  }
-  _operator_stack.push(Operation_TP::ADD);
-  return result;
-}
-
-std::optional<Error> Parser::handle_subtraction() {
-  std::optional<Error> result;
-  if (!_operator_stack.empty() && (_operator_stack.top() == Operation_TP::MUL || _operator_stack.top() == Operation_TP::DIV || _operator_stack.top() == Operation_TP::POW)) {
-    result = concatenate_next();
-  }
-  _operator_stack.push(Operation_TP::SUB);
-  return result;
-}
-
-std::optional<Error> Parser::handle_multiplication() {
-  std::optional<Error> result;
-  if (!_operator_stack.empty() && _operator_stack.top() == Operation_TP::POW) {
-    result = concatenate_next();
-  }
-  _operator_stack.push(Operation_TP::MUL);
-  return result;
+  return std::unexpected(Error(ErrorType::MISSING_OPERATOR, input.size()));
 }
 
-std::optional<Error> Parser::handle_division() {
-  std::optional<Error> result;
-  if (!_operator_stack.empty() && _operator_stack.top() == Operation_TP::POW) {
-    result = concatenate_next();
+std::optional<Error> Parser::handle_operator(Operation_TP op) {
+  // reduce all pending operations binding at least as strong, '**' is right associative
+  while (!_operator_stack.empty() && _operator_stack.top() != Operation_TP::LPAR) {
+    const int top = precedence(_operator_stack.top());
+    if (top < precedence(op) || (top == precedence(op) && op == Operation_TP::POW)) {
+      break;
+    }
+    if (auto error = concatenate_next(); error.has_value()) {
+      return error;
+    }
   }
-  _operator_stack.push(Operation_TP::DIV);
-  return result;
+  _operator_stack.push(op);
+  return std::nullopt;
 }
 
 std::optional<Error> Parser::handle_literal(std::string_view literal) {
   // TODO: how do i extract functions from variables?
   //       functions '(' as suffix
   //       variables have no '(' as suffix
-  _operand_stack.push(variable({literal.data(), literal.size()}));
+  _operand_stack.push({variable({literal.data(), literal.size()})});
   return std::nullopt;
 }
 
-std::optional<Error> Parser::handle_right_paren() {
+std::optional<Error> Parser::handle_right_paren(std::size_t position) {
   while (true) {
     if (_operator_stack.empty()) {
-      // return unexpected
-      return Error(ErrorType::MISSING_OPERATOR);
+      // ')' without matching '('
+      return Error(ErrorType::MISSING_OPERATOR, position);
     }
     Operation_TP op = _operator_stack.top();
     if (op == Operation_TP::LPAR) {
-      // (...) detected
+      // (...) detected, the parenthesized chain is closed
       _operator_stack.pop();
+      Expression group = std::move(_operand_stack.top()).materialize();
+      _operand_stack.top() = {std::move(group)};
       return std::nullopt;
     }
     std::optional<Error> maybe = concatenate_next();
@@ -132,28 +150,33 @@ std::optional<Error> Parser::handle_right_paren() {
 }
 
 std::optional<Error> Parser::concatenate_next() {
-  Expression right = std::move(_operand_stack.top());
-  _operand_stack.pop();
-  Expression left = std::move(_operand_stack.top());
+  if (_operand_stack.size() < 2) {
+    return Error(ErrorType::MISSING_OPERAND, _tokenizer.get_input().size());
+  }
+  Operand right = std::move(_operand_stack.top());
   _operand_stack.pop();
+  Operand& left = _operand_stack.top();
   Operation_TP op = _operator_stack.top();
   _operator_stack.pop();
   switch (op) {
-    // binary functions
+    // chains of additions and multiplications are collected into one n-ary node
     case Operation_TP::ADD:
-      _operand_stack.push(std::move(left) + std::move(right));
+    case Operation_TP::MUL:
+      if (left.chain != op) {
+        Expression first = std::move(left).materialize();
+        left = {nullptr, op, {std::move(first)}};
+      }
+      left.terms.push_back(std::move(right).materialize());
       break;
+    // binary functions
     case Operation_TP::SUB:
-      _operand_stack.push(std::move(left) - std::move(right));
-      break;
-    case Operation_TP::MUL:
-      _operand_stack.push(std::move(left) * std::move(right));
+      left = {std::move(left).materialize() - std::move(right).materialize()};
       break;
     case Operation_TP::DIV:
-      _operand_stack.push(std::move(left) / std::move(right));
+      left = {std::move(left).materialize() / std::move(right).materialize()};
       break;
     case Operation_TP::POW:
-      _operand_stack.push(fsd::pow(std::move(left), std::move(right)));
+      left = {fsd::pow(std::move(left).materialize(), std::move(right).materialize())};
       break;
     // unary functions
     case Operation_TP::SIN:
@@ -165,12 +188,41 @@ std::optional<Error> Parser::concatenate_next() {
     case Operation_TP::EXP:
     default:
       // not valid
-      // TODO: return unexpected here
-      break;
+      return Error(ErrorType::MISSING_OPERAND, _tokenizer.get_input().size());
   }
   return std::nullopt;
 }
 
+Expression Parser::Operand::materialize() && {
+  if (chain == Operation_TP::LPAR) {
+    return std::move(term);
+  }
+  // two operands keep the binary form, longer chains become a single n-ary node
+  if (terms.size() == 2) {
+    return chain == Operation_TP::ADD ? std::move(terms[0]) + std::move(terms[1])
+                                      : std::move(terms[0]) * std::move(terms[1]);
+  }
+  return chain == Operation_TP::ADD ? sum(std::move(terms)) : product(std::move(terms));
+}
+
+int Parser::precedence(Operation_TP op) {
+  // binding strength as defined by the grammar of the tokenizer
+  switch (op) {
+    case Operation_TP::ADD:
+      return fsd::precedence(TokenType_TP::PLUS);
+    case Operation_TP::SUB:
+      return fsd::precedence(TokenType_TP::MINUS);
+    case Operation_TP::MUL:
+      return fsd::precedence(TokenType_TP::MUL);
+    case Operation_TP::DIV:
+      return fsd::precedence(TokenType_TP::SLASH);
+    case Operation_TP::POW:
+      return fsd::precedence(TokenType_TP::POW);
+    default:
+      return 0;
+  }
+}
+
 Expression Parser::parse_number(const fsd::Token& token) {
   if (token.value.contains('.')) {
     // token is floating point
@@ -186,4 +238,9 @@ Expression Parser::parse_number(const fsd::Token& token) {
   }
 }
 
+std::expected<Expression, Error> parse(std::string_view input) {
+  Parser parser(input);
+  return parser.parse();
+}
+
 }  // namespace fsd
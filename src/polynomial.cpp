@@ -0,0 +1,423 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/constant.h>
+#include <fsd/operations.h>
+#include <fsd/polynomial.h>
+#include <fsd/variable.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace fsd {
+
+namespace {
+
+// limits of the expressions converted, the expansion costs up to the square of its number of terms
+constexpr double MAX_EXPONENT = 256;
+constexpr double MAX_DEGREE = 1 << 16;
+constexpr double MAX_TERMS = 1 << 12;
+
+double ipow(double base, std::uint32_t exponent) {
+  double result = 1;
+  while (exponent > 0) {
+    if (exponent & 1) {
+      result *= base;
+    }
+    base *= base;
+    exponent >>= 1;
+  }
+  return result;
+}
+
+Expression make_constant(double value) {
+  if (value == std::trunc(value) && std::abs(value) <= std::numeric_limits<int>::max()) {
+    return constant(static_cast<int>(value));
+  }
+  return constant(value);
+}
+
+/// true if node is a constant that can be used as polynomial exponent
+bool is_exponent(const FlatExpression& flat, const Node& node) {
+  if (node.type != Node_TP::CONSTANT) {
+    return false;
+  }
+  const double value = flat.constants()[node.lhs];
+  return value >= 0 && value <= MAX_EXPONENT && value == std::trunc(value);
+}
+
+/// binomial coefficient n choose k, infinity once it exceeds MAX_TERMS
+double binomial(double n, double k) {
+  k = std::min(k, n - k);
+  double result = 1;
+  // result is n - k + i choose i, which grows with i
+  for (double i = 1; i <= k; ++i) {
+    result = result * (n - k + i) / i;
+    if (result > MAX_TERMS) {
+      return std::numeric_limits<double>::infinity();
+    }
+  }
+  return result;
+}
+
+/// upper bounds of the number of terms and the total degree of a polynomial
+struct Bound {
+  double terms;
+  double degree;
+};
+
+/**
+ * Marks every node that is a polynomial in the symbols of flat. Polynomials that could expand to more than MAX_TERMS
+ * terms or a degree above MAX_DEGREE are not, like any other expression that is no polynomial.
+ */
+std::vector<bool> classify(const FlatExpression& flat) {
+  const auto& nodes = flat.nodes();
+  const auto symbols = static_cast<double>(flat.symbols().size());
+  std::vector<bool> polynomial(nodes.size());
+  std::vector<Bound> bounds(nodes.size());
+  for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+    const Node& node = nodes[i];
+    Bound bound {1, 0};
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        polynomial[i] = true;
+        break;
+      case Node_TP::VARIABLE:
+        polynomial[i] = true;
+        bound.degree = 1;
+        break;
+      case Node_TP::ADD:
+      case Node_TP::SUB:
+        polynomial[i] = polynomial[node.lhs] && polynomial[node.rhs];
+        bound = {bounds[node.lhs].terms + bounds[node.rhs].terms,
+                 std::max(bounds[node.lhs].degree, bounds[node.rhs].degree)};
+        break;
+      case Node_TP::MUL:
+        polynomial[i] = polynomial[node.lhs] && polynomial[node.rhs];
+        bound = {bounds[node.lhs].terms * bounds[node.rhs].terms, bounds[node.lhs].degree + bounds[node.rhs].degree};
+        break;
+      case Node_TP::DIV:
+        polynomial[i] = polynomial[node.lhs] && nodes[node.rhs].type == Node_TP::CONSTANT &&
+                        flat.constants()[nodes[node.rhs].lhs] != 0;
+        bound = bounds[node.lhs];
+        break;
+      case Node_TP::POW: {
+        polynomial[i] = polynomial[node.lhs] && is_exponent(flat, nodes[node.rhs]);
+        if (!polynomial[i]) {
+          break;
+        }
+        // the monomials of degree k in the terms of the base
+        const double k = flat.constants()[nodes[node.rhs].lhs];
+        bound = {binomial(bounds[node.lhs].terms + k - 1, k), bounds[node.lhs].degree * k};
+        break;
+      }
+      case Node_TP::SUM:
+      case Node_TP::PRODUCT: {
+        const auto operands = flat.nary_operands(node);
+        polynomial[i] = std::ranges::all_of(operands, [&polynomial](std::uint32_t operand) {
+          return polynomial[operand];
+        });
+        const bool sum = node.type == Node_TP::SUM;
+        bound = {sum ? 0.0 : 1.0, 0};
+        for (const std::uint32_t operand : operands) {
+          bound.terms = sum ? bound.terms + bounds[operand].terms : bound.terms * bounds[operand].terms;
+          bound.degree = sum ? std::max(bound.degree, bounds[operand].degree) : bound.degree + bounds[operand].degree;
+        }
+        break;
+      }
+    }
+    // there are symbols + degree choose degree monomials of at most that degree
+    bound.terms = std::min(bound.terms, binomial(symbols + bound.degree, bound.degree));
+    bounds[i] = bound;
+    polynomial[i] = polynomial[i] && bound.terms <= MAX_TERMS && bound.degree <= MAX_DEGREE;
+  }
+  return polynomial;
+}
+
+/// converts the subexpression rooted at root, all nodes reachable from root must be polynomials
+Polynomial convert(const FlatExpression& flat, std::uint32_t root) {
+  const auto& nodes = flat.nodes();
+  std::vector<bool> used(root + 1);
+  used[root] = true;
+  for (std::uint32_t i = root + 1; i-- > 0;) {
+    if (used[i]) {
+      flat.for_each_operand(nodes[i], [&used](std::uint32_t operand) { used[operand] = true; });
+    }
+  }
+  std::vector<std::optional<Polynomial>> polynomials(root + 1);
+  for (std::uint32_t i = 0; i <= root; ++i) {
+    if (!used[i]) {
+      continue;
+    }
+    const Node& node = nodes[i];
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        polynomials[i] = Polynomial::constant(flat.symbols(), flat.constants()[node.lhs]);
+        break;
+      case Node_TP::VARIABLE:
+        polynomials[i] = Polynomial::variable(flat.symbols(), node.lhs);
+        break;
+      case Node_TP::ADD:
+        polynomials[i] = *polynomials[node.lhs] + *polynomials[node.rhs];
+        break;
+      case Node_TP::SUB:
+        polynomials[i] = *polynomials[node.lhs] - *polynomials[node.rhs];
+        break;
+      case Node_TP::MUL:
+        polynomials[i] = *polynomials[node.lhs] * *polynomials[node.rhs];
+        break;
+      case Node_TP::DIV:
+        polynomials[i] = polynomials[node.lhs]->scaled(1 / flat.constants()[nodes[node.rhs].lhs]);
+        break;
+      case Node_TP::POW:
+        polynomials[i] = polynomials[node.lhs]->pow(static_cast<std::uint32_t>(flat.constants()[nodes[node.rhs].lhs]));
+        break;
+      case Node_TP::SUM:
+      case Node_TP::PRODUCT: {
+        const auto operands = flat.nary_operands(node);
+        Polynomial value = *polynomials[operands[0]];
+        for (std::size_t k = 1; k < operands.size(); ++k) {
+          value = node.type == Node_TP::SUM ? value + *polynomials[operands[k]] : value * *polynomials[operands[k]];
+        }
+        polynomials[i] = std::move(value);
+        break;
+      }
+    }
+  }
+  return std::move(*polynomials[root]);
+}
+
+}  // namespace
+
+Polynomial::Polynomial(std::vector<std::string> variables) : _variables(std::move(variables)) {}
+
+Polynomial Polynomial::constant(std::vector<std::string> variables, double value) {
+  Polynomial result(std::move(variables));
+  if (value != 0) {
+    result._coefficients.push_back(value);
+    result._exponents.resize(result._variables.size());
+  }
+  return result;
+}
+
+Polynomial Polynomial::variable(std::vector<std::string> variables, std::uint32_t index) {
+  Polynomial result(std::move(variables));
+  result._coefficients.push_back(1);
+  result._exponents.resize(result._variables.size());
+  result._exponents[index] = 1;
+  return result;
+}
+
+Polynomial Polynomial::derivative(std::string_view var) const {
+  for (std::uint32_t i = 0; i < _variables.size(); ++i) {
+    if (_variables[i] == var) {
+      return derivative(i);
+    }
+  }
+  return Polynomial(_variables);
+}
+
+Polynomial Polynomial::derivative(std::uint32_t var) const {
+  // decrementing the exponent of var keeps the terms ordered and distinct, so no merging is required
+  const std::size_t n = _variables.size();
+  Polynomial result(_variables);
+  for (std::size_t term = 0; term < size(); ++term) {
+    const std::uint32_t exponent = _exponents[term * n + var];
+    if (exponent == 0) {
+      continue;
+    }
+    result._coefficients.push_back(_coefficients[term] * exponent);
+    result._exponents.insert(result._exponents.end(), _exponents.begin() + static_cast<std::ptrdiff_t>(term * n),
+                             _exponents.begin() + static_cast<std::ptrdiff_t>((term + 1) * n));
+    result._exponents[result._exponents.size() - n + var]--;
+  }
+  return result;
+}
+
+double Polynomial::evaluate(const std::map<std::string, double>& var) const {
+  std::vector<double> values(_variables.size());
+  for (std::size_t i = 0; i < _variables.size(); ++i) {
+    if (auto it = var.find(_variables[i]); it != var.end()) {
+      values[i] = it->second;
+      continue;
+    }
+    for (std::size_t term = 0; term < size(); ++term) {
+      if (_exponents[term * _variables.size() + i] != 0) {
+        throw std::runtime_error("no value for variable " + _variables[i]);
+      }
+    }
+  }
+  return evaluate(values);
+}
+
+double Polynomial::evaluate(std::span<const double> values) const {
+  if (size() == 0) {
+    return 0;
+  }
+  return horner(0, 0, size(), values);
+}
+
+double Polynomial::horner(std::size_t var, std::size_t begin, std::size_t end, std::span<const double> values) const {
+  const std::size_t n = _variables.size();
+  if (var == n) {
+    // all exponents are equal, terms are distinct: exactly one term is left
+    return _coefficients[begin];
+  }
+  // terms [begin, end) share the exponents of all variables before var and are sorted by descending exponent of var:
+  // p = ((c_0 * x^(e_0 - e_1) + c_1) * x^(e_1 - e_2) + ...) * x^e_k, c_i being polynomials in the remaining variables
+  const double x = values[var];
+  double result = 0;
+  std::uint32_t previous = _exponents[begin * n + var];
+  for (std::size_t group = begin; group < end;) {
+    const std::uint32_t exponent = _exponents[group * n + var];
+    std::size_t group_end = group + 1;
+    while (group_end < end && _exponents[group_end * n + var] == exponent) {
+      group_end++;
+    }
+    result = result * ipow(x, previous - exponent) + horner(var + 1, group, group_end, values);
+    previous = exponent;
+    group = group_end;
+  }
+  return result * ipow(x, previous);
+}
+
+Expression Polynomial::to_expression() const {
+  const std::size_t n = _variables.size();
+  Expression result;
+  for (std::size_t term = 0; term < size(); ++term) {
+    Expression monomial;
+    for (std::size_t var = 0; var < n; ++var) {
+      const std::uint32_t exponent = _exponents[term * n + var];
+      if (exponent == 0) {
+        continue;
+      }
+      Expression factor = fsd::variable(_variables[var]);
+      if (exponent > 1) {
+        factor = fsd::pow(factor, make_constant(exponent));
+      }
+      monomial = monomial ? monomial * factor : factor;
+    }
+    if (!monomial) {
+      monomial = make_constant(_coefficients[term]);
+    } else if (_coefficients[term] != 1) {
+      monomial = make_constant(_coefficients[term]) * monomial;
+    }
+    result = result ? result + monomial : monomial;
+  }
+  return result ? result : make_constant(0);
+}
+
+std::string Polynomial::to_str() const { return to_expression()->to_str(); }
+
+Polynomial Polynomial::operator+(const Polynomial& other) const {
+  Terms terms = to_terms();
+  for (std::size_t term = 0; term < other.size(); ++term) {
+    auto exponents = other.exponents(term);
+    terms[{exponents.begin(), exponents.end()}] += other._coefficients[term];
+  }
+  return from_terms(_variables, terms);
+}
+
+Polynomial Polynomial::operator-(const Polynomial& other) const { return *this + other.scaled(-1); }
+
+Polynomial Polynomial::operator*(const Polynomial& other) const {
+  const std::size_t n = _variables.size();
+  Terms terms;
+  std::vector<std::uint32_t> exponents(n);
+  for (std::size_t a = 0; a < size(); ++a) {
+    for (std::size_t b = 0; b < other.size(); ++b) {
+      for (std::size_t var = 0; var < n; ++var) {
+        exponents[var] = _exponents[a * n + var] + other._exponents[b * n + var];
+      }
+      terms[exponents] += _coefficients[a] * other._coefficients[b];
+    }
+  }
+  return from_terms(_variables, terms);
+}
+
+Polynomial Polynomial::scaled(double factor) const {
+  if (factor == 0) {
+    return Polynomial(_variables);
+  }
+  Polynomial result = *this;
+  for (double& coefficient : result._coefficients) {
+    coefficient *= factor;
+  }
+  return result;
+}
+
+Polynomial Polynomial::pow(std::uint32_t exponent) const {
+  Polynomial result = constant(_variables, 1);
+  Polynomial base = *this;
+  while (exponent > 0) {
+    if (exponent & 1) {
+      result = result * base;
+    }
+    exponent >>= 1;
+    if (exponent > 0) {
+      base = base * base;
+    }
+  }
+  return result;
+}
+
+Polynomial Polynomial::from_terms(std::vector<std::string> variables, const Terms& terms) {
+  Polynomial result(std::move(variables));
+  for (const auto& [exponents, coefficient] : terms) {
+    if (coefficient == 0) {
+      continue;
+    }
+    result._coefficients.push_back(coefficient);
+    result._exponents.insert(result._exponents.end(), exponents.begin(), exponents.end());
+  }
+  return result;
+}
+
+Polynomial::Terms Polynomial::to_terms() const {
+  Terms terms;
+  for (std::size_t term = 0; term < size(); ++term) {
+    auto exponents = this->exponents(term);
+    terms.emplace(std::vector<std::uint32_t>(exponents.begin(), exponents.end()), _coefficients[term]);
+  }
+  return terms;
+}
+
+std::optional<Polynomial> to_polynomial(const FlatExpression& flat) {
+  if (flat.size() == 0 || !classify(flat)[flat.root()]) {
+    return std::nullopt;
+  }
+  return convert(flat, flat.root());
+}
+
+std::optional<Polynomial> to_polynomial(const Term_I& term) { return to_polynomial(flatten(term)); }
+
+std::vector<PolynomialSubexpression> polynomial_subexpressions(const FlatExpression& flat) {
+  const auto& nodes = flat.nodes();
+  const std::vector<bool> polynomial = classify(flat);
+  // a polynomial node is maximal if it is the root or used by a node that is not a polynomial
+  std::vector<bool> maximal(nodes.size());
+  if (!nodes.empty()) {
+    maximal[flat.root()] = polynomial[flat.root()];
+  }
+  for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+    const Node& node = nodes[i];
+    if (polynomial[i]) {
+      continue;
+    }
+    flat.for_each_operand(node, [&](std::uint32_t operand) {
+      maximal[operand] = maximal[operand] || polynomial[operand];
+    });
+  }
+  std::vector<PolynomialSubexpression> result;
+  for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+    if (maximal[i] && nodes[i].type != Node_TP::CONSTANT && nodes[i].type != Node_TP::VARIABLE) {
+      result.push_back({i, convert(flat, i)});
+    }
+  }
+  return result;
+}
+
+}  // namespace fsd
@@ -0,0 +1,184 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/service.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace fsd {
+
+EvaluationService::EvaluationService() : EvaluationService(Options()) {}
+
+EvaluationService::EvaluationService(Options options) : _options(options) {
+  _options.max_batch_size = std::max<std::size_t>(_options.max_batch_size, 1);
+  for (std::size_t i = 0; i < std::max<std::size_t>(_options.threads, 1); ++i) {
+    _workers.emplace_back(&EvaluationService::work, this);
+  }
+}
+
+EvaluationService::~EvaluationService() {
+  {
+    std::lock_guard lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  for (auto& worker : _workers) {
+    worker.join();
+  }
+}
+
+std::future<double> EvaluationService::submit(std::shared_ptr<const FlatExpression> expr, std::vector<double> values) {
+  Request request {std::move(values), {}, {}, {}};
+  auto future = request.promise.get_future();
+  enqueue(std::move(expr), std::move(request));
+  return future;
+}
+
+void EvaluationService::submit(std::shared_ptr<const FlatExpression> expr, std::vector<double> values,
+                               Callback callback, ErrorCallback on_error) {
+  enqueue(std::move(expr), {std::move(values), {}, std::move(callback), std::move(on_error)});
+}
+
+EvaluationService::Metrics EvaluationService::metrics() const {
+  std::lock_guard lock(_mutex);
+  return _metrics;
+}
+
+void EvaluationService::enqueue(std::shared_ptr<const FlatExpression> expr, Request request) {
+  if (expr == nullptr) {
+    throw std::invalid_argument("no expression to evaluate");
+  }
+  if (request.values.size() != expr->symbols().size()) {
+    throw std::invalid_argument("expected one value per symbol of the expression");
+  }
+  bool full;
+  {
+    std::lock_guard lock(_mutex);
+    auto& batch = _pending[expr.get()];
+    if (batch.requests.empty()) {
+      batch.expr = std::move(expr);
+      batch.deadline = std::chrono::steady_clock::now() + _options.max_delay;
+    }
+    batch.requests.push_back(std::move(request));
+    full = batch.requests.size() >= _options.max_batch_size;
+    _metrics.queue_depth++;
+    _metrics.max_queue_depth = std::max(_metrics.max_queue_depth, _metrics.queue_depth);
+  }
+  // a new batch only needs one worker to pick up its deadline, a full one should be evaluated by any idle worker
+  if (full) {
+    _cv.notify_all();
+  } else {
+    _cv.notify_one();
+  }
+}
+
+void EvaluationService::work() {
+  std::unique_lock lock(_mutex);
+  while (true) {
+    // find a batch that is full or due, and the earliest deadline of all others
+    const auto now = std::chrono::steady_clock::now();
+    auto ready = _pending.end();
+    auto next_deadline = std::chrono::steady_clock::time_point::max();
+    for (auto it = _pending.begin(); it != _pending.end(); ++it) {
+      if (_stop || it->second.requests.size() >= _options.max_batch_size || it->second.deadline <= now) {
+        ready = it;
+        break;
+      }
+      next_deadline = std::min(next_deadline, it->second.deadline);
+    }
+    if (ready == _pending.end()) {
+      if (_stop) {
+        return;
+      }
+      if (next_deadline == std::chrono::steady_clock::time_point::max()) {
+        _cv.wait(lock);
+      } else {
+        _cv.wait_until(lock, next_deadline);
+      }
+      continue;
+    }
+
+    // oversized batches are split, the remainder keeps its deadline
+    Batch batch;
+    auto& pending = ready->second;
+    if (pending.requests.size() > _options.max_batch_size) {
+      batch.expr = pending.expr;
+      auto split = pending.requests.begin() + static_cast<std::ptrdiff_t>(_options.max_batch_size);
+      batch.requests.assign(std::make_move_iterator(pending.requests.begin()), std::make_move_iterator(split));
+      pending.requests.erase(pending.requests.begin(), split);
+    } else {
+      batch = std::move(pending);
+      _pending.erase(ready);
+    }
+    _metrics.queue_depth -= batch.requests.size();
+    _metrics.requests += batch.requests.size();
+    _metrics.batches++;
+    _metrics.max_batch_size = std::max(_metrics.max_batch_size, batch.requests.size());
+
+    lock.unlock();
+    evaluate(batch);
+    lock.lock();
+  }
+}
+
+void EvaluationService::evaluate(Batch& batch) {
+  const FlatExpression& expr = *batch.expr;
+  const std::size_t n = batch.requests.size();
+  const std::size_t symbols = expr.symbols().size();
+
+  // a failed evaluation fails every request of the batch, it must not escape the worker thread
+  std::vector<double> result;
+  try {
+    // transpose the points into one column per symbol
+    std::vector<double> values(symbols * n);
+    std::vector<const double*> columns(symbols);
+    for (std::size_t s = 0; s < symbols; ++s) {
+      columns[s] = values.data() + s * n;
+      for (std::size_t i = 0; i < n; ++i) {
+        values[s * n + i] = batch.requests[i].values[s];
+      }
+    }
+    result.resize(n);
+    expr.evaluate(columns, result);
+  } catch (...) {
+    const auto error = std::current_exception();
+    for (auto& request : batch.requests) {
+      fail(request, error);
+    }
+    return;
+  }
+
+  for (std::size_t i = 0; i < n; ++i) {
+    complete(batch.requests[i], result[i]);
+  }
+}
+
+void EvaluationService::complete(Request& request, double value) noexcept {
+  if (!request.callback) {
+    request.promise.set_value(value);
+    return;
+  }
+  try {
+    request.callback(value);
+  } catch (...) {
+    fail(request, std::current_exception());
+  }
+}
+
+void EvaluationService::fail(Request& request, const std::exception_ptr& error) noexcept {
+  if (!request.callback) {
+    request.promise.set_exception(error);
+    return;
+  }
+  if (request.on_error) {
+    try {
+      request.on_error(error);
+    } catch (...) {
+      // nobody left to report to
+    }
+  }
+}
+
+}  // namespace fsd
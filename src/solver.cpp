@@ -0,0 +1,391 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/solver.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+namespace fsd {
+
+namespace {
+
+constexpr double ARMIJO = 1e-4;
+constexpr double MIN_STEP = 1e-16;
+
+double dot(std::span<const double> a, std::span<const double> b) {
+  return std::inner_product(a.begin(), a.end(), b.begin(), 0.0);
+}
+
+double max_abs(std::span<const double> a) {
+  double result = 0;
+  for (double v : a) {
+    result = std::max(result, std::abs(v));
+  }
+  return result;
+}
+
+/// solves (h + damping * I) p = rhs in place of p using a Cholesky decomposition into l, false if not positive definite
+bool cholesky_solve(std::span<const double> h, double damping, std::size_t n, std::span<double> l,
+                    std::span<const double> rhs, std::span<double> p) {
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = 0; j <= i; ++j) {
+      double sum = h[i * n + j] + (i == j ? damping : 0);
+      for (std::size_t k = 0; k < j; ++k) {
+        sum -= l[i * n + k] * l[j * n + k];
+      }
+      if (i == j) {
+        if (!(sum > 0)) {
+          return false;
+        }
+        l[i * n + i] = std::sqrt(sum);
+      } else {
+        l[i * n + j] = sum / l[j * n + j];
+      }
+    }
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    double sum = rhs[i];
+    for (std::size_t k = 0; k < i; ++k) {
+      sum -= l[i * n + k] * p[k];
+    }
+    p[i] = sum / l[i * n + i];
+  }
+  for (std::size_t i = n; i-- > 0;) {
+    double sum = p[i];
+    for (std::size_t k = i + 1; k < n; ++k) {
+      sum -= l[k * n + i] * p[k];
+    }
+    p[i] = sum / l[i * n + i];
+  }
+  return true;
+}
+
+}  // namespace
+
+/// All buffers used while solving a single problem. Allocated once per solve(), never during iterations.
+class Solver::Workspace {
+ public:
+  Workspace(const Solver& solver, std::span<const double> start, const std::map<std::string, double>& parameters)
+      : _solver(solver),
+        _values(solver._value.symbols().size()),
+        _registers(solver._registers),
+        _outputs(std::max(solver._value_gradient.outputs().size(), solver._hessian.outputs().size())) {
+    const std::size_t n = solver._variables.size();
+    if (start.size() != n) {
+      throw std::invalid_argument("expected one start value per variable");
+    }
+    std::vector<bool> bound(_values.size());
+    for (std::uint32_t symbol : solver._symbols) {
+      bound[symbol] = true;
+    }
+    for (std::uint32_t i = 0; i < _values.size(); ++i) {
+      if (bound[i]) {
+        continue;
+      }
+      auto it = parameters.find(solver._value.symbols()[i]);
+      if (it == parameters.end()) {
+        throw std::invalid_argument("no value for parameter " + solver._value.symbols()[i]);
+      }
+      _values[i] = it->second;
+    }
+    x.assign(start.begin(), start.end());
+    trial.resize(n);
+    gradient.resize(n);
+    trial_gradient.resize(n);
+    direction.resize(n);
+  }
+
+  double value(std::span<const double> at) {
+    bind(at);
+    return _solver._value_program.evaluate(_values, _registers);
+  }
+
+  double value_gradient(std::span<const double> at, std::span<double> g) {
+    bind(at);
+    _solver._value_gradient.evaluate(_values, _registers, _outputs);
+    std::copy_n(_outputs.begin() + 1, g.size(), g.begin());
+    return _outputs[0];
+  }
+
+  /// full symmetric Hessian at the point of the last evaluation
+  void hessian(std::span<double> h) {
+    const std::size_t n = x.size();
+    _solver._hessian.evaluate(_values, _registers, _outputs);
+    std::size_t k = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      for (std::size_t j = i; j < n; ++j) {
+        h[i * n + j] = h[j * n + i] = _outputs[k++];
+      }
+    }
+  }
+
+  std::vector<double> x;
+  std::vector<double> trial;
+  std::vector<double> gradient;
+  std::vector<double> trial_gradient;
+  std::vector<double> direction;
+
+ private:
+  void bind(std::span<const double> at) {
+    for (std::size_t i = 0; i < at.size(); ++i) {
+      _values[_solver._symbols[i]] = at[i];
+    }
+  }
+
+  const Solver& _solver;
+  std::vector<double> _values;
+  std::vector<double> _registers;
+  std::vector<double> _outputs;
+};
+
+Solver::Solver(const Expression& expr, std::vector<std::string> variables, SolverOptions options)
+    : _options(options), _variables(std::move(variables)), _value(flatten(*expr)) {
+  if (_options.method == Method_TP::NEWTON_RAPHSON && _variables.size() != 1) {
+    throw std::invalid_argument("NEWTON_RAPHSON solves for exactly one variable");
+  }
+  // interning all variables up front gives all derivatives the same symbol table
+  for (const auto& var : _variables) {
+    _symbols.push_back(_value.intern(var));
+  }
+  // the value comes first, so the kernels keep its symbol ids
+  std::vector<FlatExpression> outputs {_value};
+  for (std::uint32_t symbol : _symbols) {
+    outputs.push_back(_value.derivative(symbol));
+  }
+  _value_program = compile(_value);
+  _value_gradient = compile_kernel(outputs);
+  _registers = std::max<std::size_t>(_value_program.registers(), _value_gradient.registers());
+  if (_options.method == Method_TP::DAMPED_NEWTON) {
+    std::vector<FlatExpression> hessian;
+    for (std::size_t i = 0; i < _symbols.size(); ++i) {
+      for (std::size_t j = i; j < _symbols.size(); ++j) {
+        hessian.push_back(outputs[i + 1].derivative(_symbols[j]));
+      }
+    }
+    _hessian = compile_kernel(hessian);
+    _registers = std::max<std::size_t>(_registers, _hessian.registers());
+  }
+  const bool hessian_symbols = _hessian.symbols().empty() || _hessian.symbols() == _value.symbols();
+  if (_value_gradient.symbols() != _value.symbols() || !hessian_symbols) {
+    throw std::logic_error("derivatives do not share the symbol table of the expression");
+  }
+}
+
+SolverResult Solver::solve(std::span<const double> start, const std::map<std::string, double>& parameters) const {
+  Workspace ws(*this, start, parameters);
+  switch (_options.method) {
+    case Method_TP::NEWTON_RAPHSON:
+      return newton_raphson(ws);
+    case Method_TP::DAMPED_NEWTON:
+      return damped_newton(ws);
+    case Method_TP::LBFGS:
+      return lbfgs(ws);
+  }
+  throw std::invalid_argument("unknown solver method");
+}
+
+std::vector<SolverResult> Solver::solve(std::span<const std::vector<double>> starts,
+                                        std::span<const std::map<std::string, double>> parameters) const {
+  if (parameters.size() > 1 && parameters.size() != starts.size()) {
+    throw std::invalid_argument("expected no parameters, one shared set or one set per start");
+  }
+  static const std::map<std::string, double> no_parameters;
+  std::vector<SolverResult> results(starts.size());
+  std::atomic<std::size_t> next {0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto work = [&]() {
+    for (std::size_t i = next++; i < starts.size(); i = next++) {
+      const auto& params = parameters.empty() ? no_parameters : parameters[parameters.size() == 1 ? 0 : i];
+      try {
+        results[i] = solve(starts[i], params);
+      } catch (...) {
+        std::lock_guard lock(error_mutex);
+        error = std::current_exception();
+      }
+    }
+  };
+  std::size_t threads = _options.threads == 0 ? std::thread::hardware_concurrency() : _options.threads;
+  threads = std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(starts.size(), 1));
+  std::vector<std::thread> workers;
+  for (std::size_t t = 1; t < threads; ++t) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return results;
+}
+
+SolverResult Solver::newton_raphson(Workspace& ws) const {
+  auto& x = ws.x;
+  auto& df = ws.gradient;
+  for (std::size_t iteration = 0; iteration < _options.max_iterations; ++iteration) {
+    const double f = ws.value_gradient(x, df);
+    if (std::abs(f) <= _options.tolerance) {
+      return {x, f, iteration, true};
+    }
+    if (df[0] == 0 || !std::isfinite(df[0])) {
+      return {x, f, iteration, false};
+    }
+    x[0] -= f / df[0];
+  }
+  const double f = ws.value(x);
+  return {x, f, _options.max_iterations, std::abs(f) <= _options.tolerance};
+}
+
+SolverResult Solver::damped_newton(Workspace& ws) const {
+  const std::size_t n = _variables.size();
+  std::vector<double> h(n * n);
+  std::vector<double> l(n * n);
+  std::vector<double> rhs(n);
+  auto& x = ws.x;
+  auto& g = ws.gradient;
+  auto& p = ws.direction;
+  double f = ws.value_gradient(x, g);
+  for (std::size_t iteration = 0; iteration < _options.max_iterations; ++iteration) {
+    if (max_abs(g) <= _options.tolerance) {
+      return {x, f, iteration, true};
+    }
+    ws.hessian(h);
+    for (std::size_t i = 0; i < n; ++i) {
+      rhs[i] = -g[i];
+    }
+    // increase the damping until the (regularized) Hessian is positive definite
+    double damping = 0;
+    while (!cholesky_solve(h, damping, n, l, rhs, p)) {
+      damping = damping == 0 ? 1e-8 * std::max(1.0, max_abs(h)) : damping * 10;
+      if (!std::isfinite(damping)) {
+        return {x, f, iteration, false};
+      }
+    }
+    // backtracking line search on the Armijo condition
+    const double slope = dot(g, p);
+    double t = 1;
+    double f_trial;
+    while (true) {
+      for (std::size_t i = 0; i < n; ++i) {
+        ws.trial[i] = x[i] + t * p[i];
+      }
+      f_trial = ws.value(ws.trial);
+      if (f_trial <= f + ARMIJO * t * slope || t < MIN_STEP) {
+        break;
+      }
+      t /= 2;
+    }
+    if (t < MIN_STEP) {
+      return {x, f, iteration, false};
+    }
+    x.swap(ws.trial);
+    f = ws.value_gradient(x, g);
+  }
+  return {x, f, _options.max_iterations, max_abs(g) <= _options.tolerance};
+}
+
+SolverResult Solver::lbfgs(Workspace& ws) const {
+  const std::size_t n = _variables.size();
+  const std::size_t m = std::max<std::size_t>(_options.history, 1);
+  // ring buffers of the correction pairs s = x_{k+1} - x_k, y = g_{k+1} - g_k
+  std::vector<double> s(m * n);
+  std::vector<double> y(m * n);
+  std::vector<double> rho(m);
+  std::vector<double> alpha(m);
+  // the pair of the current step, copied into the ring only if it is kept
+  std::vector<double> s_step(n);
+  std::vector<double> y_step(n);
+  std::size_t stored = 0;
+  std::size_t newest = 0;
+
+  auto& x = ws.x;
+  auto& g = ws.gradient;
+  auto& p = ws.direction;
+  double f = ws.value_gradient(x, g);
+  for (std::size_t iteration = 0; iteration < _options.max_iterations; ++iteration) {
+    if (max_abs(g) <= _options.tolerance) {
+      return {x, f, iteration, true};
+    }
+    // two loop recursion: p = -H g
+    for (std::size_t i = 0; i < n; ++i) {
+      p[i] = -g[i];
+    }
+    for (std::size_t k = 0; k < stored; ++k) {
+      const std::size_t j = (newest + m - k) % m;
+      alpha[j] = rho[j] * dot({&s[j * n], n}, p);
+      for (std::size_t i = 0; i < n; ++i) {
+        p[i] -= alpha[j] * y[j * n + i];
+      }
+    }
+    if (stored > 0) {
+      const std::span<const double> y_newest(&y[newest * n], n);
+      const double gamma = 1 / (rho[newest] * dot(y_newest, y_newest));
+      for (std::size_t i = 0; i < n; ++i) {
+        p[i] *= gamma;
+      }
+    }
+    for (std::size_t k = stored; k-- > 0;) {
+      const std::size_t j = (newest + m - k) % m;
+      const double beta = rho[j] * dot({&y[j * n], n}, p);
+      for (std::size_t i = 0; i < n; ++i) {
+        p[i] += (alpha[j] - beta) * s[j * n + i];
+      }
+    }
+    double slope = dot(g, p);
+    if (!(slope < 0)) {
+      // not a descent direction, restart with steepest descent
+      stored = 0;
+      for (std::size_t i = 0; i < n; ++i) {
+        p[i] = -g[i];
+      }
+      slope = dot(g, p);
+    }
+
+    double t = stored == 0 ? std::min(1.0, 1 / std::max(max_abs(g), MIN_STEP)) : 1;
+    double f_trial;
+    while (true) {
+      for (std::size_t i = 0; i < n; ++i) {
+        ws.trial[i] = x[i] + t * p[i];
+      }
+      f_trial = ws.value_gradient(ws.trial, ws.trial_gradient);
+      if (f_trial <= f + ARMIJO * t * slope || t < MIN_STEP) {
+        break;
+      }
+      t /= 2;
+    }
+    if (t < MIN_STEP) {
+      return {x, f, iteration, false};
+    }
+
+    for (std::size_t i = 0; i < n; ++i) {
+      s_step[i] = ws.trial[i] - x[i];
+      y_step[i] = ws.trial_gradient[i] - g[i];
+    }
+    const double sy = dot(s_step, y_step);
+    // only keep pairs that preserve positive definiteness, a rejected pair must not overwrite the oldest one
+    if (sy > 1e-12 * dot(y_step, y_step)) {
+      const std::size_t next = stored == 0 ? newest : (newest + 1) % m;
+      std::ranges::copy(s_step, s.begin() + static_cast<std::ptrdiff_t>(next * n));
+      std::ranges::copy(y_step, y.begin() + static_cast<std::ptrdiff_t>(next * n));
+      rho[next] = 1 / sy;
+      newest = next;
+      stored = std::min(stored + 1, m);
+    }
+    x.swap(ws.trial);
+    g.swap(ws.trial_gradient);
+    f = f_trial;
+  }
+  return {x, f, _options.max_iterations, max_abs(g) <= _options.tolerance};
+}
+
+}  // namespace fsd
@@ -0,0 +1,125 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/specialize.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+
+namespace fsd {
+
+namespace {
+
+bool is_integral(double value) {
+  return value == std::trunc(value) && std::abs(value) <= std::numeric_limits<int>::max();
+}
+
+}  // namespace
+
+FlatExpression specialize(const FlatExpression& flat, const std::map<std::string, double>& bindings) {
+  const auto& nodes = flat.nodes();
+  FlatExpression result;
+  for (const auto& symbol : flat.symbols()) {
+    result.intern(symbol);
+  }
+  if (nodes.empty()) {
+    return result;
+  }
+  std::vector<std::optional<double>> bound(flat.symbols().size());
+  for (std::uint32_t i = 0; i < flat.symbols().size(); ++i) {
+    if (auto it = bindings.find(flat.symbols()[i]); it != bindings.end()) {
+      bound[i] = it->second;
+    }
+  }
+
+  // a node is folded if all its operands are known, values of known nodes are evaluated right away
+  std::vector<std::optional<double>> known(nodes.size());
+  for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+    const Node& node = nodes[i];
+    switch (node.type) {
+      case Node_TP::CONSTANT:
+        known[i] = flat.constants()[node.lhs];
+        break;
+      case Node_TP::VARIABLE:
+        known[i] = bound[node.lhs];
+        break;
+      case Node_TP::SUM:
+      case Node_TP::PRODUCT: {
+        const auto operands = flat.nary_operands(node);
+        if (std::ranges::all_of(operands, [&known](std::uint32_t operand) { return known[operand].has_value(); })) {
+          const Node_TP op = node.type == Node_TP::SUM ? Node_TP::ADD : Node_TP::MUL;
+          double value = *known[operands[0]];
+          for (std::size_t k = 1; k < operands.size(); ++k) {
+            value = apply(op, value, *known[operands[k]]);
+          }
+          known[i] = value;
+        }
+        break;
+      }
+      default:
+        if (known[node.lhs].has_value() && known[node.rhs].has_value()) {
+          known[i] = apply(node.type, *known[node.lhs], *known[node.rhs]);
+        }
+        break;
+    }
+  }
+
+  // only nodes reachable from the root through unknown nodes are emitted
+  std::vector<bool> used(nodes.size());
+  used[flat.root()] = true;
+  for (std::uint32_t i = flat.root() + 1; i-- > 0;) {
+    if (used[i] && !known[i].has_value()) {
+      // known operands of sums and products are folded into a single constant below
+      const bool nary = nodes[i].type == Node_TP::SUM || nodes[i].type == Node_TP::PRODUCT;
+      flat.for_each_operand(nodes[i], [&used, &known, nary](std::uint32_t operand) {
+        used[operand] = used[operand] || !nary || !known[operand].has_value();
+      });
+    }
+  }
+  std::vector<std::uint32_t> index(nodes.size());
+  std::vector<std::uint32_t> operands;
+  for (std::uint32_t i = 0; i <= flat.root(); ++i) {
+    if (!used[i]) {
+      continue;
+    }
+    const Node& node = nodes[i];
+    if (node.type == Node_TP::CONSTANT) {
+      index[i] = result.emplace_constant(*known[i], node.rhs != 0);
+    } else if (known[i].has_value()) {
+      index[i] = result.emplace_constant(*known[i], is_integral(*known[i]));
+    } else if (node.type == Node_TP::VARIABLE) {
+      index[i] = result.emplace_variable(node.lhs);
+    } else if (node.type == Node_TP::SUM || node.type == Node_TP::PRODUCT) {
+      // the known operands of a partially known sum or product are combined into one constant
+      const Node_TP op = node.type == Node_TP::SUM ? Node_TP::ADD : Node_TP::MUL;
+      std::optional<double> folded;
+      operands.clear();
+      for (std::uint32_t operand : flat.nary_operands(node)) {
+        if (known[operand].has_value()) {
+          folded = folded.has_value() ? apply(op, *folded, *known[operand]) : *known[operand];
+        } else {
+          operands.push_back(index[operand]);
+        }
+      }
+      if (folded.has_value() && *folded != (node.type == Node_TP::SUM ? 0.0 : 1.0)) {
+        operands.push_back(result.emplace_constant(*folded, is_integral(*folded)));
+      }
+      index[i] = operands.size() == 1 ? operands.front() : result.emplace_nary(node.type, operands);
+    } else {
+      index[i] = result.emplace(node.type, index[node.lhs], index[node.rhs]);
+    }
+  }
+  result.set_root(index[flat.root()]);
+  return result;
+}
+
+Specialization specialize(const Term_I& term, const std::map<std::string, double>& bindings) {
+  const FlatExpression flat = flatten(term);
+  const FlatExpression specialized = specialize(flat, bindings);
+  return {specialized.to_expression(), flat.size(), specialized.size()};
+}
+
+}  // namespace fsd
@@ -3,7 +3,73 @@
 // License  : MIT
 
 #include <fsd/term.h>
+#include <fsd/variable.h>
+
+#include <unordered_set>
+#include <vector>
 
 namespace fsd {
 
+bool occurs(const Term_I& term, std::string_view var) {
+  std::vector<const Term_I*> stack {&term};
+  std::unordered_set<const Term_I*> visited;
+  while (!stack.empty()) {
+    const Term_I* top = stack.back();
+    stack.pop_back();
+    const auto operands = top->operands();
+    if (operands.empty()) {
+      if (top->node_type() == Node_TP::VARIABLE && static_cast<const Variable*>(top)->get_name() == var) {
+        return true;
+      }
+      continue;
+    }
+    if (!visited.insert(top).second) {
+      continue;
+    }
+    for (const auto& operand : operands) {
+      stack.push_back(operand.get());
+    }
+  }
+  return false;
+}
+
+namespace detail {
+
+void release(std::span<Expression> operands) noexcept {
+  // terms released by destructors running inside the loop below are appended here instead of being destroyed in place
+  thread_local std::vector<Expression>* pending = nullptr;
+
+  auto defer = [&operands](std::vector<Expression>& list) {
+    for (auto& operand : operands) {
+      if (operand != nullptr) {
+        list.push_back(std::move(operand));
+      }
+    }
+  };
+  if (pending != nullptr) {
+    // every operand is deferred: one held more than once (e * e) only reaches a use count of 1 while it is dropped
+    defer(*pending);
+    return;
+  }
+  // an operand used more often than it can occur here survives, dropping it only decrements its reference count
+  bool owned = false;
+  for (const auto& operand : operands) {
+    owned = owned || (operand != nullptr && operand.use_count() <= static_cast<long>(operands.size()));
+  }
+  if (!owned) {
+    return;
+  }
+  std::vector<Expression> list;
+  pending = &list;
+  defer(list);
+  while (!list.empty()) {
+    Expression term = std::move(list.back());
+    list.pop_back();
+    term.reset();
+  }
+  pending = nullptr;
+}
+
+}  // namespace detail
+
 }  // namespace fsd
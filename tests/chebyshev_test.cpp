@@ -0,0 +1,145 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/chebyshev.h>
+#include <fsd/parser.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+
+namespace {
+
+fsd::FlatExpression parse(std::string_view input) { return fsd::flatten(*fsd::parse(input).value()); }
+
+}  // namespace
+
+TEST(ChebyshevTest, approximate) {
+  // Runge's function needs a high degree
+  const auto flat = parse("1 / (1 + 25*x**2)");
+  const auto series = fsd::approximate(flat, {"x", -1, 1});
+  EXPECT_LE(series.max_error(), 1e-10);
+  EXPECT_GT(series.degree(), 50);
+  EXPECT_LT(series.degree(), 512);
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> x(-1, 1);
+  for (int i = 0; i < 1000; ++i) {
+    const double value = x(generator);
+    EXPECT_NEAR(series.evaluate(value), flat.evaluate({{"x", value}}), 1e-10) << value;
+  }
+
+  // polynomials are reproduced with their degree
+  const auto cubic = fsd::approximate(parse("x**3 - 2*x + 1"), {"x", 0, 3});
+  EXPECT_EQ(cubic.degree(), 3);
+  EXPECT_LE(cubic.max_error(), 1e-12);
+  EXPECT_NEAR(cubic.evaluate(2), 5, 1e-12);
+
+  EXPECT_EQ(fsd::approximate(parse("2.5"), {"x", 0, 1}).degree(), 0);
+}
+
+TEST(ChebyshevTest, tolerance) {
+  const auto flat = parse("1 / (1 + 25*x**2)");
+  const auto coarse = fsd::approximate(flat, {"x", -1, 1}, {.tolerance = 1e-4});
+  EXPECT_LE(coarse.max_error(), 1e-4);
+  EXPECT_LT(coarse.degree(), fsd::approximate(flat, {"x", -1, 1}).degree());
+
+  // |x| converges slowly, the best series within the maximal degree is returned with its error
+  const auto limited = fsd::approximate(parse("(x**2)**0.5"), {"x", -1, 1}, {.tolerance = 1e-12, .max_degree = 64});
+  EXPECT_LE(limited.degree(), 64);
+  EXPECT_GT(limited.max_error(), 1e-12);
+  EXPECT_LT(limited.max_error(), 0.1);
+
+  // a maximal degree below the first fit limits it too
+  for (std::size_t max_degree : {0, 1, 8}) {
+    const auto low = fsd::approximate(flat, {"x", -1, 1}, {.max_degree = max_degree});
+    EXPECT_LE(low.degree(), max_degree);
+    EXPECT_TRUE(std::isfinite(low.max_error()));
+    const auto low_2d = fsd::approximate(flat, {"x", -1, 1}, {"y", 0, 1}, {.max_degree = max_degree});
+    EXPECT_LE(low_2d.degree_x(), max_degree);
+    EXPECT_LE(low_2d.degree_y(), max_degree);
+  }
+}
+
+TEST(ChebyshevTest, batch) {
+  const auto series = fsd::approximate(parse("x / (2 + x**3)"), {"x", 0, 2});
+  std::vector<double> x(3 * fsd::ChebyshevSeries::BATCH_BLOCK_SIZE + 11);
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    x[i] = 2 * static_cast<double>(i) / static_cast<double>(x.size());
+  }
+  std::vector<double> result(x.size());
+  series.evaluate(x, result);
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    EXPECT_DOUBLE_EQ(result[i], series.evaluate(x[i]));
+  }
+}
+
+TEST(ChebyshevTest, derivative) {
+  const auto flat = parse("x / (2 + x**3)");
+  const auto series = fsd::approximate(flat, {"x", 0, 2}, {.tolerance = 1e-13});
+  const auto derivative = series.derivative();
+  EXPECT_EQ(derivative.degree(), series.degree() - 1);
+  EXPECT_TRUE(std::isnan(derivative.max_error()));
+  const auto exact = flat.derivative("x");
+  for (double x = 0; x <= 2; x += 0.125) {
+    EXPECT_NEAR(derivative.evaluate(x), exact.evaluate({{"x", x}}), 1e-9) << x;
+  }
+  // d/dx (x^3 - 2x + 1) = 3x^2 - 2, d^2/dx^2 = 6x
+  const auto cubic = fsd::approximate(parse("x**3 - 2*x + 1"), {"x", 0, 3});
+  EXPECT_NEAR(cubic.derivative().evaluate(2), 10, 1e-12);
+  EXPECT_NEAR(cubic.derivative().derivative().evaluate(2), 12, 1e-12);
+  EXPECT_NEAR(cubic.derivative().derivative().derivative().derivative().evaluate(1), 0, 1e-12);
+}
+
+TEST(ChebyshevTest, approximate_2d) {
+  const auto flat = parse("1 / (1 + x**2 + 2*y**2)");
+  const auto series = fsd::approximate(flat, {"x", -1, 1}, {"y", 0, 2}, {.tolerance = 1e-9});
+  EXPECT_LE(series.max_error(), 1e-9);
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<double> x(-1, 1);
+  std::uniform_real_distribution<double> y(0, 2);
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (int i = 0; i < 500; ++i) {
+    xs.push_back(x(generator));
+    ys.push_back(y(generator));
+  }
+  std::vector<double> result(xs.size());
+  series.evaluate(xs, ys, result);
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    const double expected = flat.evaluate({{"x", xs[i]}, {"y", ys[i]}});
+    EXPECT_NEAR(series.evaluate(xs[i], ys[i]), expected, 1e-9);
+    EXPECT_DOUBLE_EQ(result[i], series.evaluate(xs[i], ys[i]));
+  }
+
+  // the degrees adapt per variable: linear in x
+  const auto separable = fsd::approximate(parse("3*x + 1 / (1.5 + y)"), {"x", 0, 1}, {"y", -1, 1});
+  EXPECT_EQ(separable.degree_x(), 1);
+  EXPECT_GT(separable.degree_y(), 10);
+  EXPECT_LE(separable.max_error(), 1e-10);
+}
+
+TEST(ChebyshevTest, derivative_2d) {
+  const auto flat = parse("x**2 * y / (3 + x + y)");
+  const auto series = fsd::approximate(flat, {"x", 0, 1}, {"y", 0, 1}, {.tolerance = 1e-12});
+  const auto dx = series.derivative("x");
+  const auto dy = series.derivative(1);
+  EXPECT_EQ(dx.degree_x(), series.degree_x() - 1);
+  EXPECT_EQ(dy.degree_y(), series.degree_y() - 1);
+  const auto exact_dx = flat.derivative("x");
+  const auto exact_dy = flat.derivative("y");
+  for (double x = 0; x <= 1; x += 0.25) {
+    for (double y = 0; y <= 1; y += 0.25) {
+      EXPECT_NEAR(dx.evaluate(x, y), exact_dx.evaluate({{"x", x}, {"y", y}}), 1e-9);
+      EXPECT_NEAR(dy.evaluate(x, y), exact_dy.evaluate({{"x", x}, {"y", y}}), 1e-9);
+    }
+  }
+  EXPECT_THROW(static_cast<void>(series.derivative("z")), std::invalid_argument);
+}
+
+TEST(ChebyshevTest, errors) {
+  EXPECT_THROW(static_cast<void>(fsd::approximate(parse("x + y"), {"x", 0, 1})), std::invalid_argument);
+  EXPECT_THROW(static_cast<void>(fsd::approximate(parse("x"), {"x", 1, 0})), std::invalid_argument);
+  EXPECT_THROW(static_cast<void>(fsd::approximate(parse("1 / x"), {"x", -1, 1})), std::runtime_error);
+  EXPECT_THROW(static_cast<void>(fsd::approximate(parse("x*y"), {"x", 0, 1}, {"x", 0, 1})), std::invalid_argument);
+}
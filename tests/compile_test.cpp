@@ -0,0 +1,219 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/compile.h>
+#include <fsd/constant.h>
+#include <fsd/operations.h>
+#include <fsd/parser.h>
+#include <fsd/variable.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+
+namespace {
+
+fsd::Expression parse(std::string_view input) { return fsd::parse(input).value(); }
+
+std::size_t count(const fsd::Program& program, fsd::OpCode_TP op) {
+  return std::ranges::count_if(program.instructions(), [op](const fsd::Instruction& i) { return i.op == op; });
+}
+
+const std::map<std::string, double> VALUES {{"x", 1.5}, {"y", 0.75}, {"z", -2.0}};
+
+}  // namespace
+
+TEST(CompileTest, matches_flat) {
+  for (std::string_view input : {"x", "2.5", "x + y*z", "(x - y) / (z*z)", "x**3 - 2*x**2*y + z/4", "x**y + 1/x**2",
+                                  "((x*y) - (y*z)) * ((x*y) - (y*z))", "1 + x + y + z + x*y*z"}) {
+    const auto flat = fsd::flatten(*parse(input));
+    const auto program = fsd::compile(flat, {.verify = true});
+    EXPECT_NEAR(program.evaluate(VALUES), flat.evaluate(VALUES), 1e-12) << input;
+  }
+}
+
+TEST(CompileTest, passes) {
+  const auto flat = fsd::flatten(*(parse("x**5*y - (3*x*y + z/8)") + fsd::pow(fsd::variable("x"), fsd::constant(-2))));
+  const double expected = flat.evaluate(VALUES);
+  // every pass on its own and every pass left out
+  for (int mask = 0; mask < 32; ++mask) {
+    fsd::CompileOptions options {(mask & 1) != 0, (mask & 2) != 0, (mask & 4) != 0, (mask & 8) != 0, true,
+                                 (mask & 16) != 0};
+    EXPECT_NEAR(fsd::compile(flat, options).evaluate(VALUES), expected, 1e-12) << mask;
+  }
+}
+
+TEST(CompileTest, strength_reduction) {
+  auto program = fsd::compile(*parse("x**13"));
+  EXPECT_EQ(count(program, fsd::OpCode_TP::POW), 0);
+  // three squarings and two multiplications
+  EXPECT_EQ(count(program, fsd::OpCode_TP::MUL), 5);
+  EXPECT_DOUBLE_EQ(program.evaluate(VALUES), std::pow(1.5, 13));
+
+  const fsd::Expression x = fsd::variable("x");
+  program = fsd::compile(*(fsd::pow(x, fsd::constant(-3)) + fsd::pow(x, fsd::constant(0))));
+  EXPECT_EQ(count(program, fsd::OpCode_TP::POW), 0);
+  EXPECT_DOUBLE_EQ(program.evaluate(VALUES), std::pow(1.5, -3) + 1);
+
+  // only integer exponents are expanded
+  EXPECT_EQ(count(fsd::compile(*parse("x**0.5")), fsd::OpCode_TP::POW), 1);
+  EXPECT_EQ(count(fsd::compile(*parse("x**y")), fsd::OpCode_TP::POW), 1);
+
+  program = fsd::compile(*parse("x / 4"));
+  EXPECT_EQ(count(program, fsd::OpCode_TP::DIV), 0);
+  EXPECT_EQ(program.evaluate(VALUES), 1.5 * 0.25);
+  // division by zero keeps its semantics
+  EXPECT_EQ(count(fsd::compile(*parse("x / 0")), fsd::OpCode_TP::DIV), 1);
+}
+
+TEST(CompileTest, fma_fusion) {
+  auto program = fsd::compile(*parse("x*y + z"));
+  EXPECT_EQ(program.instructions().size(), 4);
+  EXPECT_EQ(count(program, fsd::OpCode_TP::FMA), 1);
+  EXPECT_DOUBLE_EQ(program.evaluate(VALUES), 1.5 * 0.75 - 2);
+
+  EXPECT_EQ(count(fsd::compile(*parse("x*y - z")), fsd::OpCode_TP::FMS), 1);
+  program = fsd::compile(*parse("z - x*y"));
+  EXPECT_EQ(count(program, fsd::OpCode_TP::FNMA), 1);
+  EXPECT_DOUBLE_EQ(program.evaluate(VALUES), -2 - 1.5 * 0.75);
+
+  // a shared product is not fused
+  const fsd::Expression xy = fsd::variable("x") * fsd::variable("y");
+  program = fsd::compile(*((xy + fsd::variable("z")) / xy));
+  EXPECT_EQ(count(program, fsd::OpCode_TP::FMA), 0);
+
+  program = fsd::compile(*parse("x*y + z"), {.fma_fusion = false});
+  EXPECT_EQ(count(program, fsd::OpCode_TP::FMA), 0);
+}
+
+TEST(CompileTest, common_subexpression_elimination) {
+  // the parser creates separate terms for both x*y
+  auto program = fsd::compile(*parse("(x*y + 1) * (y*x + 2)"));
+  // the shared product is fused into both sums
+  EXPECT_EQ(count(program, fsd::OpCode_TP::MUL), 1);
+  EXPECT_EQ(count(program, fsd::OpCode_TP::FMA), 2);
+  EXPECT_EQ(count(program, fsd::OpCode_TP::LOAD), 2);
+  EXPECT_EQ(count(fsd::compile(*parse("(x*y + 1) * (y*x + 2)"), {.common_subexpression_elimination = false}),
+                  fsd::OpCode_TP::LOAD),
+            4);
+  EXPECT_DOUBLE_EQ(program.evaluate(VALUES), (1.5 * 0.75 + 1) * (1.5 * 0.75 + 2));
+}
+
+TEST(CompileTest, dead_code_elimination) {
+  // the fused product is dead without elimination
+  EXPECT_EQ(fsd::compile(*parse("x*y + z"), {.dead_code_elimination = false}).instructions().size(), 5);
+  EXPECT_EQ(fsd::compile(*parse("x*y + z")).instructions().size(), 4);
+}
+
+TEST(CompileTest, register_reuse) {
+  std::string input = "x";
+  for (int i = 1; i <= 200; ++i) {
+    input += std::format(" + {}*x**2*y", i);
+  }
+  const auto flat = fsd::flatten(*parse(input));
+  const auto program = fsd::compile(flat, {.verify = true});
+  EXPECT_LE(program.registers(), 8);
+  EXPECT_GT(flat.size(), 100 * program.registers());
+  EXPECT_NEAR(program.evaluate(VALUES), flat.evaluate(VALUES), 1e-9 * std::abs(flat.evaluate(VALUES)));
+
+  const auto without = fsd::compile(flat, {.register_reuse = false});
+  EXPECT_EQ(without.registers(), without.instructions().size());
+  EXPECT_EQ(without.evaluate(VALUES), program.evaluate(VALUES));
+}
+
+TEST(CompileTest, batch) {
+  const auto program = fsd::compile(*parse("x**3 - 2*x*y + y/3"));
+  const std::size_t n = 3 * fsd::Program::BATCH_BLOCK_SIZE + 17;
+  std::vector<double> x(n);
+  std::vector<double> y(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = 0.01 * static_cast<double>(i);
+    y[i] = 1 - 0.003 * static_cast<double>(i);
+  }
+  std::vector<const double*> columns(program.symbols().size());
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    columns[i] = program.symbols()[i] == "x" ? x.data() : y.data();
+  }
+  std::vector<double> result(n);
+  program.evaluate(columns, result);
+  for (std::size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(result[i], program.evaluate({{"x", x[i]}, {"y", y[i]}}));
+  }
+}
+
+TEST(CompileTest, to_str) {
+  const auto program = fsd::compile(*parse("x*y + 2.5"));
+  EXPECT_EQ(program.to_str(), "r0 = x\nr1 = y\nr2 = 2.5\nr2 = fma(r0, r1, r2)\nreturn r2");
+}
+
+TEST(CompileTest, missing_variable) {
+  EXPECT_THROW(static_cast<void>(fsd::compile(*parse("x + y")).evaluate({{"x", 1}})), std::runtime_error);
+}
+
+TEST(KernelTest, derivatives) {
+  const auto f = parse("x**3*y + (x*y - z) / (x*x + y*y)");
+  const std::vector<fsd::Expression> outputs {f, f->derivative("x"), f->derivative("y")};
+  const auto kernel = fsd::compile_kernel(outputs, {.verify = true});
+  ASSERT_EQ(kernel.outputs().size(), 3);
+  const auto values = kernel.evaluate(VALUES);
+  for (std::size_t i = 0; i < outputs.size(); ++i) {
+    EXPECT_NEAR(values[i], outputs[i]->evaluate(VALUES), 1e-12) << i;
+  }
+  // the derivatives contain all subexpressions of f, so f is computed for free
+  EXPECT_GE(kernel.saved_operations(), fsd::compile(*f).operations());
+  EXPECT_EQ(kernel.saved_operations(), kernel.separate_operations() - kernel.operations());
+}
+
+TEST(KernelTest, shared_fused_product) {
+  // compiled separately both outputs are one fma, the product they share is fused into both instead of computed once
+  const std::vector<fsd::Expression> outputs {parse("x*y + 1"), parse("x*y + 2")};
+  const auto kernel = fsd::compile_kernel(outputs, {.verify = true});
+  EXPECT_EQ(kernel.separate_operations(), 2);
+  EXPECT_EQ(kernel.operations(), 2);
+  EXPECT_EQ(kernel.saved_operations(), 0);
+  EXPECT_EQ(kernel.evaluate(VALUES), (std::vector<double> {1.5 * 0.75 + 1, 1.5 * 0.75 + 2}));
+
+  // a product also used elsewhere is computed once
+  const auto program = fsd::compile(*parse("(x*y + 1) * (x*y)"));
+  EXPECT_EQ(count(program, fsd::OpCode_TP::FMA), 0);
+  EXPECT_EQ(count(program, fsd::OpCode_TP::MUL), 2);
+}
+
+TEST(KernelTest, symbols) {
+  // symbols are merged by name, z only occurs in the second output
+  const std::vector<fsd::Expression> outputs {parse("y*x"), parse("(x*y) / z"), parse("2.5")};
+  const auto kernel = fsd::compile_kernel(outputs);
+  EXPECT_EQ(kernel.symbols(), (std::vector<std::string> {"y", "x", "z"}));
+  EXPECT_EQ(kernel.operations(), 2);
+  EXPECT_EQ(kernel.separate_operations(), 3);
+  EXPECT_EQ(kernel.evaluate(VALUES), (std::vector<double> {1.5 * 0.75, 1.5 * 0.75 / -2, 2.5}));
+  EXPECT_THROW(static_cast<void>(kernel.evaluate({{"x", 1}, {"y", 2}})), std::runtime_error);
+}
+
+TEST(KernelTest, batch) {
+  const auto f = parse("x**2*y - y/x");
+  const std::vector<fsd::Expression> outputs {f, f->derivative("x"), f->derivative("y")};
+  const auto kernel = fsd::compile_kernel(outputs);
+  const std::size_t n = 2 * fsd::Program::BATCH_BLOCK_SIZE + 5;
+  std::vector<double> x(n);
+  std::vector<double> y(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = 0.5 + 0.01 * static_cast<double>(i);
+    y[i] = 2 - 0.004 * static_cast<double>(i);
+  }
+  std::vector<const double*> columns(kernel.symbols().size());
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    columns[i] = kernel.symbols()[i] == "x" ? x.data() : y.data();
+  }
+  std::vector<std::vector<double>> results(3, std::vector<double>(n));
+  const std::vector<double*> pointers {results[0].data(), results[1].data(), results[2].data()};
+  kernel.evaluate(columns, pointers, n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto expected = kernel.evaluate({{"x", x[i]}, {"y", y[i]}});
+    for (std::size_t j = 0; j < 3; ++j) {
+      EXPECT_EQ(results[j][i], expected[j]);
+    }
+  }
+}
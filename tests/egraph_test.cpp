@@ -0,0 +1,102 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/egraph.h>
+#include <fsd/parser.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+fsd::Expression parse(std::string_view input) { return fsd::parse(input).value(); }
+
+}  // namespace
+
+TEST(EGraphTest, factoring) {
+  auto result = fsd::optimize(*parse("(a*x) + (a*y)"));
+  EXPECT_TRUE(result.saturated);
+  // a * (x + y) or a * (y + x)
+  EXPECT_EQ(result.expr.size(), 5);
+  EXPECT_EQ(result.expr.nodes()[result.expr.root()].type, fsd::Node_TP::MUL);
+  EXPECT_DOUBLE_EQ(result.cost_after, 3 * 0.3 + 1 + 1.1);
+  // the input holds two separate a variables
+  EXPECT_DOUBLE_EQ(result.cost_before, 4 * 0.3 + 1 + 2 * 1.1);
+}
+
+TEST(EGraphTest, powers) {
+  EXPECT_EQ(fsd::optimize(*parse("x**2")).expr.to_str(), "(x * x)");
+  // x^8 as three squarings
+  auto result = fsd::optimize(*parse("x**8"));
+  EXPECT_DOUBLE_EQ(result.cost_after, 0.3 + 3 * 1.1);
+  EXPECT_DOUBLE_EQ(result.expr.evaluate({{"x", 1.5}}), std::pow(1.5, 8));
+}
+
+TEST(EGraphTest, fractional_powers) {
+  // x^0.5 * x^0.5 is NaN for x < 0, x is not
+  auto result = fsd::optimize(*parse("x**0.5 * x**0.5"));
+  EXPECT_TRUE(std::isnan(result.expr.evaluate({{"x", -2.0}})));
+  EXPECT_DOUBLE_EQ(result.expr.evaluate({{"x", 2.0}}), 2.0);
+  // x^-1 * x is NaN for x = 0, 1 is not
+  result = fsd::optimize(*(fsd::pow(fsd::variable("x"), fsd::constant(-1)) * parse("x")));
+  EXPECT_TRUE(std::isnan(result.expr.evaluate({{"x", 0.0}})));
+  EXPECT_DOUBLE_EQ(result.expr.evaluate({{"x", 4.0}}), 1.0);
+  // integral exponents of the same sign are still merged
+  result = fsd::optimize(*parse("x**3 * x"));
+  EXPECT_DOUBLE_EQ(result.cost_after, 0.3 + 2 * 1.1);
+}
+
+TEST(EGraphTest, identities) {
+  EXPECT_EQ(fsd::optimize(*parse("(x*1 + 0*y) - (z - z)")).expr.to_str(), "x");
+  EXPECT_EQ(fsd::optimize(*parse("2*3 + x/1")).expr.to_str(), "(6 + x)");
+}
+
+TEST(EGraphTest, derivative) {
+  // derivatives built by the term rules contain lots of redundant work
+  auto expr = parse("(x**3 + 2*x*y - y/4) * (x - y)");
+  auto flat = fsd::flatten(*expr->derivative("x"));
+  auto result = fsd::optimize(flat);
+  EXPECT_LT(result.cost_after, 0.5 * result.cost_before);
+  for (double x : {-1.5, 0.25, 3.0}) {
+    const std::map<std::string, double> values {{"x", x}, {"y", 0.75}};
+    EXPECT_NEAR(result.expr.evaluate(values), flat.evaluate(values), 1e-12);
+  }
+}
+
+TEST(EGraphTest, costs) {
+  // a node without cost makes cycles in the e-graph free, extraction would not terminate
+  auto expr = parse("x * y");
+  EXPECT_THROW(static_cast<void>(fsd::optimize(*expr, {.costs = {.mul = 0}})), std::invalid_argument);
+  EXPECT_THROW(static_cast<void>(fsd::optimize(*expr, {.costs = {.variable = -1}})), std::invalid_argument);
+  EXPECT_THROW(static_cast<void>(fsd::optimize(*expr, {.costs = {.pow = std::nan("")}})), std::invalid_argument);
+}
+
+TEST(EGraphTest, budgets) {
+  // associativity and commutativity alone create exponentially many forms of a long sum
+  auto expr = parse("a + b + c + d + e + f + g + h + i + j + k + l");
+  auto result = fsd::optimize(*expr, {.max_nodes = 500});
+  EXPECT_FALSE(result.saturated);
+  EXPECT_LE(result.cost_after, result.cost_before);
+  EXPECT_EQ(result.expr.evaluate<double>(std::vector<double>(12, 1.0)), 12);
+
+  result = fsd::optimize(*expr, {.max_iterations = 1});
+  EXPECT_EQ(result.iterations, 1);
+
+  // without time no rule is applied, the input is returned
+  result = fsd::optimize(*expr, {.max_time = std::chrono::milliseconds(0)});
+  EXPECT_EQ(result.iterations, 0U);
+  EXPECT_FALSE(result.saturated);
+  EXPECT_EQ(result.cost_after, result.cost_before);
+  EXPECT_EQ(result.expr.evaluate<double>(std::vector<double>(12, 1.0)), 12);
+
+  // only the time limits the rewriting, it stops within the iteration running out of it
+  const auto start = std::chrono::steady_clock::now();
+  result = fsd::optimize(*expr, {.max_nodes = 100'000'000, .max_time = std::chrono::milliseconds(20),
+                                 .max_iterations = 1'000});
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+  EXPECT_FALSE(result.saturated);
+  EXPECT_EQ(result.expr.evaluate<double>(std::vector<double>(12, 1.0)), 12);
+}
@@ -0,0 +1,181 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/flat.h>
+#include <fsd/operations.h>
+#include <fsd/parser.h>
+#include <fsd/variable.h>
+#include <gtest/gtest.h>
+
+TEST(FlatExpressionTest, flatten) {
+  fsd::Expression x = fsd::variable("x");
+  fsd::Expression shared = x * x;
+  fsd::Expression expr = shared + shared;
+  auto flat = fsd::flatten(*expr);
+  // x, x * x and the addition: shared subterms are stored once
+  EXPECT_EQ(flat.size(), 3);
+  EXPECT_EQ(flat.symbols(), std::vector<std::string>({"x"}));
+  EXPECT_EQ(flat.nodes()[flat.root()], fsd::Node(fsd::Node_TP::ADD, 1, 1));
+}
+
+TEST(FlatExpressionTest, evaluate) {
+  auto expr = fsd::parse("x**3 + 2*x*y - y/4");
+  ASSERT_TRUE(expr.has_value());
+  auto flat = fsd::flatten(*expr.value());
+  const std::map<std::string, double> values {{"x", 1.5}, {"y", -2}};
+  EXPECT_DOUBLE_EQ(flat.evaluate(values), expr.value()->evaluate(values));
+
+  std::vector<double> by_id(flat.symbols().size());
+  by_id[flat.symbol_id("x").value()] = 1.5;
+  by_id[flat.symbol_id("y").value()] = -2;
+  std::vector<double> scratch(flat.size());
+  EXPECT_DOUBLE_EQ(flat.evaluate(by_id, scratch), expr.value()->evaluate(values));
+
+  EXPECT_THROW(static_cast<void>(flat.evaluate(std::map<std::string, double> {{"x", 1}})), std::runtime_error);
+}
+
+TEST(FlatExpressionTest, to_str) {
+  auto expr = fsd::parse("x**3 + 2.5*x - 4/y");
+  ASSERT_TRUE(expr.has_value());
+  EXPECT_EQ(fsd::flatten(*expr.value()).to_str(), expr.value()->to_str());
+}
+
+TEST(FlatExpressionTest, derivative) {
+  auto expr = fsd::parse("x**3 + 2*x*y - y/x + 7");
+  ASSERT_TRUE(expr.has_value());
+  auto flat = fsd::flatten(*expr.value());
+  const std::map<std::string, double> values {{"x", 1.5}, {"y", -2}};
+  EXPECT_DOUBLE_EQ(flat.derivative("x").evaluate(values), expr.value()->derivative("x")->evaluate(values));
+  EXPECT_DOUBLE_EQ(flat.derivative("y").evaluate(values), expr.value()->derivative("y")->evaluate(values));
+  // symbol ids are kept stable, even if the derivative no longer depends on a variable
+  EXPECT_EQ(flat.derivative("y").symbols(), flat.symbols());
+  EXPECT_EQ(flat.derivative("z").to_str(), "0");
+  EXPECT_EQ(fsd::flatten(*fsd::parse("3*x").value()).derivative("x").to_str(), "3");
+}
+
+TEST(FlatExpressionTest, to_expression) {
+  auto expr = fsd::parse("x**3 + 2*x*y - y/4.5");
+  ASSERT_TRUE(expr.has_value());
+  auto flat = fsd::flatten(*expr.value());
+  EXPECT_EQ(flat.to_expression()->to_str(), expr.value()->to_str());
+}
+
+TEST(FlatExpressionTest, deep_expression) {
+  fsd::FlatExpression flat;
+  const std::uint32_t x = flat.emplace_variable(flat.intern("x"));
+  std::uint32_t sum = flat.emplace_constant(0, true);
+  for (int i = 0; i < 1'000'000; ++i) {
+    sum = flat.emplace(fsd::Node_TP::ADD, sum, x);
+  }
+  EXPECT_DOUBLE_EQ(flat.evaluate(std::map<std::string, double> {{"x", 0.5}}), 500'000);
+  EXPECT_DOUBLE_EQ(flat.derivative("x").evaluate(std::map<std::string, double> {{"x", 0.5}}), 1'000'000);
+}
+
+TEST(FlatExpressionTest, evaluate_batch) {
+  auto expr = fsd::parse("x**2 + 3*x*y - 4");
+  ASSERT_TRUE(expr.has_value());
+  auto flat = fsd::flatten(*expr.value());
+  // more points than one block, and a partial last block
+  const std::size_t n = fsd::FlatExpression::BATCH_BLOCK_SIZE * 2 + 17;
+  std::vector<double> x(n);
+  std::vector<double> y(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = 0.25 * static_cast<double>(i);
+    y[i] = 3.0 - static_cast<double>(i);
+  }
+  std::vector<const double*> columns(flat.symbols().size());
+  columns[flat.symbol_id("x").value()] = x.data();
+  columns[flat.symbol_id("y").value()] = y.data();
+  std::vector<double> result(n);
+  flat.evaluate(columns, result);
+  for (std::size_t i = 0; i < n; ++i) {
+    EXPECT_DOUBLE_EQ(result[i], expr.value()->evaluate({{"x", x[i]}, {"y", y[i]}}));
+  }
+}
+
+TEST(FlatExpressionTest, evaluate_empty) {
+  // a default constructed expression has no root node, every evaluate() returns 0
+  const fsd::FlatExpression flat;
+  EXPECT_EQ(flat.evaluate(std::map<std::string, double> {}), 0);
+  EXPECT_EQ(flat.evaluate(std::span<const double> {}), 0);
+  EXPECT_EQ(flat.evaluate<float>(std::span<const float> {}, std::span<float> {}), 0);
+  std::vector<double> result(fsd::FlatExpression::BATCH_BLOCK_SIZE + 3, 1.0);
+  flat.evaluate(std::span<const double* const> {}, result);
+  EXPECT_EQ(result, std::vector<double>(result.size(), 0.0));
+}
+
+namespace {
+
+// minimal user supplied scalar type: counts the number of multiplications
+struct Counted {
+  explicit Counted(double v = 0) : value(v) {}
+  double value;
+  inline static int multiplications = 0;
+
+  friend Counted operator+(Counted a, Counted b) { return Counted(a.value + b.value); }
+  friend Counted operator-(Counted a, Counted b) { return Counted(a.value - b.value); }
+  friend Counted operator*(Counted a, Counted b) {
+    multiplications++;
+    return Counted(a.value * b.value);
+  }
+  friend Counted operator/(Counted a, Counted b) { return Counted(a.value / b.value); }
+  friend Counted pow(Counted a, Counted b) { return Counted(std::pow(a.value, b.value)); }
+};
+
+}  // namespace
+
+TEST(FlatExpressionTest, evaluate_scalar_types) {
+  auto expr = fsd::parse("x**3 + (x*y - y/3)").value();
+  auto flat = fsd::flatten(*expr);
+  const double expected = expr->evaluate({{"x", 1.25}, {"y", -2}});
+
+  EXPECT_NEAR(flat.evaluate<float>({{"x", 1.25f}, {"y", -2.0f}}), expected, 1e-5);
+  EXPECT_NEAR(static_cast<double>(flat.evaluate<long double>({{"x", 1.25L}, {"y", -2.0L}})), expected, 1e-15);
+  EXPECT_NEAR(fsd::evaluate<float>(*expr, {{"x", 1.25f}, {"y", -2.0f}}), expected, 1e-5);
+
+  Counted::multiplications = 0;
+  const Counted counted = flat.evaluate<Counted>({{"x", Counted(1.25)}, {"y", Counted(-2)}});
+  EXPECT_DOUBLE_EQ(counted.value, expected);
+  EXPECT_EQ(Counted::multiplications, 1);
+
+  std::vector<float> x {1.25f, 2.0f};
+  std::vector<float> y {-2.0f, 0.5f};
+  std::vector<const float*> columns(2);
+  columns[flat.symbol_id("x").value()] = x.data();
+  columns[flat.symbol_id("y").value()] = y.data();
+  std::vector<float> result(2);
+  flat.evaluate<float>(columns, result);
+  EXPECT_NEAR(result[0], expected, 1e-5);
+  EXPECT_NEAR(result[1], expr->evaluate({{"x", 2}, {"y", 0.5}}), 1e-5);
+}
+
+TEST(FlatExpressionTest, nary) {
+  fsd::Expression x = fsd::variable("x");
+  fsd::Expression y = fsd::variable("y");
+  fsd::Expression expr = fsd::sum({fsd::product({x, y, x, fsd::constant(3)}), y, fsd::constant(1)});
+  auto flat = fsd::flatten(*expr);
+  EXPECT_EQ(flat.nodes()[flat.root()].type, fsd::Node_TP::SUM);
+  EXPECT_EQ(flat.to_str(), "((x * y * x * 3) + y + 1)");
+  EXPECT_EQ(flat.to_expression()->to_str(), expr->to_str());
+
+  const std::map<std::string, double> values {{"x", 2}, {"y", -3}};
+  EXPECT_DOUBLE_EQ(flat.evaluate(values), expr->evaluate(values));
+  // d/dx 3 * x^2 * y + y + 1 and d/dy
+  EXPECT_DOUBLE_EQ(flat.derivative("x").evaluate(values), 6 * 2 * -3);
+  EXPECT_DOUBLE_EQ(flat.derivative("y").evaluate(values), 3 * 4 + 1);
+  EXPECT_EQ(flat.derivative("z").to_str(), "0");
+
+  std::vector<double> xs(300);
+  std::vector<double> ys(300);
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    xs[i] = 0.01 * i;
+    ys[i] = 2 - 0.02 * i;
+  }
+  const double* columns[] = {xs.data(), ys.data()};
+  std::vector<double> result(xs.size());
+  flat.evaluate<double>(columns, result);
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    EXPECT_DOUBLE_EQ(result[i], flat.evaluate(std::map<std::string, double> {{"x", xs[i]}, {"y", ys[i]}}));
+  }
+}
@@ -0,0 +1,172 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// FSD_EVAL is the path of the fsd_eval executable, defined by CMake
+
+namespace {
+
+namespace fs = std::filesystem;
+
+class FsdEvalTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    _directory = fs::temp_directory_path() / ("fsd_eval_test_" + std::to_string(::getpid()));
+    fs::create_directories(_directory);
+  }
+  void TearDown() override { fs::remove_all(_directory); }
+
+  [[nodiscard]] std::string path(const std::string& name) const { return (_directory / name).string(); }
+
+  /// runs fsd_eval with arguments and returns its exit code
+  [[nodiscard]] int run(const std::string& arguments) const {
+    const std::string command = std::string(FSD_EVAL) + " " + arguments + " 2>" + path("stderr.txt");
+    const int status = std::system(command.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  }
+
+  [[nodiscard]] std::string read_text(const std::string& name) const {
+    std::ifstream file(path(name));
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+  }
+
+ private:
+  fs::path _directory;
+};
+
+struct Columnar {
+  std::vector<std::string> names;
+  std::vector<std::vector<double>> columns;
+};
+
+// see the format description in tools/fsd_eval.cpp
+std::string header(std::uint64_t rows, const std::vector<std::string>& names) {
+  std::string result("FSDCOL1\0", 8);
+  auto append = [&result](const void* data, std::size_t size) {
+    result.append(static_cast<const char*>(data), size);
+  };
+  const auto columns = static_cast<std::uint32_t>(names.size());
+  const std::uint32_t reserved = 0;
+  append(&rows, sizeof(rows));
+  append(&columns, sizeof(columns));
+  append(&reserved, sizeof(reserved));
+  for (const auto& name : names) {
+    const auto length = static_cast<std::uint32_t>(name.size());
+    append(&length, sizeof(length));
+    append(name.data(), name.size());
+  }
+  result.resize((result.size() + 7) / 8 * 8, '\0');
+  return result;
+}
+
+void write_columnar(const std::string& path, const Columnar& data) {
+  std::ofstream file(path, std::ios::binary);
+  file << header(data.columns.front().size(), data.names);
+  for (const auto& column : data.columns) {
+    file.write(reinterpret_cast<const char*>(column.data()), static_cast<std::streamsize>(column.size() * 8));
+  }
+}
+
+Columnar read_columnar(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[8];
+  std::uint64_t rows;
+  std::uint32_t columns;
+  std::uint32_t reserved;
+  file.read(magic, 8);
+  file.read(reinterpret_cast<char*>(&rows), sizeof(rows));
+  file.read(reinterpret_cast<char*>(&columns), sizeof(columns));
+  file.read(reinterpret_cast<char*>(&reserved), sizeof(reserved));
+  Columnar result;
+  std::size_t size = 24;
+  for (std::uint32_t i = 0; i < columns; ++i) {
+    std::uint32_t length;
+    file.read(reinterpret_cast<char*>(&length), sizeof(length));
+    std::string name(length, '\0');
+    file.read(name.data(), length);
+    result.names.push_back(name);
+    size += 4 + length;
+  }
+  file.ignore(static_cast<std::streamsize>((size + 7) / 8 * 8 - size));
+  for (std::uint32_t i = 0; i < columns; ++i) {
+    std::vector<double> column(rows);
+    file.read(reinterpret_cast<char*>(column.data()), static_cast<std::streamsize>(rows * 8));
+    result.columns.push_back(std::move(column));
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST_F(FsdEvalTest, csv) {
+  std::ofstream(path("in.csv")) << "x, y\n1, 2\n\n-0.5, 4\n3,0.25\n";
+  ASSERT_EQ(run("-i " + path("in.csv") + " -o " + path("out.csv") + " -d x -d y -b 2 -t 2 \"x**2*y + 3*x\""), 0);
+  EXPECT_EQ(read_text("out.csv"), "f,df/dx,df/dy\n5,7,1\n-0.5,-1,0.25\n11.25,4.5,9\n");
+  EXPECT_NE(read_text("stderr.txt").find("3 rows"), std::string::npos);
+
+  std::ofstream(path("bad.csv")) << "x\n1\nfoo\n";
+  EXPECT_EQ(run("-i " + path("bad.csv") + " -o " + path("out.csv") + " x"), 1);
+  EXPECT_NE(read_text("stderr.txt").find("invalid number 'foo' in row 2"), std::string::npos);
+  EXPECT_EQ(run("-i " + path("in.csv") + " -o " + path("out.csv") + " z"), 1);
+}
+
+TEST_F(FsdEvalTest, columnar) {
+  Columnar input {{"y", "x"}, {{}, {}}};
+  for (int i = 0; i < 1000; ++i) {
+    input.columns[0].push_back(0.5 * i);
+    input.columns[1].push_back(i - 500);
+  }
+  write_columnar(path("in.fsdc"), input);
+  ASSERT_EQ(run("-i " + path("in.fsdc") + " -o " + path("out.fsdc") + " -d x -b 64 -t 4 \"x*y - x\""), 0);
+  const Columnar output = read_columnar(path("out.fsdc"));
+  ASSERT_EQ(output.names, (std::vector<std::string> {"f", "df/dx"}));
+  ASSERT_EQ(output.columns[0].size(), 1000);
+  for (std::size_t i = 0; i < 1000; ++i) {
+    const double x = input.columns[1][i];
+    const double y = input.columns[0][i];
+    EXPECT_EQ(output.columns[0][i], x * y - x);
+    EXPECT_EQ(output.columns[1][i], y - 1);
+  }
+}
+
+TEST_F(FsdEvalTest, invalid_columnar) {
+  // magic only
+  std::ofstream(path("short.fsdc"), std::ios::binary) << std::string("FSDCOL1\0", 8);
+  EXPECT_EQ(run("-i " + path("short.fsdc") + " -o " + path("out.fsdc") + " x"), 1);
+  EXPECT_NE(read_text("stderr.txt").find("truncated columnar header"), std::string::npos);
+
+  // a row count whose data size overflows
+  std::ofstream(path("huge.fsdc"), std::ios::binary) << header((std::uint64_t {1} << 61) + 1, {"x"})
+                                                     << std::string(64, '\0');
+  EXPECT_EQ(run("-i " + path("huge.fsdc") + " -o " + path("out.fsdc") + " x"), 1);
+  EXPECT_NE(read_text("stderr.txt").find("truncated columnar data"), std::string::npos);
+
+  std::ofstream(path("empty.fsdc"), std::ios::binary) << header(5, {});
+  EXPECT_EQ(run("-i " + path("empty.fsdc") + " -o " + path("out.fsdc") + " 1"), 1);
+}
+
+TEST_F(FsdEvalTest, same_input_and_output) {
+  write_columnar(path("in.fsdc"), {{"x"}, {{1, 2, 3}}});
+  EXPECT_EQ(run("-i " + path("in.fsdc") + " -o " + path("in.fsdc") + " x"), 1);
+  EXPECT_NE(read_text("stderr.txt").find("same file"), std::string::npos);
+  fs::create_symlink(path("in.fsdc"), path("link.fsdc"));
+  EXPECT_EQ(run("-i " + path("in.fsdc") + " -o " + path("link.fsdc") + " x"), 1);
+  // the input is untouched
+  EXPECT_EQ(read_columnar(path("in.fsdc")).columns[0], (std::vector<double> {1, 2, 3}));
+}
@@ -0,0 +1,51 @@
+# Copyright: Leon Freist, 2024
+# Author   : Leon Freist
+# License  : MIT
+
+# Smoke test of the Python bindings, run by ctest if BUILD_PYTHON_BINDINGS is ON. Uses array.array as float64 buffer,
+# so it does not depend on NumPy.
+
+import array
+import unittest
+
+import fsd
+
+
+class FsdModuleTest(unittest.TestCase):
+    def test_scalar(self):
+        f = fsd.parse("x**2 + 3*x*y")
+        self.assertEqual(f.variables, ("x", "y"))
+        self.assertAlmostEqual(f.evaluate(x=2, y=1.5), 13)
+        self.assertAlmostEqual(f.derivative("x").evaluate(x=2, y=1.5), 8.5)
+
+    def test_batch(self):
+        f = fsd.parse("x*y - x")
+        x = array.array("d", [float(i) for i in range(1000)])
+        y = array.array("d", [0.5] * 1000)
+        values = f.evaluate(x=x, y=y)
+        self.assertEqual(len(values), 1000)
+        self.assertAlmostEqual(values[10], -5)
+        # scalars are broadcast, results can be written in place
+        out = array.array("d", [0.0] * 1000)
+        f.evaluate(x=x, y=2, out=out)
+        self.assertAlmostEqual(out[10], 10)
+
+    def test_errors(self):
+        f = fsd.parse("x + y")
+        with self.assertRaises(ValueError):
+            fsd.parse("x +")
+        with self.assertRaises(TypeError):
+            f.evaluate(x=1)
+        with self.assertRaises(TypeError):
+            f.evaluate(x=1, y=2, z=3)
+        with self.assertRaises(ValueError):
+            f.evaluate(x=array.array("d", [1, 2]), y=array.array("d", [1]))
+        with self.assertRaises(TypeError):
+            f.evaluate(x=array.array("i", [1, 2]), y=1)
+        # exceptions of the C++ library become Python errors
+        with self.assertRaises(ValueError):
+            fsd.parse("x**x").derivative("x")
+
+
+if __name__ == "__main__":
+    unittest.main()
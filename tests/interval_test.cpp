@@ -0,0 +1,212 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/compile.h>
+#include <fsd/flat.h>
+#include <fsd/interval.h>
+#include <fsd/literal.h>
+#include <fsd/parser.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <random>
+
+using fsd::Interval;
+
+namespace {
+
+constexpr double INF = std::numeric_limits<double>::infinity();
+
+// x is an enclosure of [lower, upper] that is at most a few ulps wider
+void expect_tight(const Interval& x, double lower, double upper) {
+  EXPECT_TRUE(x.contains(Interval(lower, upper))) << x.to_str();
+  EXPECT_LE(x.upper() - upper, 8 * std::numeric_limits<double>::epsilon() * std::max(1.0, std::abs(upper)))
+      << x.to_str();
+  EXPECT_LE(lower - x.lower(), 8 * std::numeric_limits<double>::epsilon() * std::max(1.0, std::abs(lower)))
+      << x.to_str();
+}
+
+}  // namespace
+
+TEST(IntervalTest, arithmetic) {
+  // exact results are not widened
+  EXPECT_EQ(Interval(1, 2) + Interval(-3, 0.5), Interval(-2, 2.5));
+  EXPECT_EQ(Interval(1, 2) - Interval(-3, 0.5), Interval(0.5, 5));
+  EXPECT_EQ(Interval(-1, 2) * Interval(-3, 0.5), Interval(-6, 3));
+  EXPECT_EQ(Interval(1, 2) / Interval(4, 8), Interval(0.125, 0.5));
+  EXPECT_EQ(-Interval(1, 2), Interval(-2, -1));
+  EXPECT_EQ(Interval(0, 1) * Interval(0.1, 0.3), Interval(0, 0.3));
+  EXPECT_TRUE((Interval(1, 2) / Interval(-1, 1)).is_entire());
+  EXPECT_TRUE((Interval(1, 2) / Interval(0)).is_entire());
+  // 0 * inf is 0 for bounds
+  EXPECT_EQ(Interval(0, 1) * Interval(1, INF), Interval(0, INF));
+  EXPECT_TRUE((Interval(-INF, 0) + Interval(INF)).is_entire());
+  EXPECT_THROW(Interval(2, 1), std::invalid_argument);
+}
+
+TEST(IntervalTest, outward_rounding) {
+  // 0.1 + 0.2 is not representable, the enclosure must contain the exact sum of both doubles, which long double holds
+  const Interval sum = Interval(0.1) + Interval(0.2);
+  EXPECT_LE(sum.lower(), 0.1L + 0.2L);
+  EXPECT_GE(sum.upper(), 0.1L + 0.2L);
+  EXPECT_LT(sum.lower(), sum.upper());
+  const Interval third = Interval(1) / Interval(3);
+  EXPECT_LE(third.lower(), 1.0L / 3);
+  EXPECT_GE(third.upper(), 1.0L / 3);
+  // rounding is directed, not widened: the bounds are neighbours
+  EXPECT_EQ(std::nextafter(sum.lower(), INF), sum.upper());
+  EXPECT_EQ(std::nextafter(third.lower(), INF), third.upper());
+  const Interval root = fsd::sqrt(Interval(2));
+  EXPECT_EQ(std::nextafter(root.lower(), INF), root.upper());
+  EXPECT_EQ(fsd::sqrt(Interval(0, 4)), Interval(0, 2));
+  const Interval product = Interval(0.1) * Interval(0.1);
+  EXPECT_LT(product.lower(), product.upper());
+  EXPECT_TRUE(product.contains(0.1 * 0.1));
+}
+
+TEST(IntervalTest, pow) {
+  // integer powers are exact if representable
+  EXPECT_EQ(fsd::pow(Interval(-2, 1), Interval(2)), Interval(0, 4));
+  EXPECT_EQ(fsd::pow(Interval(-2, 1), Interval(3)), Interval(-8, 1));
+  EXPECT_EQ(fsd::pow(Interval(-3, -2), Interval(2)), Interval(4, 9));
+  // (1 + 2^-20)^3 needs 61 bits, long double holds it exactly
+  constexpr double x = 1 + 0x1p-20;
+  const Interval cube = fsd::pow(Interval(x), Interval(3));
+  const long double exact = static_cast<long double>(x) * x * x;
+  EXPECT_LE(cube.lower(), exact);
+  EXPECT_GE(cube.upper(), exact);
+  EXPECT_LT(cube.lower(), cube.upper());
+  expect_tight(fsd::pow(Interval(2, 4), Interval(-1)), 0.25, 0.5);
+  expect_tight(fsd::pow(Interval(-2, 1), Interval(0)), 1, 1);
+  expect_tight(fsd::pow(Interval(1, 4), Interval(0.5, 2)), 1, 16);
+  expect_tight(fsd::pow(Interval(0.25, 4), Interval(0.5)), 0.5, 2);
+  // negative bases are outside the domain of real exponents
+  expect_tight(fsd::pow(Interval(-4, 4), Interval(0.5)), 0, 2);
+  EXPECT_TRUE(fsd::pow(Interval(-4, -1), Interval(0.5)).is_entire());
+  EXPECT_TRUE(fsd::pow(Interval(-1, 1), Interval(-2)).is_entire());
+}
+
+TEST(IntervalTest, functions) {
+  constexpr double pi = std::numbers::pi;
+  expect_tight(fsd::exp(Interval(0, 1)), 1, std::numbers::e);
+  expect_tight(fsd::sqrt(Interval(-1, 4)), 0, 2);
+  EXPECT_TRUE(fsd::sqrt(Interval(-2, -1)).is_entire());
+
+  expect_tight(fsd::sin(Interval(0, 1)), 0, std::sin(1.0));
+  expect_tight(fsd::sin(Interval(1, 2)), std::sin(1.0), 1);
+  expect_tight(fsd::sin(Interval(4, 5)), -1, std::sin(4.0));
+  EXPECT_EQ(fsd::sin(Interval(0, 7)), Interval(-1, 1));
+  expect_tight(fsd::cos(Interval(-1, 1)), std::cos(1.0), 1);
+  expect_tight(fsd::cos(Interval(3, 3.5)), -1, std::cos(3.5));
+
+  expect_tight(fsd::tan(Interval(-1, 1)), std::tan(-1.0), std::tan(1.0));
+  EXPECT_TRUE(fsd::tan(Interval(1, 2)).is_entire());
+
+  expect_tight(fsd::asin(Interval(-0.5, 2)), -pi / 6, pi / 2);
+  expect_tight(fsd::acos(Interval(-1, 0.5)), pi / 3, pi);
+  expect_tight(fsd::atan(Interval(-INF, 1)), -pi / 2, pi / 4);
+  EXPECT_TRUE(fsd::asin(Interval(2, 3)).is_entire());
+}
+
+TEST(IntervalTest, enclosure) {
+  // the enclosure contains every sampled point of the box
+  const auto expr = fsd::parse("x**3 - 2*x*y + y/(x + 3) - (x - y)**2").value();
+  const auto flat = fsd::flatten(*expr);
+  const Interval range = flat.evaluate<Interval>({{"x", {-1, 2}}, {"y", {0.5, 1.5}}});
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> x(-1, 2);
+  std::uniform_real_distribution<double> y(0.5, 1.5);
+  for (int i = 0; i < 1000; ++i) {
+    const double value = flat.evaluate({{"x", x(generator)}, {"y", y(generator)}});
+    EXPECT_TRUE(range.contains(value)) << value << " " << range.to_str();
+  }
+  // a degenerate box gives the point value
+  const Interval point = fsd::evaluate<Interval>(*expr, {{"x", 1.5}, {"y", 0.75}});
+  EXPECT_TRUE(point.contains(expr->evaluate({{"x", 1.5}, {"y", 0.75}})));
+  EXPECT_LT(point.width(), 1e-14);
+}
+
+TEST(IntervalTest, pruning) {
+  // x^2 + y^2 + 1 is positive everywhere
+  const auto flat = fsd::flatten(*fsd::parse("x**2 + y**2 + 1").value());
+  EXPECT_GT(flat.evaluate<Interval>({{"x", {-10, 10}}, {"y", {-10, 10}}}).lower(), 0);
+  // the derivative 2x of x^2 is positive on [1, 2]
+  const auto derivative = flat.derivative("x");
+  EXPECT_GT(derivative.evaluate<Interval>({{"x", {1, 2}}, {"y", {-1, 1}}}).lower(), 0);
+}
+
+TEST(IntervalTest, batch) {
+  const auto flat = fsd::flatten(*fsd::parse("x*y - x**2").value());
+  // boxes [i, i + 1] x [-1, 1]
+  const std::size_t n = 300;
+  std::vector<Interval> x;
+  std::vector<Interval> y(n, Interval(-1, 1));
+  for (std::size_t i = 0; i < n; ++i) {
+    x.emplace_back(static_cast<double>(i), static_cast<double>(i + 1));
+  }
+  std::vector<const Interval*> columns(2);
+  columns[flat.symbol_id("x").value()] = x.data();
+  columns[flat.symbol_id("y").value()] = y.data();
+  std::vector<Interval> result(n);
+  flat.evaluate<Interval>(columns, result);
+  for (std::size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(result[i], flat.evaluate<Interval>({{"x", x[i]}, {"y", y[i]}}));
+  }
+  // x*y - x^2 <= x - x^2 < 0 for x >= 2
+  EXPECT_LT(result[2].upper(), 0);
+}
+
+TEST(IntervalTest, literal) {
+  using namespace fsd::literals;
+  constexpr auto expr = "x*x - 2*x"_fsd;
+  const Interval result = expr.evaluate<Interval>({{"x", Interval(0, 1)}});
+  expect_tight(result, -2, 1);
+}
+
+TEST(IntervalTest, compiled) {
+  // fused multiply-adds are evaluated as products and sums
+  const auto expr = fsd::parse("x*y + 1 - (x - y)*y - 3*x*x*y").value();
+  const auto program = fsd::compile(*expr);
+  ASSERT_TRUE(std::ranges::any_of(program.instructions(), [](const fsd::Instruction& instruction) {
+    return instruction.op == fsd::OpCode_TP::FMA || instruction.op == fsd::OpCode_TP::FNMA;
+  }));
+  ASSERT_EQ(program.symbols(), (std::vector<std::string> {"x", "y"}));
+  const std::vector<Interval> box {Interval(-1, 2), Interval(0.5, 1.5)};
+  const Interval range = program.evaluate(box);
+  EXPECT_EQ(range, fsd::evaluate<Interval>(*expr, {{"x", {-1, 2}}, {"y", {0.5, 1.5}}}));
+
+  // a kernel encloses every output, points give the point values
+  const std::vector<fsd::Expression> outputs {expr, expr->derivative("x")};
+  const auto kernel = fsd::compile_kernel(outputs);
+  std::vector<Interval> ranges(2);
+  kernel.evaluate(box, ranges);
+  EXPECT_EQ(ranges[0], range);
+  EXPECT_TRUE(ranges[1].contains(fsd::evaluate<Interval>(*outputs[1], {{"x", {-1, 2}}, {"y", {0.5, 1.5}}})));
+  kernel.evaluate(std::vector<Interval> {1.5, 0.75}, ranges);
+  const auto values = kernel.evaluate({{"x", 1.5}, {"y", 0.75}});
+  for (std::size_t i = 0; i < 2; ++i) {
+    EXPECT_TRUE(ranges[i].contains(values[i])) << ranges[i].to_str();
+    EXPECT_LT(ranges[i].width(), 1e-14);
+  }
+
+  // division by a constant is strength reduced, the enclosure still holds the exact quotient
+  for (const double divisor : {3.0, 10.0}) {
+    const auto quotient = fsd::compile(*(fsd::variable("x") / fsd::constant(divisor)));
+    ASSERT_TRUE(std::ranges::none_of(quotient.instructions(), [](const fsd::Instruction& instruction) {
+      return instruction.op == fsd::OpCode_TP::DIV;
+    }));
+    for (const double x : {1.0, 3.0}) {
+      const Interval result = quotient.evaluate(std::vector<Interval> {x});
+      EXPECT_TRUE(result.contains(Interval(x) / Interval(divisor))) << divisor << " " << result.to_str();
+      EXPECT_LT(result.lower(), result.upper());
+    }
+  }
+  // a constant equal to the rounded reciprocal is not merged with it
+  const auto third = fsd::compile(*fsd::parse("x/3 + y*0.3333333333333333").value());
+  EXPECT_EQ(third.evaluate(std::vector<Interval> {1, 0}), Interval(1) / Interval(3));
+  EXPECT_EQ(third.evaluate(std::vector<Interval> {0, 1}), Interval(1.0 / 3));
+}
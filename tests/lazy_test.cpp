@@ -0,0 +1,121 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/lazy.h>
+#include <fsd/operations.h>
+#include <fsd/parser.h>
+#include <fsd/variable.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+fsd::Expression parse(std::string_view input) { return fsd::parse(input).value(); }
+
+}  // namespace
+
+TEST(LazyDerivativeTest, evaluate) {
+  const std::map<std::string, double> values {{"x", 1.5}, {"y", 0.75}, {"z", -2}};
+  for (const auto* input : {"x**3 - 2*x*y + y/(x + 3) - (x - y)**2", "x*y*z + x*x*x", "(x*y + z) / (x*x + 1)",
+                            "2 + y*z", "(x*y)**0.5", "x"}) {
+    const auto expr = parse(input);
+    for (const auto* var : {"x", "y", "z"}) {
+      const fsd::LazyDerivative derivative(expr, var);
+      EXPECT_NEAR(derivative.evaluate(values), expr->derivative(var)->evaluate(values), 1e-12) << input << " " << var;
+    }
+  }
+
+  // n-ary sums and products
+  const fsd::Expression x = fsd::variable("x");
+  const fsd::Expression y = fsd::variable("y");
+  const auto expr = fsd::sum({fsd::product({x, y, x, fsd::constant(2)}), x, y});
+  EXPECT_DOUBLE_EQ(fsd::lazy_derivative(expr, "x").evaluate({{"x", 3}, {"y", 4}}), 49);
+  EXPECT_DOUBLE_EQ(fsd::lazy_derivative(expr, "y").evaluate({{"x", 3}, {"y", 4}}), 19);
+
+  EXPECT_THROW(static_cast<void>(fsd::lazy_derivative(expr, "x").evaluate({{"x", 3}})), std::runtime_error);
+}
+
+TEST(LazyDerivativeTest, zero_and_constant) {
+  EXPECT_TRUE(fsd::lazy_derivative(parse("y*z + 2"), "x").is_zero());
+  EXPECT_TRUE(fsd::lazy_derivative(parse("y*z + 2"), "x").is_constant());
+  EXPECT_FALSE(fsd::lazy_derivative(parse("y*x"), "x").is_zero());
+  // structural: x occurs
+  EXPECT_FALSE(fsd::lazy_derivative(parse("x - x"), "x").is_zero());
+
+  EXPECT_TRUE(fsd::lazy_derivative(parse("3*x + y**2 - x/4"), "x").is_constant());
+  EXPECT_FALSE(fsd::lazy_derivative(parse("3*x + y**2 - x/4"), "x").is_zero());
+  EXPECT_FALSE(fsd::lazy_derivative(parse("x*y"), "x").is_constant());
+  EXPECT_FALSE(fsd::lazy_derivative(parse("x*x"), "x").is_constant());
+  EXPECT_FALSE(fsd::lazy_derivative(parse("1/x"), "x").is_constant());
+  EXPECT_FALSE(fsd::lazy_derivative(parse("x**2"), "x").is_constant());
+  EXPECT_TRUE(fsd::lazy_derivative(fsd::product({fsd::constant(2), fsd::variable("x"), fsd::constant(3)}), "x")
+                  .is_constant());
+}
+
+TEST(LazyDerivativeTest, dependencies) {
+  const auto derivative = fsd::lazy_derivative(parse("x**2*y + 3*z + w/(x + 1)"), "x");
+  EXPECT_TRUE(derivative.depends_on("x"));
+  EXPECT_TRUE(derivative.depends_on("y"));
+  EXPECT_FALSE(derivative.depends_on("z"));
+  EXPECT_TRUE(derivative.depends_on("w"));
+  EXPECT_FALSE(derivative.depends_on("v"));
+  EXPECT_EQ(derivative.variables(), (std::vector<std::string> {"w", "x", "y"}));
+
+  // the factor y multiplies x, x itself drops out
+  EXPECT_EQ(fsd::lazy_derivative(parse("x*y + z"), "x").variables(), std::vector<std::string> {"y"});
+  EXPECT_EQ(fsd::lazy_derivative(parse("(x + y) / 2"), "x").variables(), std::vector<std::string> {});
+  EXPECT_EQ(fsd::lazy_derivative(parse("y / x"), "x").variables(), (std::vector<std::string> {"x", "y"}));
+  EXPECT_EQ(fsd::lazy_derivative(parse("x*x*y"), "x").variables(), (std::vector<std::string> {"x", "y"}));
+}
+
+TEST(LazyDerivativeTest, materialize) {
+  const auto expr = parse("x**3 - 2*x*y");
+  const auto derivative = fsd::lazy_derivative(expr, "x");
+  EXPECT_EQ(derivative.to_str(), expr->derivative("x")->to_str());
+  EXPECT_EQ(derivative.clone()->to_str(), derivative.materialize()->to_str());
+  EXPECT_EQ(derivative.source(), expr);
+  EXPECT_EQ(derivative.var(), "x");
+
+  // d^2/dxdy (x^3 - 2xy) = -2, d^2/dx^2 = 6x
+  EXPECT_DOUBLE_EQ(derivative.derivative("y").evaluate({{"x", 2}, {"y", 1}}), -2);
+  EXPECT_DOUBLE_EQ(derivative.derivative("x").evaluate({{"x", 2}, {"y", 1}}), 12);
+  EXPECT_FALSE(derivative.derivative("x").depends_on("y"));
+}
+
+TEST(LazyDerivativeTest, deep_terms) {
+  // the walks use no recursion: d/dx and d/dy of x / y^1000000
+  const fsd::Expression x = fsd::variable("x");
+  const fsd::Expression y = fsd::variable("y");
+  fsd::Expression expr = x;
+  for (int i = 0; i < 1'000'000; ++i) {
+    expr = std::move(expr) / y;
+  }
+  EXPECT_EQ(fsd::lazy_derivative(expr, "x").evaluate({{"x", 2}, {"y", 1}}), 1);
+  EXPECT_EQ(fsd::lazy_derivative(expr, "y").evaluate({{"x", 2}, {"y", 1}}), -2'000'000);
+  EXPECT_FALSE(fsd::lazy_derivative(expr, "x").is_constant());
+  EXPECT_EQ(fsd::lazy_derivative(expr, "x").variables(), std::vector<std::string> {"y"});
+
+  // shared subterms are visited once, the term has 2^30 paths to x
+  fsd::Expression shared = x;
+  for (int i = 0; i < 30; ++i) {
+    shared = shared * shared + y;
+  }
+  const std::map<std::string, double> values {{"x", 0.25}, {"y", 0.125}};
+  const fsd::LazyDerivative derivative(shared, "x");
+  EXPECT_NEAR(derivative.evaluate(values), shared->derivative("x")->evaluate(values), 1e-12);
+  EXPECT_FALSE(derivative.is_constant());
+  EXPECT_EQ(derivative.variables(), (std::vector<std::string> {"x", "y"}));
+}
+
+TEST(LazyDerivativeTest, errors) {
+  EXPECT_THROW(fsd::LazyDerivative(nullptr, "x"), std::invalid_argument);
+  // like the derivative term, exponents must not depend on var
+  const auto derivative = fsd::lazy_derivative(parse("y**x"), "x");
+  EXPECT_THROW(static_cast<void>(derivative.evaluate({{"x", 1}, {"y", 2}})), std::runtime_error);
+  EXPECT_THROW(static_cast<void>(derivative.is_constant()), std::runtime_error);
+  EXPECT_THROW(static_cast<void>(derivative.materialize()), std::runtime_error);
+  EXPECT_DOUBLE_EQ(fsd::lazy_derivative(parse("y**x"), "y").evaluate({{"x", 3}, {"y", 2}}), 12);
+}
@@ -0,0 +1,58 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/literal.h>
+#include <fsd/parser.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <type_traits>
+
+using namespace fsd::literals;
+
+namespace {
+
+constexpr auto f = "x**2 + 3*x*y - y/4"_fsd;
+constexpr auto df_dx = f.derivative("x");
+
+// everything below is evaluated by the compiler
+static_assert(f.symbols().size() == 2);
+static_assert(f.evaluate({{"x", 2.0}, {"y", 4.0}}) == 4 + 24 - 1);
+static_assert(df_dx.evaluate({{"x", 2.0}, {"y", 4.0}}) == 2 * 2 + 3 * 4);
+static_assert(f.derivative("y").evaluate({{"x", 2.0}, {"y", 4.0}}) == 6 - 0.25);
+static_assert(f.derivative("z").size() == 1);
+static_assert("(1 + 2) * 3 - 2**3**2 / 64"_fsd.evaluate({}) == 9 - 8);
+static_assert("2.5 * 4"_fsd.evaluate({}) == 10);
+static_assert("x**3 + x**(1 - 2) + 3**0"_fsd.evaluate({{"x", 2.0}}) == 8 + 0.5 + 1);
+
+// powers are only evaluated at compile time with an integral exponent
+template <auto F>
+concept constant_evaluable = requires { typename std::bool_constant<(F(), true)>; };
+static_assert(constant_evaluable<[] { return "x**(2*3)"_fsd.evaluate({{"x", 2.0}}); }>);
+static_assert(!constant_evaluable<[] { return "x**0.5"_fsd.evaluate({{"x", 4.0}}); }>);
+static_assert(!constant_evaluable<[] { return "x**y"_fsd.evaluate({{"x", 4.0}, {"y", 2.0}}); }>);
+
+}  // namespace
+
+TEST(LiteralTest, matches_parser) {
+  constexpr auto literal = "(x + 2*y)**3 - (x*y)/2.5 + 4"_fsd;
+  auto flat = fsd::flatten(*fsd::parse("(x + 2*y)**3 - (x*y)/2.5 + 4").value());
+  const std::map<std::string, double> values {{"x", 1.5}, {"y", -0.75}};
+  EXPECT_DOUBLE_EQ(literal.evaluate({{"x", 1.5}, {"y", -0.75}}), flat.evaluate(values));
+  EXPECT_DOUBLE_EQ(literal.derivative("y").evaluate({{"x", 1.5}, {"y", -0.75}}), flat.derivative("y").evaluate(values));
+  EXPECT_EQ(literal.to_flat().to_str(), flat.to_str());
+  EXPECT_EQ(literal.derivative("x").to_flat().to_str(), flat.derivative("x").to_str());
+}
+
+TEST(LiteralTest, evaluate) {
+  constexpr auto g = "a*x**2 + b"_fsd;
+  EXPECT_EQ((g.evaluate<float>({{"a", 2.0f}, {"x", 3.0f}, {"b", 1.0f}})), 19.0f);
+  const double by_id[] = {2, 3, 1};
+  EXPECT_EQ(g.evaluate(by_id), 19);
+  EXPECT_THROW(static_cast<void>(g.evaluate({{"a", 2.0}})), std::runtime_error);
+  // at runtime any power is evaluated
+  EXPECT_DOUBLE_EQ("x**0.5"_fsd.evaluate({{"x", 2.0}}), std::sqrt(2.0));
+  // second derivative
+  EXPECT_EQ(g.derivative("x").derivative("x").evaluate({{"a", 2.0}, {"x", 3.0}, {"b", 1.0}}), 4);
+}
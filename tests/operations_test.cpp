@@ -0,0 +1,150 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/constant.h>
+#include <fsd/operations.h>
+#include <fsd/variable.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+TEST(OperationsTest, clone_shares_term) {
+  fsd::Expression expr = fsd::variable("x") * fsd::constant(2);
+  fsd::Expression copy = expr->clone();
+  EXPECT_EQ(copy.get(), expr.get());
+  EXPECT_EQ(copy->to_str(), "(x * 2)");
+}
+
+TEST(OperationsTest, composition_shares_operands) {
+  fsd::Expression x = fsd::variable("x");
+  fsd::Expression expr = x + x;
+  EXPECT_EQ(x.use_count(), 3);
+  EXPECT_EQ(expr->evaluate({{"x", 3}}), 6);
+}
+
+TEST(OperationsTest, derivative_shares_operands) {
+  fsd::Expression lhs = fsd::variable("x") + fsd::constant(1);
+  fsd::Expression rhs = fsd::variable("x") * fsd::variable("y");
+  const long lhs_count = lhs.use_count();
+  const long rhs_count = rhs.use_count();
+  fsd::Expression expr = lhs * rhs;
+  fsd::Expression derivative = expr->derivative("x");
+  // product rule references both factors once more, but never copies them
+  EXPECT_EQ(lhs.use_count(), lhs_count + 2);
+  EXPECT_EQ(rhs.use_count(), rhs_count + 2);
+  EXPECT_EQ(derivative->evaluate({{"x", 2}, {"y", 3}}), 3 * 2 + 3 * 3);
+}
+
+TEST(OperationsTest, unique_ptr_migration) {
+  std::unique_ptr<fsd::Term_I> lhs = fsd::variable("x");
+  std::unique_ptr<fsd::Term_I> rhs = fsd::constant(3);
+  // terms owned by a std::unique_ptr can not be shared and are copied instead
+  EXPECT_NE(lhs->clone().get(), lhs.get());
+  EXPECT_EQ(lhs->clone()->to_str(), "x");
+  std::unique_ptr<fsd::Term_I> copy = rhs->clone_unique();
+  EXPECT_EQ(copy->to_str(), rhs->to_str());
+
+  fsd::Expression expr = std::move(lhs) * std::move(rhs);
+  EXPECT_EQ(expr->evaluate({{"x", 2}}), 6);
+}
+
+TEST(OperationsTest, pow_derivative) {
+  fsd::Expression x = fsd::variable("x");
+  EXPECT_EQ(fsd::pow(x, fsd::constant(3))->derivative("x")->to_str(), "(3 * x^((3 - 1)))");
+  // chain rule for bases other than the variable itself
+  fsd::Expression expr = fsd::pow(x * fsd::variable("y") + fsd::constant(1), fsd::constant(2));
+  EXPECT_DOUBLE_EQ(expr->derivative("x")->evaluate({{"x", 2}, {"y", 3}}), 2 * 7 * 3);
+  EXPECT_EQ(expr->derivative("z")->evaluate({}), 0);
+  EXPECT_THROW(static_cast<void>(fsd::pow(x, x)->derivative("x")), std::runtime_error);
+}
+
+TEST(OperationsTest, nary) {
+  fsd::Expression x = fsd::variable("x");
+  fsd::Expression y = fsd::variable("y");
+  fsd::Expression expr = fsd::product({x, y, x, fsd::constant(2)});
+  const std::map<std::string, double> values {{"x", 3}, {"y", 5}};
+  EXPECT_EQ(expr->to_str(), "(x * y * x * 2)");
+  EXPECT_EQ(expr->evaluate(values), 90);
+  // d/dx 2 * x^2 * y
+  EXPECT_EQ(expr->derivative("x")->evaluate(values), 60);
+  EXPECT_EQ(expr->derivative("y")->evaluate(values), 18);
+  EXPECT_EQ(expr->derivative("z")->evaluate(values), 0);
+
+  fsd::Expression sum = fsd::sum({x, y, expr});
+  EXPECT_EQ(sum->to_str(), "(x + y + (x * y * x * 2))");
+  EXPECT_EQ(sum->evaluate(values), 98);
+  EXPECT_EQ(sum->derivative("x")->evaluate(values), 61);
+  EXPECT_EQ(fsd::sum({})->evaluate({}), 0);
+  EXPECT_EQ(fsd::product({x}).get(), x.get());
+}
+
+TEST(OperationsTest, deep_term_destruction) {
+  // one million nested binary operations, destroying them recursively would overflow the stack
+  fsd::Expression expr = fsd::variable("x");
+  for (int i = 0; i < 1'000'000; ++i) {
+    expr = std::move(expr) + fsd::constant(1);
+  }
+  fsd::Expression shared = expr;
+  expr.reset();
+  EXPECT_EQ(shared.use_count(), 1);
+  shared.reset();
+
+  // a node holding the same operand twice releases it only with its second reference
+  fsd::Expression square = fsd::variable("x");
+  for (int i = 0; i < 300'000; ++i) {
+    square = square * square;
+  }
+  square.reset();
+}
+
+TEST(OperationsTest, deep_terms) {
+  // evaluate, to_str and derivative walk terms without recursion
+  fsd::Expression expr = fsd::variable("x");
+  for (int i = 0; i < 1'000'000; ++i) {
+    expr = std::move(expr) - fsd::constant(1);
+  }
+  EXPECT_EQ(expr->evaluate({{"x", 5}}), -999'995);
+  EXPECT_EQ(expr->to_str().size(), 6'000'001);
+  EXPECT_EQ(expr->derivative("x")->evaluate({}), 1);
+
+  // shared subterms are evaluated once: the term has 2^64 paths to x
+  fsd::Expression square = fsd::variable("x") + fsd::constant(1);
+  for (int i = 0; i < 64; ++i) {
+    square = square * square;
+  }
+  EXPECT_EQ(square->evaluate({{"x", 0}}), 1);
+  EXPECT_EQ(square->derivative("x")->evaluate({{"x", 0}}), std::ldexp(1, 64));
+}
+
+TEST(OperationsTest, product_derivative) {
+  fsd::Expression x = fsd::variable("x");
+  std::vector<fsd::Expression> factors;
+  for (int i = 0; i < 20'000; ++i) {
+    if (i % 2 == 0) {
+      factors.push_back(fsd::variable("x"));
+    } else {
+      factors.push_back(fsd::constant(1));
+    }
+  }
+  // d/dx x^10000 at 1
+  const fsd::Expression derivative = fsd::product(std::move(factors))->derivative("x");
+  EXPECT_EQ(derivative->evaluate({{"x", 1}}), 10'000);
+
+  EXPECT_EQ(fsd::product({x, fsd::constant(2), x})->derivative("x")->to_str(), "(2 * ((1 * x) + (x * 1)))");
+  EXPECT_EQ(fsd::product({fsd::variable("y"), x})->derivative("x")->to_str(), "(y * 1)");
+}
+
+TEST(OperationsTest, occurs) {
+  fsd::Expression x = fsd::variable("x");
+  EXPECT_TRUE(fsd::occurs(*(x - x), "x"));
+  EXPECT_FALSE(fsd::occurs(*(fsd::variable("y") * fsd::constant(2)), "x"));
+  // shared subterms are visited once: 2^64 paths lead to x
+  fsd::Expression expr = fsd::variable("y") + x;
+  for (int i = 0; i < 64; ++i) {
+    expr = expr * expr;
+  }
+  EXPECT_TRUE(fsd::occurs(*expr, "x"));
+  EXPECT_FALSE(fsd::occurs(*expr, "z"));
+}
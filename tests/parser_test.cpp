@@ -2,3 +2,67 @@
 // Author   : Leon Freist
 // License  : MIT
 
+#include <fsd/flat.h>
+#include <fsd/parser.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+TEST(ParserTest, precedence) {
+  EXPECT_EQ(fsd::parse("x - y - z").value()->to_str(), "((x - y) - z)");
+  EXPECT_EQ(fsd::parse("x / y * z").value()->to_str(), "((x / y) * z)");
+  EXPECT_EQ(fsd::parse("x + y * z").value()->to_str(), "(x + (y * z))");
+  EXPECT_EQ(fsd::parse("x * y - z / 2").value()->to_str(), "((x * y) - (z / 2))");
+  // '**' binds strongest and is right associative
+  EXPECT_EQ(fsd::parse("2 * x ** y ** z").value()->to_str(), "(2 * x^(y^(z)))");
+  EXPECT_EQ(fsd::parse("(x + y) * z").value()->to_str(), "((x + y) * z)");
+}
+
+TEST(ParserTest, nary_chains) {
+  EXPECT_EQ(fsd::parse("a + b * c * d + e").value()->to_str(), "(a + (b * c * d) + e)");
+  // parentheses close a chain
+  EXPECT_EQ(fsd::parse("(a + b + c) + d").value()->to_str(), "((a + b + c) + d)");
+  auto flat = fsd::flatten(*fsd::parse("a + b + c - d").value());
+  EXPECT_EQ(flat.nodes()[flat.nodes()[flat.root()].lhs].type, fsd::Node_TP::SUM);
+}
+
+TEST(ParserTest, long_sum) {
+  // 100k terms are parsed into a single n-ary node
+  constexpr int n = 100'000;
+  std::string input = "x0";
+  for (int i = 1; i < n; ++i) {
+    input += " + x" + std::to_string(i % 100) + " * " + std::to_string(i % 7);
+  }
+  auto expr = fsd::parse(input);
+  ASSERT_TRUE(expr.has_value());
+  EXPECT_EQ(expr.value()->operands().size(), n);
+
+  std::map<std::string, double> values;
+  double expected = 0;
+  for (int i = 0; i < 100; ++i) {
+    values["x" + std::to_string(i)] = i;
+  }
+  for (int i = 1; i < n; ++i) {
+    expected += (i % 100) * (i % 7);
+  }
+  EXPECT_DOUBLE_EQ(expr.value()->evaluate(values), expected);
+  auto flat = fsd::flatten(*expr.value());
+  EXPECT_DOUBLE_EQ(flat.evaluate(values), expected);
+  EXPECT_DOUBLE_EQ(flat.derivative("x7").evaluate(values), [] {
+    double result = 0;
+    for (int i = 7; i < n; i += 100) {
+      result += i % 7;
+    }
+    return result;
+  }());
+}
+
+TEST(ParserTest, errors) {
+  EXPECT_EQ(fsd::parse("x +").error(), fsd::Error(fsd::ErrorType::MISSING_OPERAND, 3));
+  EXPECT_EQ(fsd::parse("* x").error(), fsd::Error(fsd::ErrorType::MISSING_OPERAND, 0));
+  EXPECT_EQ(fsd::parse("x y").error(), fsd::Error(fsd::ErrorType::MISSING_OPERATOR, 2));
+  EXPECT_EQ(fsd::parse("x)").error(), fsd::Error(fsd::ErrorType::MISSING_OPERATOR, 1));
+  EXPECT_EQ(fsd::parse("(x").error(), fsd::Error(fsd::ErrorType::MISSING_OPERATOR, 2));
+  EXPECT_EQ(fsd::parse("x + $").error(), fsd::Error(fsd::ErrorType::UNKNOWN_TOKEN, 4));
+  EXPECT_FALSE(fsd::parse("").has_value());
+}
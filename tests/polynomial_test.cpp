@@ -0,0 +1,71 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/parser.h>
+#include <fsd/polynomial.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+fsd::Expression parse(std::string_view input) { return fsd::parse(input).value(); }
+
+}  // namespace
+
+TEST(PolynomialTest, to_polynomial) {
+  auto expr = parse("(x + 2*y)**3 - ((x*y)/2 - 4)");
+  auto polynomial = fsd::to_polynomial(*expr);
+  ASSERT_TRUE(polynomial.has_value());
+  // x^3 + 6x^2y + 12xy^2 + 8y^3 - xy/2 + 4
+  EXPECT_EQ(polynomial->size(), 6);
+  EXPECT_EQ(polynomial->variables(), std::vector<std::string>({"x", "y"}));
+  for (double x : {-1.5, 0.0, 2.0}) {
+    for (double y : {-3.0, 0.5, 1.0}) {
+      EXPECT_DOUBLE_EQ(polynomial->evaluate({{"x", x}, {"y", y}}), expr->evaluate({{"x", x}, {"y", y}}));
+    }
+  }
+
+  EXPECT_FALSE(fsd::to_polynomial(*parse("x / y")).has_value());
+  EXPECT_FALSE(fsd::to_polynomial(*parse("x ** y")).has_value());
+  EXPECT_FALSE(fsd::to_polynomial(*parse("x ** 1.5")).has_value());
+
+  // expansions that are too large are rejected before they are built
+  EXPECT_EQ(fsd::to_polynomial(*parse("(x + y)**200")).value().size(), 201);
+  EXPECT_FALSE(fsd::to_polynomial(*parse("(x + y)**65536")).has_value());
+  EXPECT_FALSE(fsd::to_polynomial(*parse("x ** 300")).has_value());
+  EXPECT_EQ(fsd::to_polynomial(*parse("(a + b + c + d + e + f + g + h)**6")).value().size(), 1716);
+  EXPECT_FALSE(fsd::to_polynomial(*parse("(a + b + c + d + e + f + g + h)**8")).has_value());
+  EXPECT_FALSE(fsd::to_polynomial(*parse("((x**256)**256)**256")).has_value());
+  // a product of many binomials in one variable has few terms
+  EXPECT_EQ(fsd::to_polynomial(*parse("(x+1)*(x+2)*(x+3)*(x+4)*(x+5)*(x+6)*(x+7)*(x+8)*(x+9)*(x+10)*(x+11)*(x+12)*(x+13)"))
+                .value()
+                .size(),
+            14);
+}
+
+TEST(PolynomialTest, derivative) {
+  auto polynomial = fsd::to_polynomial(*parse("((x**3)*(y**2)) + ((5*x)*y) + (y**4) + 7")).value();
+  auto dx = polynomial.derivative("x");
+  EXPECT_EQ(dx.size(), 2);
+  EXPECT_DOUBLE_EQ(dx.evaluate({{"x", 2}, {"y", 3}}), 3 * 4 * 9 + 5 * 3);
+  auto dy = polynomial.derivative("y");
+  EXPECT_EQ(dy.size(), 3);
+  EXPECT_DOUBLE_EQ(dy.evaluate({{"x", 2}, {"y", 3}}), 8 * 2 * 3 + 5 * 2 + 4 * 27);
+  EXPECT_EQ(polynomial.derivative("z").size(), 0);
+  EXPECT_EQ(polynomial.derivative("z").to_str(), "0");
+}
+
+TEST(PolynomialTest, to_expression) {
+  auto polynomial = fsd::to_polynomial(*parse("((2*(x**2))*y) - (x - 3)")).value();
+  auto expr = polynomial.to_expression();
+  EXPECT_EQ(expr->to_str(), "(((2 * (x^(2) * y)) + (-1 * x)) + 3)");
+  EXPECT_DOUBLE_EQ(expr->evaluate({{"x", 1.5}, {"y", -2}}), polynomial.evaluate({{"x", 1.5}, {"y", -2}}));
+}
+
+TEST(PolynomialTest, polynomial_subexpressions) {
+  auto flat = fsd::flatten(*parse("(x**2 + 1) / (y*x - 3) + x ** y"));
+  auto subexpressions = fsd::polynomial_subexpressions(flat);
+  ASSERT_EQ(subexpressions.size(), 2);
+  EXPECT_EQ(subexpressions[0].polynomial.size(), 2);
+  EXPECT_EQ(subexpressions[1].polynomial.size(), 2);
+}
@@ -0,0 +1,99 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/parser.h>
+#include <fsd/service.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+namespace {
+
+std::shared_ptr<const fsd::FlatExpression> compile(std::string_view input) {
+  return std::make_shared<const fsd::FlatExpression>(fsd::flatten(*fsd::parse(input).value()));
+}
+
+}  // namespace
+
+TEST(EvaluationServiceTest, submit) {
+  auto expr = compile("x * y + 1");
+  fsd::EvaluationService service;
+  auto future = service.submit(expr, {2, 3});
+  EXPECT_EQ(future.get(), 7);
+  EXPECT_THROW(service.submit(expr, {2}), std::invalid_argument);
+}
+
+TEST(EvaluationServiceTest, callback) {
+  auto expr = compile("x * 2");
+  std::atomic<double> result {0};
+  {
+    fsd::EvaluationService service;
+    service.submit(expr, {4}, [&](double value) { result = value; });
+  }
+  EXPECT_EQ(result, 8);
+}
+
+TEST(EvaluationServiceTest, coalescing) {
+  auto square = compile("x * x");
+  auto twice = compile("x + x");
+  fsd::EvaluationService::Options options;
+  options.max_batch_size = 64;
+  options.max_delay = std::chrono::milliseconds(20);
+  options.threads = 2;
+  fsd::EvaluationService service(options);
+
+  constexpr int threads = 8;
+  constexpr int per_thread = 100;
+  std::vector<std::thread> clients;
+  std::atomic<int> wrong {0};
+  for (int t = 0; t < threads; ++t) {
+    clients.emplace_back([&, t]() {
+      std::vector<std::future<double>> futures;
+      for (int i = 0; i < per_thread; ++i) {
+        futures.push_back(service.submit(i % 2 == 0 ? square : twice, {static_cast<double>(t * per_thread + i)}));
+      }
+      for (int i = 0; i < per_thread; ++i) {
+        const double x = t * per_thread + i;
+        if (futures[i].get() != (i % 2 == 0 ? x * x : x + x)) {
+          wrong++;
+        }
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  EXPECT_EQ(wrong, 0);
+
+  const auto metrics = service.metrics();
+  EXPECT_EQ(metrics.requests, threads * per_thread);
+  EXPECT_EQ(metrics.queue_depth, 0);
+  EXPECT_LE(metrics.max_batch_size, 64);
+  EXPECT_LT(metrics.batches, metrics.requests);
+  EXPECT_GT(metrics.average_batch_size(), 1);
+}
+
+TEST(EvaluationServiceTest, errors) {
+  auto expr = compile("x + 1");
+  fsd::EvaluationService service;
+  EXPECT_THROW(service.submit(nullptr, {}), std::invalid_argument);
+
+  // a throwing callback is reported to its error callback and does not affect the other requests of its batch
+  std::atomic<int> errors {0};
+  std::atomic<double> result {0};
+  service.submit(expr, {1}, [](double) { throw std::runtime_error("callback failed"); },
+                 [&](const std::exception_ptr& error) {
+                   try {
+                     std::rethrow_exception(error);
+                   } catch (const std::runtime_error&) {
+                     errors++;
+                   }
+                 });
+  service.submit(expr, {2}, [](double) { throw std::runtime_error("dropped"); });
+  service.submit(expr, {3}, [&](double value) { result = value; });
+  EXPECT_EQ(service.submit(expr, {4}).get(), 5);
+  EXPECT_EQ(errors, 1);
+  EXPECT_EQ(result, 4);
+}
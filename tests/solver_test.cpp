@@ -0,0 +1,78 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/parser.h>
+#include <fsd/solver.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+namespace {
+
+fsd::Expression parse(std::string_view input) { return fsd::parse(input).value(); }
+
+}  // namespace
+
+TEST(SolverTest, newton_raphson) {
+  fsd::Solver solver(parse("x**2 - a"), {"x"}, {.method = fsd::Method_TP::NEWTON_RAPHSON});
+  const std::vector<double> start {1};
+  auto result = solver.solve(start, {{"a", 2}});
+  EXPECT_TRUE(result.converged);
+  EXPECT_NEAR(result.x[0], std::sqrt(2), 1e-10);
+  EXPECT_THROW(static_cast<void>(solver.solve(start)), std::invalid_argument);
+  EXPECT_THROW(fsd::Solver(parse("x*y"), {"x", "y"}, {.method = fsd::Method_TP::NEWTON_RAPHSON}),
+               std::invalid_argument);
+}
+
+TEST(SolverTest, damped_newton) {
+  fsd::Solver solver(parse("(1-x)**2 + 100*(y-x**2)**2"), {"x", "y"}, {.method = fsd::Method_TP::DAMPED_NEWTON});
+  const std::vector<double> start {-1.2, 1};
+  auto result = solver.solve(start);
+  EXPECT_TRUE(result.converged);
+  EXPECT_NEAR(result.x[0], 1, 1e-8);
+  EXPECT_NEAR(result.x[1], 1, 1e-8);
+  EXPECT_NEAR(result.value, 0, 1e-12);
+}
+
+TEST(SolverTest, lbfgs) {
+  fsd::Solver solver(parse("(1-x)**2 + 100*(y-x**2)**2"), {"x", "y"},
+                     {.method = fsd::Method_TP::LBFGS, .max_iterations = 1000, .tolerance = 1e-8});
+  const std::vector<double> start {-1.2, 1};
+  auto result = solver.solve(start);
+  EXPECT_TRUE(result.converged);
+  EXPECT_NEAR(result.x[0], 1, 1e-6);
+  EXPECT_NEAR(result.x[1], 1, 1e-6);
+}
+
+TEST(SolverTest, lbfgs_rejected_pair) {
+  // with a history of one pair, a step with negative curvature is rejected while the history is full, the stored pair
+  // must stay intact
+  fsd::Solver solver(parse("x**4 + y**4 - 6*x*y + x"), {"x", "y"},
+                     {.method = fsd::Method_TP::LBFGS, .max_iterations = 200, .tolerance = 1e-8, .history = 1});
+  const std::vector<double> start {-0.75, 1};
+  auto result = solver.solve(start);
+  EXPECT_TRUE(result.converged);
+  EXPECT_LT(result.iterations, 50);
+  // 4x^3 - 6y + 1 = 0 and 4y^3 - 6x = 0
+  EXPECT_NEAR(4 * std::pow(result.x[0], 3) - 6 * result.x[1] + 1, 0, 1e-7);
+  EXPECT_NEAR(4 * std::pow(result.x[1], 3) - 6 * result.x[0], 0, 1e-7);
+}
+
+TEST(SolverTest, batch) {
+  fsd::Solver solver(parse("(x-a)**2 + (y+a)**2 + z**2"), {"x", "y", "z"}, {.threads = 4});
+  std::vector<std::vector<double>> starts;
+  std::vector<std::map<std::string, double>> parameters;
+  for (int i = 0; i < 64; ++i) {
+    starts.push_back({static_cast<double>(i), 1, -1});
+    parameters.push_back({{"a", i * 0.5}});
+  }
+  auto results = solver.solve(starts, parameters);
+  ASSERT_EQ(results.size(), starts.size());
+  for (int i = 0; i < 64; ++i) {
+    EXPECT_TRUE(results[i].converged);
+    EXPECT_NEAR(results[i].x[0], i * 0.5, 1e-8);
+    EXPECT_NEAR(results[i].x[1], -i * 0.5, 1e-8);
+    EXPECT_NEAR(results[i].x[2], 0, 1e-8);
+  }
+}
@@ -0,0 +1,33 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+#include <fsd/parser.h>
+#include <fsd/specialize.h>
+#include <gtest/gtest.h>
+
+TEST(SpecializeTest, specialize) {
+  auto expr = fsd::parse("(a**2 + b) * x + (a * b) / (y - b)").value();
+  auto specialization = fsd::specialize(*expr, {{"a", 3}, {"b", 2}});
+  // (9 + 2) * x + 6 / (y - 2)
+  EXPECT_EQ(specialization.expr->to_str(), "((11 * x) + (6 / (y - 2)))");
+  EXPECT_EQ(specialization.nodes_before, 15);
+  EXPECT_EQ(specialization.nodes_after, 9);
+  for (double x : {-1.0, 0.5, 4.0}) {
+    const std::map<std::string, double> values {{"a", 3}, {"b", 2}, {"x", x}, {"y", x + 7}};
+    EXPECT_DOUBLE_EQ(specialization.expr->evaluate(values), expr->evaluate(values));
+  }
+}
+
+TEST(SpecializeTest, flat) {
+  auto flat = fsd::flatten(*fsd::parse("p * x + p * q").value());
+  auto specialized = fsd::specialize(flat, {{"p", 0.5}, {"q", 4}});
+  // symbol ids are kept
+  EXPECT_EQ(specialized.symbols(), flat.symbols());
+  EXPECT_LT(specialized.size(), flat.size());
+  EXPECT_DOUBLE_EQ(specialized.evaluate(std::map<std::string, double> {{"x", 3}}), 3.5);
+
+  auto constant = fsd::specialize(flat, {{"p", 1}, {"q", 2}, {"x", 3}});
+  EXPECT_EQ(constant.size(), 1);
+  EXPECT_EQ(constant.to_str(), "5");
+}
@@ -0,0 +1,453 @@
+// Copyright: Leon Freist, 2024
+// Author   : Leon Freist
+// License  : MIT
+
+// fsd_eval: evaluates an expression and its partial derivatives over columnar input.
+//
+// Usage: fsd_eval [options] <expression>
+//   -i, --input FILE       input file, *.csv is streamed as CSV, anything else is read as columnar file (see below).
+//                          CSV is read from stdin if no input is given
+//   -o, --output FILE      output file, same format as the input. CSV is written to stdout if no output is given
+//   -d, --derivative VAR   additionally output the partial derivative by VAR (repeatable)
+//   -t, --threads N        number of worker threads (default: hardware concurrency)
+//   -b, --block N          rows per block (default: 65536)
+//
+// Columnar file format (all values little-endian):
+//   char[8]   magic "FSDCOL1\0"
+//   uint64    number of rows
+//   uint32    number of columns
+//   uint32    reserved, 0
+//   columns x {uint32 name length, name bytes}
+//   zero padding up to the next multiple of 8 bytes
+//   columns x rows float64 values, column after column
+//
+// Input files are memory mapped, output files are created with their final size, memory mapped and written in place
+// by the worker threads. Throughput is reported on stderr.
+
+#include <fsd/flat.h>
+#include <fsd/parser.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr char MAGIC[8] = {'F', 'S', 'D', 'C', 'O', 'L', '1', '\0'};
+
+struct Options {
+  std::string expression;
+  std::string input;
+  std::string output;
+  std::vector<std::string> derivatives;
+  std::size_t threads {std::max(1U, std::thread::hardware_concurrency())};
+  std::size_t block {1 << 16};
+};
+
+/// The expression and the requested derivatives, sharing one symbol table.
+struct Outputs {
+  std::vector<std::string> names;
+  std::vector<fsd::FlatExpression> exprs;
+};
+
+/// Read only or read write memory mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile(const std::string& path, std::size_t create_size = 0) {
+    const bool create = create_size > 0;
+    _fd = create ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+      throw std::runtime_error("can not open " + path);
+    }
+    if (create) {
+      if (::ftruncate(_fd, static_cast<off_t>(create_size)) != 0) {
+        throw std::runtime_error("can not resize " + path);
+      }
+      _size = create_size;
+    } else {
+      struct stat st {};
+      ::fstat(_fd, &st);
+      _size = static_cast<std::size_t>(st.st_size);
+    }
+    if (_size > 0) {
+      void* data = ::mmap(nullptr, _size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, _fd, 0);
+      if (data == MAP_FAILED) {
+        throw std::runtime_error("can not map " + path);
+      }
+      _data = static_cast<char*>(data);
+    }
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile() {
+    if (_data != nullptr) {
+      ::munmap(_data, _size);
+    }
+    if (_fd >= 0) {
+      ::close(_fd);
+    }
+  }
+
+  [[nodiscard]] char* data() const { return _data; }
+  [[nodiscard]] std::size_t size() const { return _size; }
+
+ private:
+  int _fd {-1};
+  char* _data {nullptr};
+  std::size_t _size {0};
+};
+
+struct ColumnarHeader {
+  std::uint64_t rows;
+  std::vector<std::string> names;
+  /// offset of the first value of the first column
+  std::size_t data_offset;
+};
+
+std::size_t header_size(const std::vector<std::string>& names) {
+  std::size_t size = sizeof(MAGIC) + sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t);
+  for (const auto& name : names) {
+    size += sizeof(std::uint32_t) + name.size();
+  }
+  return (size + 7) / 8 * 8;
+}
+
+ColumnarHeader read_header(const MappedFile& file) {
+  const char* data = file.data();
+  std::size_t position = 0;
+  auto read = [&](void* target, std::size_t size) {
+    if (position + size > file.size()) {
+      throw std::runtime_error("truncated columnar header");
+    }
+    std::memcpy(target, data + position, size);
+    position += size;
+  };
+  char magic[sizeof(MAGIC)];
+  read(magic, sizeof(magic));
+  if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error("not a columnar file");
+  }
+  ColumnarHeader header {};
+  std::uint32_t columns;
+  std::uint32_t reserved;
+  read(&header.rows, sizeof(header.rows));
+  read(&columns, sizeof(columns));
+  read(&reserved, sizeof(reserved));
+  for (std::uint32_t i = 0; i < columns; ++i) {
+    std::uint32_t length;
+    read(&length, sizeof(length));
+    std::string name(length, '\0');
+    read(name.data(), length);
+    header.names.push_back(std::move(name));
+  }
+  header.data_offset = header_size(header.names);
+  if (header.data_offset > file.size()) {
+    throw std::runtime_error("truncated columnar header");
+  }
+  // rows is untrusted, compare without multiplying it
+  if (columns == 0 ? header.rows != 0
+                   : header.rows > (file.size() - header.data_offset) / sizeof(double) / columns) {
+    throw std::runtime_error("truncated columnar data");
+  }
+  return header;
+}
+
+void write_header(char* data, std::uint64_t rows, const std::vector<std::string>& names) {
+  std::memset(data, 0, header_size(names));
+  std::size_t position = 0;
+  auto write = [&](const void* source, std::size_t size) {
+    std::memcpy(data + position, source, size);
+    position += size;
+  };
+  const auto columns = static_cast<std::uint32_t>(names.size());
+  const std::uint32_t reserved = 0;
+  write(MAGIC, sizeof(MAGIC));
+  write(&rows, sizeof(rows));
+  write(&columns, sizeof(columns));
+  write(&reserved, sizeof(reserved));
+  for (const auto& name : names) {
+    const auto length = static_cast<std::uint32_t>(name.size());
+    write(&length, sizeof(length));
+    write(name.data(), name.size());
+  }
+}
+
+/**
+ * Evaluates all outputs for rows [0, rows). inputs[s] points to the column of symbol s, outputs[o] to the column of
+ * output o. Blocks of rows are distributed over the worker threads.
+ */
+void evaluate_parallel(const Outputs& outputs, const std::vector<const double*>& inputs,
+                       const std::vector<double*>& results, std::size_t rows, const Options& options) {
+  const std::size_t blocks = (rows + options.block - 1) / options.block;
+  std::atomic<std::size_t> next {0};
+  auto work = [&]() {
+    std::vector<const double*> columns(inputs.size());
+    for (std::size_t block = next++; block < blocks; block = next++) {
+      const std::size_t offset = block * options.block;
+      const std::size_t n = std::min(options.block, rows - offset);
+      for (std::size_t s = 0; s < inputs.size(); ++s) {
+        columns[s] = inputs[s] == nullptr ? nullptr : inputs[s] + offset;
+      }
+      for (std::size_t o = 0; o < outputs.exprs.size(); ++o) {
+        outputs.exprs[o].evaluate(columns, {results[o] + offset, n});
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (std::size_t t = 1; t < std::min(options.threads, blocks); ++t) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+constexpr std::size_t UNBOUND = std::numeric_limits<std::size_t>::max();
+
+/// maps every symbol used by the outputs to the index of the input column of the same name
+std::vector<std::size_t> bind_columns(const Outputs& outputs, const std::vector<std::string>& names) {
+  const auto& symbols = outputs.exprs.front().symbols();
+  std::vector<bool> used(symbols.size());
+  for (const auto& expr : outputs.exprs) {
+    for (const auto& node : expr.nodes()) {
+      if (node.type == fsd::Node_TP::VARIABLE) {
+        used[node.lhs] = true;
+      }
+    }
+  }
+  std::vector<std::size_t> binding(symbols.size(), UNBOUND);
+  for (std::size_t s = 0; s < symbols.size(); ++s) {
+    auto it = std::find(names.begin(), names.end(), symbols[s]);
+    if (it != names.end()) {
+      binding[s] = static_cast<std::size_t>(it - names.begin());
+    } else if (used[s]) {
+      throw std::runtime_error("no input column for variable " + symbols[s]);
+    }
+  }
+  return binding;
+}
+
+std::size_t run_columnar(const Outputs& outputs, const Options& options) {
+  if constexpr (std::endian::native != std::endian::little) {
+    throw std::runtime_error("columnar files are only supported on little-endian hosts");
+  }
+  if (options.output.empty()) {
+    throw std::runtime_error("columnar input requires an output file");
+  }
+  MappedFile input(options.input);
+  const ColumnarHeader header = read_header(input);
+  const auto binding = bind_columns(outputs, header.names);
+  const auto* values = reinterpret_cast<const double*>(input.data() + header.data_offset);
+  std::vector<const double*> inputs;
+  for (std::size_t column : binding) {
+    inputs.push_back(column == UNBOUND ? nullptr : values + column * header.rows);
+  }
+
+  const std::size_t output_offset = header_size(outputs.names);
+  if (header.rows > (std::numeric_limits<std::size_t>::max() - output_offset) / sizeof(double) / outputs.names.size()) {
+    throw std::runtime_error("output file too large");
+  }
+  MappedFile output(options.output, output_offset + outputs.names.size() * header.rows * sizeof(double));
+  write_header(output.data(), header.rows, outputs.names);
+  auto* results_data = reinterpret_cast<double*>(output.data() + output_offset);
+  std::vector<double*> results;
+  for (std::size_t o = 0; o < outputs.names.size(); ++o) {
+    results.push_back(results_data + o * header.rows);
+  }
+  evaluate_parallel(outputs, inputs, results, header.rows, options);
+  return header.rows;
+}
+
+std::vector<std::string> split_csv_line(const std::string& line) {
+  std::vector<std::string> fields;
+  std::size_t start = 0;
+  while (true) {
+    const std::size_t end = line.find(',', start);
+    std::string field = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    field.erase(0, field.find_first_not_of(" \t\r"));
+    field.erase(field.find_last_not_of(" \t\r") + 1);
+    fields.push_back(std::move(field));
+    if (end == std::string::npos) {
+      return fields;
+    }
+    start = end + 1;
+  }
+}
+
+std::size_t run_csv(const Outputs& outputs, const Options& options) {
+  std::ifstream input_file;
+  std::ofstream output_file;
+  if (!options.input.empty()) {
+    input_file.open(options.input);
+    if (!input_file) {
+      throw std::runtime_error("can not open " + options.input);
+    }
+  }
+  if (!options.output.empty()) {
+    output_file.open(options.output);
+    if (!output_file) {
+      throw std::runtime_error("can not open " + options.output);
+    }
+  }
+  std::istream& in = options.input.empty() ? std::cin : input_file;
+  std::ostream& out = options.output.empty() ? std::cout : output_file;
+
+  std::string line;
+  if (!std::getline(in, line)) {
+    throw std::runtime_error("missing CSV header");
+  }
+  const auto names = split_csv_line(line);
+  const auto binding = bind_columns(outputs, names);
+  for (std::size_t o = 0; o < outputs.names.size(); ++o) {
+    out << (o == 0 ? "" : ",") << outputs.names[o];
+  }
+  out << '\n';
+
+  // rows are streamed in chunks of threads * block rows, each chunk is evaluated in parallel
+  const std::size_t chunk = options.block * options.threads;
+  std::vector<std::vector<double>> columns(names.size(), std::vector<double>(chunk));
+  std::vector<std::vector<double>> results(outputs.names.size(), std::vector<double>(chunk));
+  std::vector<const double*> inputs;
+  for (std::size_t column : binding) {
+    inputs.push_back(column == UNBOUND ? nullptr : columns[column].data());
+  }
+  std::vector<double*> result_columns;
+  for (auto& result : results) {
+    result_columns.push_back(result.data());
+  }
+
+  std::size_t total = 0;
+  char buffer[32];
+  while (in) {
+    std::size_t rows = 0;
+    while (rows < chunk && std::getline(in, line)) {
+      if (line.empty() || line == "\r") {
+        continue;
+      }
+      const auto fields = split_csv_line(line);
+      if (fields.size() != names.size()) {
+        throw std::runtime_error("row " + std::to_string(total + rows + 1) + " has the wrong number of fields");
+      }
+      for (std::size_t c = 0; c < fields.size(); ++c) {
+        const auto [end, ec] = std::from_chars(fields[c].data(), fields[c].data() + fields[c].size(), columns[c][rows]);
+        if (ec != std::errc()) {
+          throw std::runtime_error("invalid number '" + fields[c] + "' in row " + std::to_string(total + rows + 1));
+        }
+      }
+      rows++;
+    }
+    evaluate_parallel(outputs, inputs, result_columns, rows, options);
+    for (std::size_t r = 0; r < rows; ++r) {
+      for (std::size_t o = 0; o < results.size(); ++o) {
+        const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), results[o][r]);
+        if (o > 0) {
+          out << ',';
+        }
+        out.write(buffer, end - buffer);
+      }
+      out << '\n';
+    }
+    total += rows;
+  }
+  return total;
+}
+
+Options parse_arguments(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::runtime_error("missing value for " + arg);
+      }
+      return argv[++i];
+    };
+    if (arg == "-i" || arg == "--input") {
+      options.input = value();
+    } else if (arg == "-o" || arg == "--output") {
+      options.output = value();
+    } else if (arg == "-d" || arg == "--derivative") {
+      options.derivatives.push_back(value());
+    } else if (arg == "-t" || arg == "--threads") {
+      options.threads = std::max<std::size_t>(std::stoul(value()), 1);
+    } else if (arg == "-b" || arg == "--block") {
+      options.block = std::max<std::size_t>(std::stoul(value()), 1);
+    } else if (options.expression.empty()) {
+      options.expression = arg;
+    } else {
+      throw std::runtime_error("unexpected argument " + arg);
+    }
+  }
+  if (options.expression.empty()) {
+    throw std::runtime_error("usage: fsd_eval [-i input] [-o output] [-d var]... [-t threads] [-b block] <expression>");
+  }
+  return options;
+}
+
+bool is_csv(const std::string& path) { return path.empty() || path.ends_with(".csv"); }
+
+/// true if both paths name the same existing file, also through links
+bool same_file(const std::string& lhs, const std::string& rhs) {
+  struct stat lhs_stat {};
+  struct stat rhs_stat {};
+  if (lhs.empty() || rhs.empty() || ::stat(lhs.c_str(), &lhs_stat) != 0 || ::stat(rhs.c_str(), &rhs_stat) != 0) {
+    return false;
+  }
+  return lhs_stat.st_dev == rhs_stat.st_dev && lhs_stat.st_ino == rhs_stat.st_ino;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    const Options options = parse_arguments(argc, argv);
+    // the output is truncated before the input is read (and mapped)
+    if (same_file(options.input, options.output)) {
+      throw std::runtime_error("input and output are the same file");
+    }
+    auto expr = fsd::parse(options.expression);
+    if (!expr.has_value()) {
+      std::cerr << "Error parsing expression at position " << expr.error().position << std::endl;
+      return 1;
+    }
+
+    Outputs outputs;
+    outputs.names.emplace_back("f");
+    outputs.exprs.push_back(fsd::flatten(*expr.value()));
+    // interning the derivative variables up front keeps one symbol table for all outputs
+    for (const auto& var : options.derivatives) {
+      outputs.exprs.front().intern(var);
+    }
+    for (const auto& var : options.derivatives) {
+      outputs.names.push_back("df/d" + var);
+      outputs.exprs.push_back(outputs.exprs.front().derivative(var));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::size_t rows = is_csv(options.input) ? run_csv(outputs, options) : run_columnar(outputs, options);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << rows << " rows in " << elapsed.count() << " s (" << static_cast<double>(rows) / elapsed.count()
+              << " rows/s)" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}